@@ -0,0 +1,62 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, calloc, free, atoi     */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+
+#include "matmul.h"
+
+/*
+ *  main - @count independent N x N products, one mm_gemm_block call each
+ *         and then as one mm_gemm_batch_strided call
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    if (argc < 3 || argc > 4)
+        return mm_usage(argv[0], "<N> <count> [verify]");
+
+    uint32_t N      = atoi(argv[1]);
+    uint32_t count  = atoi(argv[2]);
+    uint32_t VERIFY = argc == 4 ? atoi(argv[3]) : 0;
+    uint64_t nn     = (uint64_t)N * N;
+
+    if (!N || !count)
+        return mm_usage(argv[0], "<N> <count> [verify]");
+
+    /* allocate space for matrices, product i at offset i * N * N */
+    int64_t *m1 = mm_alloc(nn * count * sizeof(int64_t));
+    int64_t *m2 = mm_alloc(nn * count * sizeof(int64_t));
+    int64_t *r  = mm_alloc(nn * count * sizeof(int64_t));
+
+    /* initialize matrices */
+    for (uint32_t i=0; i<count; i++)
+        init_matrices(N, &m1[i*nn], &m2[i*nn]);
+
+    double wc_start = mm_wtime();
+    for (uint32_t i=0; i<count; i++)
+        mm_gemm_block(N, N, N, &m1[i*nn], N, &m2[i*nn], N, &r[i*nn], N, 0);
+    double loop = mm_wtime() - wc_start;
+
+    wc_start = mm_wtime();
+    mm_gemm_batch_strided(N, N, N, m1, N, nn, m2, N, nn, r, N, nn, 0, count);
+    double batch = mm_wtime() - wc_start;
+
+    double ops = 2.0 * nn * N * count;
+    printf("%u x %ux%u, %u threads\n", count, N, N, mm_get_num_threads());
+    printf("block loop: %.6f s %.2f GOP/s\n", loop, ops / loop / 1e9);
+    printf("batched:    %.6f s %.2f GOP/s\n", batch, ops / batch / 1e9);
+
+    if (VERIFY) {
+        uint32_t ok = 1;
+        for (uint32_t i=0; i<count && ok; i++)
+            ok = verify_matrix(N, &m1[i*nn], &m2[i*nn], &r[i*nn]);
+        printf("Matrix verification %s\n", ok ? "ok" : "failed");
+    }
+
+    mm_free(m1);
+    mm_free(m2);
+    mm_free(r);
+    return 0;
+}
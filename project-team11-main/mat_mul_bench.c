@@ -0,0 +1,424 @@
+#include <stdio.h>      /* printf, fprintf                */
+#include <stdlib.h>     /* malloc, calloc, free, atoi     */
+#include <string.h>     /* strcmp, strdup, strtok_r       */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <math.h>       /* sqrt, ceil                     */
+#include <unistd.h>     /* getopt                         */
+
+#include "matmul.h"
+
+/*
+ *  Benchmark driver: sweeps kernels x shapes x thread counts x block sizes
+ *  in one process. Each configuration gets warm-up runs, then is repeated
+ *  until the 95% confidence interval of the mean is within the requested
+ *  fraction of it (or the repetition / time budget runs out), and one CSV
+ *  or JSON record is written with the timing statistics, GOP/s and the
+ *  counter averages per run.
+ */
+
+#define MAX_LIST 64
+
+struct bench_opts {
+    const char *kernels;
+    const char *sizes;
+    const char *dtypes;
+    const char *threads;
+    const char *blocks;
+    const char *events;
+    int json;
+    uint32_t warmup;
+    uint32_t min_reps;
+    uint32_t max_reps;
+    double ci;          /* target CI half-width / mean */
+    double max_time;    /* seconds of measured runs per configuration */
+    int verify;
+};
+
+struct bench_result {
+    const struct mm_kernel *k;
+    enum mm_dtype dt;
+    mm_gemm_any_fn any;     /* typed build of k, NULL for int64 */
+    uint32_t M, K, N;
+    uint32_t threads;
+    uint32_t block;     /* 0: kernel has no block size */
+    uint32_t reps;
+    double median, p95, mean, stddev, ci, min;
+    int verified;       /* -1 not checked, 0 failed, 1 ok */
+    int64_t counters[MM_PERF_MAX_EVENTS];
+};
+
+/* two-sided 95% Student t quantiles for 1..30 degrees of freedom */
+static const double t95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static double
+t_quantile(uint32_t df)
+{
+    if (df == 0)
+        return INFINITY;
+    if (df <= 30)
+        return t95[df-1];
+    return df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+}
+
+/*
+ *  parse_list - comma separated unsigned numbers
+ *      @return: number of entries
+ */
+static uint32_t
+parse_list(const char *s, uint32_t *out)
+{
+    char *dup = strdup(s), *save = NULL;
+    uint32_t n = 0;
+
+    for (char *tok = strtok_r(dup, ",", &save); tok && n < MAX_LIST;
+         tok = strtok_r(NULL, ",", &save))
+        out[n++] = atoi(tok);
+    free(dup);
+    return n;
+}
+
+/*
+ *  parse_kernels - comma separated kernel names, or "all"
+ *      @return: number of entries
+ */
+static uint32_t
+parse_kernels(const char *s, const struct mm_kernel **out)
+{
+    char *dup = strdup(s), *save = NULL;
+    uint32_t n = 0;
+
+    if (!strcmp(s, "all")) {
+        for (uint32_t i=0; i<mm_kernel_count() && n < MAX_LIST; i++)
+            out[n++] = mm_kernel_at(i);
+        free(dup);
+        return n;
+    }
+    for (char *tok = strtok_r(dup, ",", &save); tok && n < MAX_LIST;
+         tok = strtok_r(NULL, ",", &save)) {
+        const struct mm_kernel *k = mm_kernel_find(tok);
+        if (k)
+            out[n++] = k;
+        else
+            fprintf(stderr, "unknown kernel %s, skipped\n", tok);
+    }
+    free(dup);
+    return n;
+}
+
+/*
+ *  parse_shapes - comma separated "N" or "MxKxN" entries
+ *      @return: number of entries
+ */
+static uint32_t
+parse_shapes(const char *s, uint32_t (*out)[3])
+{
+    char *dup = strdup(s), *save = NULL;
+    uint32_t n = 0;
+
+    for (char *tok = strtok_r(dup, ",", &save); tok && n < MAX_LIST;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (!mm_parse_shape(tok, &out[n][0], &out[n][1], &out[n][2]))
+            n++;
+        else
+            fprintf(stderr, "bad shape %s, skipped\n", tok);
+    }
+    free(dup);
+    return n;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ *  parse_dtypes - comma separated dtype names
+ *      @return: number of entries
+ */
+static uint32_t
+parse_dtypes(const char *s, enum mm_dtype *out)
+{
+    char *dup = strdup(s), *save = NULL;
+    uint32_t n = 0;
+
+    for (char *tok = strtok_r(dup, ",", &save); tok && n < MAX_LIST;
+         tok = strtok_r(NULL, ",", &save)) {
+        int dt = mm_dtype_parse(tok);
+        if (dt >= 0)
+            out[n++] = dt;
+        else
+            fprintf(stderr, "unknown dtype %s, skipped\n", tok);
+    }
+    free(dup);
+    return n;
+}
+
+static void
+run_once(const struct bench_result *res, const void *m1, const void *m2,
+         void *r)
+{
+    uint32_t M = res->M, K = res->K, N = res->N;
+
+    if (res->any)
+        res->any(M, N, K, m1, K, m2, N, r, N, 0);
+    else
+        res->k->gemm(M, N, K, m1, K, m2, N, r, N, 0);
+}
+
+/*
+ *  run_config - time one kernel / shape / dtype / thread count / block size
+ */
+static void
+run_config(const struct bench_opts *o, struct mm_perf *pmc,
+           struct bench_result *res, const void *m1, const void *m2,
+           void *r)
+{
+    uint32_t M = res->M, K = res->K, N = res->N;
+    uint32_t nev = mm_perf_group_size(pmc);
+    double *t = malloc(o->max_reps * sizeof(double));
+    int64_t c0[MM_PERF_MAX_EVENTS], c1[MM_PERF_MAX_EVENTS];
+    double sum = 0, sumsq = 0, spent = 0;
+    uint32_t n = 0;
+
+    for (uint32_t e=0; e<nev; e++)
+        res->counters[e] = 0;
+
+    for (uint32_t w=0; w<o->warmup; w++)
+        run_once(res, m1, m2, r);
+
+    res->verified = -1;
+    while (n < o->max_reps) {
+        mm_perf_group_read(pmc, c0);
+        double start = mm_wtime();
+        run_once(res, m1, m2, r);
+        t[n] = mm_wtime() - start;
+        mm_perf_group_read(pmc, c1);
+
+        for (uint32_t e=0; e<nev; e++)
+            res->counters[e] = c0[e] < 0 || c1[e] < 0 || res->counters[e] < 0 ?
+                               -1 : res->counters[e] + c1[e] - c0[e];
+        if (o->verify && n == 0)
+            res->verified = mm_dtype_verify(res->dt, M, N, K, m1, K, m2, N, r, N);
+
+        sum += t[n];
+        sumsq += t[n] * t[n];
+        spent += t[n];
+        n++;
+
+        double mean = sum / n;
+        double var = n > 1 ? (sumsq - n * mean * mean) / (n - 1) : 0;
+        res->stddev = var > 0 ? sqrt(var) : 0;
+        res->ci = t_quantile(n - 1) * res->stddev / sqrt(n) / mean;
+        if (n >= o->min_reps && (res->ci <= o->ci || spent >= o->max_time))
+            break;
+    }
+
+    qsort(t, n, sizeof(double), cmp_double);
+    res->reps = n;
+    res->mean = sum / n;
+    res->min = t[0];
+    res->median = n % 2 ? t[n/2] : (t[n/2-1] + t[n/2]) / 2;
+    res->p95 = t[(uint32_t)ceil(0.95 * n) - 1];
+    for (uint32_t e=0; e<nev; e++)
+        if (res->counters[e] >= 0)
+            res->counters[e] /= n;
+    free(t);
+}
+
+static void
+print_header(const struct bench_opts *o, const struct mm_perf *pmc)
+{
+    if (o->json) {
+        printf("[\n");
+        return;
+    }
+    printf("kernel,dtype,m,k,n,threads,block,reps,median_s,p95_s,mean_s,stddev_s,"
+           "ci95_rel,min_s,gops,verified");
+    for (uint32_t e=0; e<mm_perf_group_size(pmc); e++)
+        printf(",%s", mm_perf_group_name(pmc, e));
+    printf("\n");
+}
+
+static void
+print_result(const struct bench_opts *o, const struct mm_perf *pmc,
+             const struct bench_result *res, int first)
+{
+    /* one multiply-add counts as two int64 operations */
+    double gops = 2.0 * res->M * res->N * res->K / res->median / 1e9;
+    const char *ver = res->verified < 0 ? "" : res->verified ? "ok" : "failed";
+    uint32_t nev = mm_perf_group_size(pmc);
+
+    if (!o->json) {
+        printf("%s,%s,%u,%u,%u,%u,%u,%u,%.9f,%.9f,%.9f,%.9f,%.4f,%.9f,%.3f,%s",
+               res->k->name, mm_dtype_name(res->dt), res->M, res->K, res->N,
+               res->threads, res->block, res->reps, res->median, res->p95, res->mean, res->stddev, res->ci,
+               res->min, gops, ver);
+        for (uint32_t e=0; e<nev; e++)
+            if (res->counters[e] >= 0)
+                printf(",%ld", res->counters[e]);
+            else
+                printf(",");
+        printf("\n");
+        return;
+    }
+
+    printf("%s  {\"kernel\": \"%s\", \"dtype\": \"%s\", \"m\": %u, \"k\": %u, \"n\": %u, \"threads\": %u, \"block\": %u, "
+           "\"reps\": %u, \"median_s\": %.9f, \"p95_s\": %.9f, \"mean_s\": %.9f, "
+           "\"stddev_s\": %.9f, \"ci95_rel\": %.4f, \"min_s\": %.9f, "
+           "\"gops\": %.3f, \"verified\": %s, \"counters\": {",
+           first ? "" : ",\n", res->k->name, mm_dtype_name(res->dt), res->M, res->K, res->N, res->threads, res->block,
+           res->reps, res->median, res->p95, res->mean, res->stddev, res->ci,
+           res->min, gops,
+           res->verified < 0 ? "null" : res->verified ? "true" : "false");
+    for (uint32_t e=0; e<nev; e++) {
+        printf("%s\"%s\": ", e ? ", " : "", mm_perf_group_name(pmc, e));
+        if (res->counters[e] >= 0)
+            printf("%ld", res->counters[e]);
+        else
+            printf("null");
+    }
+    printf("}}");
+}
+
+/*
+ *  main - parse the sweep, run every configuration, write the records
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    char default_threads[16];
+    struct bench_opts o = {
+        .kernels = "all",
+        .sizes = "256,512,1024",
+        .dtypes = "i64",
+        .warmup = 1,
+        .min_reps = 5,
+        .max_reps = 50,
+        .ci = 0.02,
+        .max_time = 10,
+    };
+    const char *args = "[-k kernels|all] [-n N|MxKxN,...] [-d dtypes] [-t threads] "
+                       "[-b blocks] [-e events] [-w warmup] [-r min_reps >= 2] "
+                       "[-R max_reps] [-c ci] [-T seconds] [-f csv|json] [-v]";
+    int opt;
+
+    snprintf(default_threads, sizeof(default_threads), "%u", mm_get_num_threads());
+    o.threads = default_threads;
+
+    while ((opt = getopt(argc, argv, "k:n:d:t:b:e:w:r:R:c:T:f:v")) != -1) {
+        switch (opt) {
+        case 'k': o.kernels = optarg; break;
+        case 'n': o.sizes = optarg; break;
+        case 'd': o.dtypes = optarg; break;
+        case 't': o.threads = optarg; break;
+        case 'b': o.blocks = optarg; break;
+        case 'e': o.events = optarg; break;
+        case 'w': o.warmup = atoi(optarg); break;
+        case 'r': o.min_reps = atoi(optarg); break;
+        case 'R': o.max_reps = atoi(optarg); break;
+        case 'c': o.ci = atof(optarg); break;
+        case 'T': o.max_time = atof(optarg); break;
+        case 'f': o.json = !strcmp(optarg, "json"); break;
+        case 'v': o.verify = 1; break;
+        default:
+            return mm_usage(argv[0], args);
+        }
+    }
+    /* a confidence interval needs two runs */
+    if (o.min_reps < 2)
+        return mm_usage(argv[0], args);
+    if (o.max_reps < o.min_reps)
+        o.max_reps = o.min_reps;
+
+    const struct mm_kernel *kernels[MAX_LIST];
+    enum mm_dtype dtypes[MAX_LIST];
+    uint32_t shapes[MAX_LIST][3], threads[MAX_LIST], blocks[MAX_LIST];
+    uint32_t nk = parse_kernels(o.kernels, kernels);
+    uint32_t nn = parse_shapes(o.sizes, shapes);
+    if (!nn)
+        return mm_usage(argv[0], args);
+    uint32_t nd = parse_dtypes(o.dtypes, dtypes);
+    uint32_t nt = parse_list(o.threads, threads);
+    /* no -b: every kernel runs at its own block size / crossover */
+    uint32_t nb = o.blocks ? parse_list(o.blocks, blocks) : 0;
+
+    /* opened before any kernel runs, so it inherits into the pool threads */
+    struct mm_perf *pmc = mm_perf_group(o.events, MM_PERF_THREADS);
+    mm_perf_group_start(pmc);
+
+    print_header(&o, pmc);
+    int first = 1;
+
+    /* every shape in every dtype */
+    for (uint32_t in=0; in<nn*nd; in++) {
+        uint32_t M = shapes[in/nd][0], K = shapes[in/nd][1], N = shapes[in/nd][2];
+        enum mm_dtype dt = dtypes[in%nd];
+        uint32_t es = mm_dtype_size(dt);
+        void *m1 = mm_alloc((uint64_t)M * K * es);
+        void *m2 = mm_alloc((uint64_t)K * N * es);
+        void *r  = mm_alloc((uint64_t)M * N * mm_dtype_acc_size(dt));
+        mm_dtype_init(dt, M, K, m1, K);
+        mm_dtype_init(dt, K, N, m2, N);
+
+        for (uint32_t ik=0; ik<nk; ik++) {
+            const struct mm_kernel *k = kernels[ik];
+            mm_gemm_any_fn any = dt != MM_DTYPE_I64 ? mm_dtype_kernel(k, dt) : NULL;
+            if (dt != MM_DTYPE_I64 && !any) {
+                fprintf(stderr, "%s: no %s build, skipped\n", k->name,
+                        mm_dtype_name(dt));
+                continue;
+            }
+            if (!mm_kernel_supports(k, M) || !mm_kernel_supports(k, K) ||
+                !mm_kernel_supports(k, N)) {
+                fprintf(stderr, "%s: %ux%ux%u is not a multiple of %u, skipped\n",
+                        k->name, M, K, N, k->align);
+                continue;
+            }
+
+            /* only sweep the axes the kernel actually has */
+            uint32_t kt = k->threaded == MM_THREADS_ANY ? nt : 1;
+            uint32_t kb = mm_kernel_has_block(k) && nb ? nb : 1;
+
+            for (uint32_t it=0; it<kt; it++) {
+                for (uint32_t ib=0; ib<kb; ib++) {
+                    struct bench_result res = {
+                        .k = k, .dt = dt, .any = any, .M = M, .K = K, .N = N,
+                    };
+
+                    res.threads = k->threaded == MM_THREADS_ANY ? threads[it] :
+                                  k->threaded ? k->threaded : 1;
+                    res.block = !mm_kernel_has_block(k) ? 0 :
+                                nb ? blocks[ib] : mm_kernel_get_block(k);
+                    mm_set_num_threads(k->threaded == MM_THREADS_ANY ? threads[it] : 0);
+                    if (res.block)
+                        mm_kernel_set_block(k, res.block);
+
+                    fprintf(stderr, "%s %s %ux%ux%u threads=%u block=%u\n",
+                            k->name, mm_dtype_name(dt), M, K, N, res.threads,
+                            res.block);
+                    run_config(&o, pmc, &res, m1, m2, r);
+                    print_result(&o, pmc, &res, first);
+                    first = 0;
+                    fflush(stdout);
+                }
+            }
+        }
+
+        mm_free(m1);
+        mm_free(m2);
+        mm_free(r);
+    }
+
+    if (o.json)
+        printf("\n]\n");
+    mm_perf_group_close(pmc);
+    return 0;
+}
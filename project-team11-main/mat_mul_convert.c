@@ -0,0 +1,294 @@
+#include <stdio.h>      /* FILE, fopen, getline, fprintf  */
+#include <stdlib.h>     /* strtoll, strtod, free          */
+#include <string.h>     /* strcmp, strrchr, memcpy        */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <unistd.h>     /* getopt, unlink                 */
+
+#include "matmul.h"
+
+/*
+ *  Converts between matrix files (.mmt), CSV (.csv) and raw row-major
+ *  binary (anything else). Rows go one at a time through a row buffer, so
+ *  a matrix larger than memory converts too; a .mmt side is mmap'd.
+ */
+
+enum fmt { FMT_MMT, FMT_CSV, FMT_RAW };
+
+static enum fmt
+format_of(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+
+    if (dot && !strcmp(dot, ".mmt"))
+        return FMT_MMT;
+    if (dot && !strcmp(dot, ".csv"))
+        return FMT_CSV;
+    return FMT_RAW;
+}
+
+static int
+is_sep(char c)
+{
+    return c == ',' || c == ';' || c == ' ' || c == '\t';
+}
+
+/*
+ *  csv_shape - rows (non-empty lines) and columns (fields of the first
+ *              line) of a CSV file
+ */
+static int
+csv_shape(FILE *in, uint32_t *rows, uint32_t *cols)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    *rows = *cols = 0;
+    while ((len = getline(&line, &cap, in)) > 0) {
+        char *p = line;
+        while (is_sep(*p))
+            p++;
+        if (*p == '\n' || *p == '\r' || !*p)
+            continue;
+        if (!(*rows)++)
+            for (; *p && *p != '\n' && *p != '\r'; (*cols)++) {
+                while (*p && !is_sep(*p) && *p != '\n' && *p != '\r')
+                    p++;
+                while (is_sep(*p))
+                    p++;
+            }
+    }
+    free(line);
+    rewind(in);
+    return *rows && *cols ? 0 : -1;
+}
+
+/* parse element text into a @dt element */
+static void
+put(enum mm_dtype dt, void *row, uint32_t j, const char *s, char **end)
+{
+    switch (dt) {
+    case MM_DTYPE_I64: ((int64_t *)row)[j] = strtoll(s, end, 10); break;
+    case MM_DTYPE_I8:  ((int8_t *)row)[j]  = strtol(s, end, 10);  break;
+    case MM_DTYPE_I16: ((int16_t *)row)[j] = strtol(s, end, 10);  break;
+    case MM_DTYPE_I32: ((int32_t *)row)[j] = strtol(s, end, 10);  break;
+    case MM_DTYPE_F32: ((float *)row)[j]   = strtof(s, end);      break;
+    case MM_DTYPE_F64: ((double *)row)[j]  = strtod(s, end);      break;
+    }
+}
+
+static void
+print(FILE *out, enum mm_dtype dt, const void *row, uint32_t j)
+{
+    switch (dt) {
+    case MM_DTYPE_I64: fprintf(out, "%ld", ((const int64_t *)row)[j]); break;
+    case MM_DTYPE_I8:  fprintf(out, "%d", ((const int8_t *)row)[j]);   break;
+    case MM_DTYPE_I16: fprintf(out, "%d", ((const int16_t *)row)[j]);  break;
+    case MM_DTYPE_I32: fprintf(out, "%d", ((const int32_t *)row)[j]);  break;
+    case MM_DTYPE_F32: fprintf(out, "%.9g", ((const float *)row)[j]);  break;
+    case MM_DTYPE_F64: fprintf(out, "%.17g", ((const double *)row)[j]); break;
+    }
+}
+
+/*
+ *  csv_row - next non-empty line of @in into @row
+ *      @return: 0, -1 if the line is short or the file ended
+ */
+static int
+csv_row(FILE *in, enum mm_dtype dt, uint32_t cols, void *row, char **line,
+        size_t *cap)
+{
+    char *p, *end;
+
+    do {
+        if (getline(line, cap, in) <= 0)
+            return -1;
+        for (p = *line; is_sep(*p); p++)
+            ;
+    } while (*p == '\n' || *p == '\r' || !*p);
+
+    for (uint32_t j=0; j<cols; j++) {
+        put(dt, row, j, p, &end);
+        if (end == p)
+            return -1;
+        for (p = end; is_sep(*p); p++)
+            ;
+    }
+    return 0;
+}
+
+/* element (i, j) of a mapped matrix file */
+static const void *
+mmt_at(const struct mm_tfile *f, const char *data, uint32_t i, uint32_t j)
+{
+    uint32_t size = mm_dtype_size(f->dtype), T = f->tile;
+
+    if (f->layout == MM_LAYOUT_ROWS)
+        return &data[((uint64_t)i * f->cols + j) * size];
+    return (const char *)mm_tfile_tile(f, i / T, j / T) +
+           ((uint64_t)(i % T) * T + j % T) * size;
+}
+
+/* copy one row between a row buffer and a mapped matrix file */
+static void
+mmt_row(const struct mm_tfile *f, char *data, uint32_t i, void *row, int store)
+{
+    uint32_t size = mm_dtype_size(f->dtype);
+    uint32_t run = f->layout == MM_LAYOUT_ROWS ? f->cols : f->tile;
+
+    /* contiguous runs: the whole row, or its part inside one tile */
+    for (uint32_t j=0; j<f->cols; j+=run) {
+        char *m = (char *)mmt_at(f, data, i, j);
+        char *r = (char *)row + (uint64_t)j * size;
+        uint64_t n = (uint64_t)min(run, f->cols - j) * size;
+        if (store)
+            memcpy(m, r, n);
+        else
+            memcpy(r, m, n);
+    }
+}
+
+/*
+ *  main - convert @in to @out
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    const char *args = "[-d dtype] [-t tile] [-s RxC] [-c] <in> <out>\n"
+                       "  .mmt: matrix file, .csv: text, else raw row-major binary\n"
+                       "  -d: element type of csv/raw input (default i64)\n"
+                       "  -t: tile size of a .mmt output, 0 for row-major (default)\n"
+                       "  -s: shape of raw input\n"
+                       "  -c: verify the checksum of a .mmt input";
+    enum mm_dtype dt = MM_DTYPE_I64;
+    uint32_t tile = 0, rows = 0, cols = 0;
+    int check = 0, opt, d;
+
+    while ((opt = getopt(argc, argv, "d:t:s:c")) != -1) {
+        switch (opt) {
+        case 'd':
+            if ((d = mm_dtype_parse(optarg)) < 0)
+                return mm_usage(argv[0], args);
+            dt = d;
+            break;
+        case 't': tile = atoi(optarg); break;
+        case 's':
+            if (sscanf(optarg, "%ux%u", &rows, &cols) != 2)
+                return mm_usage(argv[0], args);
+            break;
+        case 'c': check = 1; break;
+        default:
+            return mm_usage(argv[0], args);
+        }
+    }
+    if (argc - optind != 2)
+        return mm_usage(argv[0], args);
+
+    const char *inp = argv[optind], *outp = argv[optind+1];
+    enum fmt fi = format_of(inp), fo = format_of(outp);
+    struct mm_tfile *fin = NULL, *fout = NULL;
+    FILE *in = NULL, *out = NULL;
+    char *in_data = NULL, *out_data = NULL, *line = NULL;
+    size_t cap = 0;
+    int ret = -1;
+
+    /* open the input and find its shape and type */
+    if (fi == FMT_MMT) {
+        if (!(fin = mm_tfile_open(inp, 0)) || !(in_data = mm_tfile_map(fin))) {
+            perror(inp);
+            goto done;
+        }
+        if (check) {
+            int ok = mm_tfile_verify(fin);
+            printf("%s: checksum %s\n", inp, ok > 0 ? "ok" : "MISMATCH");
+            if (ok <= 0)
+                goto done;
+        }
+        rows = fin->rows;
+        cols = fin->cols;
+        dt = fin->dtype;
+    } else {
+        if (!(in = fopen(inp, fi == FMT_CSV ? "r" : "rb"))) {
+            perror(inp);
+            goto done;
+        }
+        if (fi == FMT_CSV && csv_shape(in, &rows, &cols)) {
+            fprintf(stderr, "%s: no numbers\n", inp);
+            goto done;
+        }
+        if (!rows || !cols) {
+            fprintf(stderr, "raw input needs -s RxC\n");
+            goto done;
+        }
+    }
+
+    /* and create the output */
+    if (fo == FMT_MMT) {
+        if (!(fout = mm_tfile_create(outp, rows, cols, dt, tile)) ||
+            !(out_data = mm_tfile_map(fout))) {
+            perror(outp);
+            goto done;
+        }
+    } else if (!(out = fopen(outp, fo == FMT_CSV ? "w" : "wb"))) {
+        perror(outp);
+        goto done;
+    }
+
+    uint32_t size = mm_dtype_size(dt);
+    void *row = malloc((uint64_t)cols * size);
+    double wc_start = mm_wtime();
+
+    for (uint32_t i=0; i<rows; i++) {
+        if (fi == FMT_MMT)
+            mmt_row(fin, in_data, i, row, 0);
+        else if (fi == FMT_CSV && csv_row(in, dt, cols, row, &line, &cap)) {
+            fprintf(stderr, "%s: row %u is short or not a number\n", inp, i + 1);
+            free(row);
+            goto done;
+        } else if (fi == FMT_RAW && fread(row, size, cols, in) != cols) {
+            fprintf(stderr, "%s: ends at row %u\n", inp, i + 1);
+            free(row);
+            goto done;
+        }
+
+        if (fo == FMT_MMT)
+            mmt_row(fout, out_data, i, row, 1);
+        else if (fo == FMT_RAW)
+            fwrite(row, size, cols, out);
+        else
+            for (uint32_t j=0; j<cols; j++) {
+                print(out, dt, row, j);
+                fputc(j + 1 < cols ? ',' : '\n', out);
+            }
+    }
+    free(row);
+
+    ret = 0;
+    if (out && fclose(out)) {
+        perror(outp);
+        ret = -1;
+    }
+    out = NULL;
+    if (fout && mm_tfile_close(fout)) {
+        perror(outp);
+        ret = -1;
+    }
+    fout = NULL;
+    printf("%s -> %s: %ux%u %s, %.3f s\n", inp, outp, rows, cols,
+           mm_dtype_name(dt), mm_wtime() - wc_start);
+
+done:
+    /* a half-converted output must not look like a good one: remove it */
+    if (ret && (out || fout))
+        unlink(outp);
+    free(line);
+    if (in)
+        fclose(in);
+    if (out)
+        fclose(out);
+    mm_tfile_close(fin);
+    mm_tfile_close(fout);
+    return ret;
+}
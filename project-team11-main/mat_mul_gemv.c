@@ -0,0 +1,131 @@
+#include <stdio.h>      /* printf, sscanf                 */
+#include <stdlib.h>     /* atoi                           */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <unistd.h>     /* getopt                         */
+
+#include "matmul.h"
+
+/*
+ *  Times y = A x (or y = A^T x with -t) through mm_gemv against the same
+ *  product run as an M x K x 1 GEMM through block, and reports the memory
+ *  bandwidth each reaches: A, x and y moved once, over the best of -r runs.
+ */
+
+/* y = A x or y = A^T x through the GEMV kernels */
+static void
+gemv(enum mm_dtype dt, int trans, uint32_t M, uint32_t K, const void *A,
+     const void *x, void *y)
+{
+    if (dt == MM_DTYPE_F32 && trans)
+        mm_gemv_t_f32(M, K, A, K, x, y, 0);
+    else if (dt == MM_DTYPE_F32)
+        mm_gemv_f32(M, K, A, K, x, y, 0);
+    else if (trans)
+        mm_gemv_t(M, K, A, K, x, y, 0);
+    else
+        mm_gemv(M, K, A, K, x, y, 0);
+}
+
+/* the same product as a GEMM with a one-wide B (or one-high A) */
+static void
+gemm(enum mm_dtype dt, int trans, uint32_t M, uint32_t K, const void *A,
+     const void *x, void *y)
+{
+    const struct mm_kernel *k = mm_kernel_find("block");
+    mm_gemm_any_fn fn = dt == MM_DTYPE_I64 ? (mm_gemm_any_fn)k->gemm :
+                                             mm_dtype_kernel(k, dt);
+
+    if (trans)
+        fn(1, K, M, x, M, A, K, y, K, 0);
+    else
+        fn(M, 1, K, A, K, x, 1, y, 1, 0);
+}
+
+/* best of @reps runs of @fn, after one warm-up run */
+static double
+best_time(void (*fn)(enum mm_dtype, int, uint32_t, uint32_t, const void *,
+                     const void *, void *),
+          enum mm_dtype dt, int trans, uint32_t M, uint32_t K, const void *A,
+          const void *x, void *y, uint32_t reps)
+{
+    double best = 0;
+
+    fn(dt, trans, M, K, A, x, y);
+    for (uint32_t r=0; r<reps; r++) {
+        double t = mm_wtime();
+        fn(dt, trans, M, K, A, x, y);
+        t = mm_wtime() - t;
+        if (r == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/*
+ *  main - time one matrix-vector product
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    const char *args = "[-d i64|f32] [-t] [-r reps] <N|MxK> [verify]\n"
+                       "  A is M x K (N x N); -t computes A^T x";
+    enum mm_dtype dt = MM_DTYPE_I64;
+    uint32_t reps = 5, M, K;
+    int trans = 0, opt, d;
+
+    while ((opt = getopt(argc, argv, "d:tr:")) != -1) {
+        switch (opt) {
+        case 'd':
+            d = mm_dtype_parse(optarg);
+            if (d != MM_DTYPE_I64 && d != MM_DTYPE_F32)
+                return mm_usage(argv[0], args);
+            dt = d;
+            break;
+        case 't': trans = 1; break;
+        case 'r': reps = atoi(optarg); break;
+        default:
+            return mm_usage(argv[0], args);
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2)
+        return mm_usage(argv[0], args);
+    switch (sscanf(argv[optind], "%ux%u", &M, &K)) {
+    case 1: K = M; break;
+    case 2: break;
+    default: return mm_usage(argv[0], args);
+    }
+    if (!M || !K || !reps)
+        return mm_usage(argv[0], args);
+
+    uint32_t VERIFY = argc - optind == 2 ? atoi(argv[optind+1]) : 0;
+    uint32_t size = mm_dtype_size(dt);
+    uint32_t nx = trans ? M : K, ny = trans ? K : M;
+    void *A = mm_alloc((uint64_t)M * K * size);
+    void *x = mm_alloc((uint64_t)nx * size);
+    void *y = mm_alloc((uint64_t)ny * size);
+
+    mm_dtype_init(dt, M, K, A, K);
+    mm_dtype_init(dt, 1, nx, x, nx);
+
+    double bytes = ((double)M * K + nx + ny) * size;
+    double t_gemm = best_time(gemm, dt, trans, M, K, A, x, y, reps);
+    double t_gemv = best_time(gemv, dt, trans, M, K, A, x, y, reps);
+
+    printf("%s %ux%u %s, %u threads, %s\n", trans ? "gemv_t" : "gemv", M, K,
+           mm_dtype_name(dt), mm_get_num_threads(), mm_gemv_simd_name());
+    printf("gemv:         %.6f s %.2f GB/s\n", t_gemv, bytes / t_gemv / 1e9);
+    printf("block (GEMM): %.6f s %.2f GB/s\n", t_gemm, bytes / t_gemm / 1e9);
+
+    if (VERIFY) {
+        int ok = trans ? mm_dtype_verify(dt, 1, K, M, x, M, A, K, y, K) :
+                         mm_dtype_verify(dt, M, 1, K, A, K, x, 1, y, 1);
+        printf("Matrix verification %s\n", ok ? "ok" : "failed");
+    }
+
+    mm_free(A);
+    mm_free(x);
+    mm_free(y);
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>      /* printf, perror, snprintf       */
+#include <stdlib.h>     /* atoi, strtoull                 */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <unistd.h>     /* unlink                         */
+
+#include "matmul.h"
+
+/*
+ *  fill - write every tile of @f with the element index, as
+ *         mm_init_matrix does in memory
+ */
+static int
+fill(struct mm_tfile *f, int64_t *t)
+{
+    uint32_t T = f->tile;
+
+    for (uint32_t ti=0; ti<f->trows; ti++)
+        for (uint32_t tj=0; tj<f->tcols; tj++) {
+            memset(t, 0, mm_tfile_tile_bytes(f));
+            for (uint32_t i=0; i<T && ti*T + i < f->rows; i++)
+                for (uint32_t j=0; j<T && tj*T + j < f->cols; j++)
+                    t[(uint64_t)i*T + j] = (uint64_t)(ti*T + i) * f->cols + tj*T + j;
+            if (mm_tfile_write(f, ti, tj, t))
+                return -1;
+        }
+    return 0;
+}
+
+/*
+ *  check - compare C with the closed form of the product of two index
+ *          matrices, one tile at a time, so no reference product is needed:
+ *          sum_k (i K + k)(k N + j) = i K N S1 + i K K j + N S2 + j S1
+ *          with S1 = sum k, S2 = sum k^2, all modulo 2^64 like the kernels
+ *      @return: 1 if C == A * B, 0 otherwise, -1 on a read error
+ */
+static int
+check(const struct mm_tfile *C, uint32_t K, int64_t *t)
+{
+    uint32_t T = C->tile, N = C->cols;
+    uint64_t s1 = (unsigned __int128)K * (K - 1) / 2;
+    uint64_t s2 = (unsigned __int128)K * (K - 1) * (2ull*K - 1) / 6;
+
+    for (uint32_t ti=0; ti<C->trows; ti++)
+        for (uint32_t tj=0; tj<C->tcols; tj++) {
+            if (mm_tfile_read(C, ti, tj, t))
+                return -1;
+            for (uint32_t i=0; i<T && ti*T + i < C->rows; i++)
+                for (uint32_t j=0; j<T && tj*T + j < N; j++) {
+                    uint64_t gi = ti*T + i, gj = tj*T + j;
+                    uint64_t v = gi*K*N*s1 + gi*K*K*gj + N*s2 + gj*s1;
+                    if ((uint64_t)t[(uint64_t)i*T + j] != v)
+                        return 0;
+                }
+        }
+    return 1;
+}
+
+/*
+ *  main - out-of-core product of two index matrices stored as tiled files
+ *         in @dir, which are removed afterwards
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    const char *args = "<N|MxKxN> <dir> [tile] [mem MiB] [verify]";
+
+    if (argc < 3 || argc > 6)
+        return mm_usage(argv[0], args);
+
+    uint32_t M, K, N;
+    uint32_t tile   = argc > 3 ? atoi(argv[3]) : 1024;
+    uint64_t mem    = argc > 4 ? strtoull(argv[4], NULL, 10) << 20 : 0;
+    uint32_t VERIFY = argc > 5 ? atoi(argv[5]) : 0;
+    char pa[4096], pb[4096], pc[4096];
+
+    if (mm_parse_shape(argv[1], &M, &K, &N) || !tile)
+        return mm_usage(argv[0], args);
+    snprintf(pa, sizeof(pa), "%s/A.mmt", argv[2]);
+    snprintf(pb, sizeof(pb), "%s/B.mmt", argv[2]);
+    snprintf(pc, sizeof(pc), "%s/C.mmt", argv[2]);
+
+    struct mm_tfile *A = mm_tfile_create(pa, M, K, MM_DTYPE_I64, tile);
+    struct mm_tfile *B = mm_tfile_create(pb, K, N, MM_DTYPE_I64, tile);
+    struct mm_tfile *C = mm_tfile_create(pc, M, N, MM_DTYPE_I64, tile);
+    int64_t *t = mm_alloc((uint64_t)tile * tile * sizeof(int64_t));
+    int ret = -1;
+
+    if (!A || !B || !C) {
+        perror("mm_tfile_create");
+        goto out;
+    }
+
+    double wc_start = mm_wtime();
+    if (fill(A, t) || fill(B, t)) {
+        perror("mm_tfile_write");
+        goto out;
+    }
+    double init = mm_wtime() - wc_start;
+
+    struct mm_ooc_stats st;
+    if (mm_gemm_ooc(A, B, C, NULL, mem, &st)) {
+        perror("mm_gemm_ooc");
+        goto out;
+    }
+
+    printf("ooc\n%ux%ux%u\n%.6f\n", M, K, N, st.seconds);
+    printf("tile %u, C block %ux%u tiles, memory %lu MiB\n", tile, st.bm, st.bn,
+           (unsigned long)((mem ? mem : mm_ooc_memory()) >> 20));
+    printf("write A, B: %.3f s\n", init);
+    printf("read %.2f GiB (%.2f GB/s), wrote %.2f GiB, waited %.3f s for I/O\n",
+           st.bytes_read / 1073741824.0, st.bytes_read / st.seconds / 1e9,
+           st.bytes_written / 1073741824.0, st.wait);
+    printf("%.2f GOP/s\n", 2.0 * M * K * N / st.seconds / 1e9);
+
+    ret = 0;
+    if (VERIFY) {
+        int ok = check(C, K, t);
+        if (ok < 0)
+            perror("mm_tfile_read");
+        printf("Matrix verification %s\n", ok > 0 ? "ok" : "failed");
+    }
+
+out:
+    mm_free(t);
+    mm_tfile_close(A);
+    mm_tfile_close(B);
+    mm_tfile_close(C);
+    unlink(pa);
+    unlink(pb);
+    unlink(pc);
+    return ret;
+}
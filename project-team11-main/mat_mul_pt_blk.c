@@ -101,7 +101,7 @@ print_matrix(uint32_t N, long *m)
 void
 verify_matrix(uint32_t N, int64_t *m1, int64_t *m2, int64_t *r)
 {
-    int64_t *v  = malloc(N * N * sizeof(int64_t));
+    int64_t *v  = calloc((uint64_t)N * N, sizeof(int64_t));
     for (uint32_t k=0; k<N; ++k)
         for (uint32_t i=0; i<N; ++i)
             for (uint32_t j=0; j<N; ++j)
@@ -4,38 +4,7 @@
 #include <string.h>     /* memset                         */
 #include <stdint.h>     /* uint32_t, uint64_t             */
 
-#define rdpmc(ecx, eax, edx)    \
-    asm volatile (              \
-        "rdpmc"                 \
-        : "=a"(eax),            \
-          "=d"(edx)             \
-        : "c"(ecx))
-
-/*
- *  usage - how to run the program
- *      @return: -1
- */
-int32_t
-usage(void)
-{
-    printf("\t./mat_mul <N>\n");
-    return -1;
-}
-
-/*
- *  print_matrix - if you need convincing that it works just fine
- *      @N: square matrix size
- *      @m: pointer to matrix
- */
-void
-print_matrix(uint32_t N, long *m)
-{
-    for (uint32_t i=0; i<N; ++i) {
-        for (uint32_t j=0; j<N; ++j)
-            printf("%3ld ", m[i*N + j]);
-        printf("\n");
-    }
-}
+#include "matmul.h"
 
 /*
  *  main - program entry point
@@ -46,86 +15,58 @@ int32_t
 main(int32_t argc, char *argv[])
 {
     if (argc != 2)
-        return usage();
+        return mm_usage(argv[0], "<N>");
 
     /* allocate space for matrices */
     clock_t t;
     uint32_t N   = atoi(argv[1]);
-    int64_t  *m1 = malloc(N * N * sizeof(int64_t));
-    int64_t  *m2 = malloc(N * N * sizeof(int64_t));
-    int64_t  *r  = malloc(N * N * sizeof(int64_t));
+    int64_t  *m1 = mm_alloc((uint64_t)N * N * sizeof(int64_t));
+    int64_t  *m2 = mm_alloc((uint64_t)N * N * sizeof(int64_t));
+    int64_t  *r  = mm_alloc((uint64_t)N * N * sizeof(int64_t));
 
     /* initialize matrices */
-    for (uint32_t i=0; i<N*N; ++i) {
-        m1[i] = i;
-        m2[i] = i;
-    }
+    init_matrices(N, m1, m2);
 
-    uint32_t edx=0, eax=0;
-    uint32_t n_edx=0, n_eax=0;
-    uint64_t start, end;
+    /* default event set (or MM_PERF), read with rdpmc where permitted */
+    struct mm_perf *pmc = mm_perf_group(NULL, 0);
+    printf("counters read with %s\n",
+           mm_perf_group_rdpmc(pmc) ? "rdpmc" : "read(2)");
 
-    /* result matrix clear; clock init */
-    memset(r, 0, N * N * sizeof(int64_t));
+    /* clock init */
     t = clock();
-
-    /* TODO: count L2 cache misses for the next block using RDPMC */
-    rdpmc(0, eax, edx);
+    mm_perf_group_start(pmc);
 
     /* perform slow multiplication */
-    for (uint32_t i=0; i<N; ++i)             /* line   */
-        for (uint32_t j=0; j<N; ++j)         /* column */
-            for (uint32_t k=0; k<N; ++k)
-                r[i*N + j] += m1[i*N + k] * m2[k*N + j];
+    mm_naive(N, m1, m2, r);
 
-    rdpmc(0, n_eax, n_edx);
+    mm_perf_group_stop(pmc);
 
     /* clock delta */
     t = clock() - t;
 
-    start = ((uint64_t) edx) << 32 | (uint64_t) eax;
-    end = ((uint64_t) n_edx) << 32 | (uint64_t) n_eax;
-
-    printf("%d %d\n", edx, eax);
-    printf("%d %d\n", n_edx, n_eax);
-    printf("%lu %lu\n", start, end);
-
-    printf("l2 cache miss: %lu\n", end-start);
+    mm_perf_group_print(pmc);
 
     printf("Multiplication 1 finished in %6.2f s\n",
            ((float)t)/CLOCKS_PER_SEC);
 
 
-    /* result matrix clear; clock init */
-    memset(r, 0, N * N * sizeof(int64_t));
+    /* clock init */
     t = clock();
-
-    /* TODO: count L2 cache misses for the next block using RDPMC */
-
-    rdpmc(0, eax, edx);
+    mm_perf_group_start(pmc);
 
     /* perform fast(er) multiplication */
-    for (uint32_t k=0; k<N; ++k)
-        for (uint32_t i=0; i<N; ++i)         /* line   */
-            for (uint32_t j=0; j<N; ++j)     /* column */
-                r[i*N + j] += m1[i*N + k] * m2[k*N + j];
+    mm_faster(N, m1, m2, r);
 
-    rdpmc(0, n_eax, n_edx);
+    mm_perf_group_stop(pmc);
 
     /* clock delta */
     t = clock() - t;
 
-    start = ((uint64_t) edx) << 32 | (uint64_t) eax;
-    end = ((uint64_t) n_edx) << 32 | (uint64_t) n_eax;
-
-    printf("%d %d\n", edx, eax);
-    printf("%d %d\n", n_edx, n_eax);
-    printf("%lu %lu\n", start, end);
-
-    printf("l2 cache miss: %lu\n", end-start);
+    mm_perf_group_print(pmc);
 
     printf("Multiplication 2 finished in %6.2f s\n",
            ((float)t)/CLOCKS_PER_SEC);
 
+    mm_perf_group_close(pmc);
     return 0;
 }
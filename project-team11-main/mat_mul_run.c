@@ -0,0 +1,172 @@
+#include <stdio.h>      /* printf                         */
+#include <time.h>       /* clock_t, clock, CLOCKS_PER_SEC */
+#include <stdlib.h>     /* malloc, calloc, free, atoi     */
+#include <string.h>     /* strcmp                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <math.h>       /* cbrt                           */
+
+#include "matmul.h"
+
+/*
+ *  list_kernels - print the registry
+ */
+static void
+list_kernels(void)
+{
+    for (uint32_t i=0; i<mm_kernel_count(); i++) {
+        const struct mm_kernel *k = mm_kernel_at(i);
+        printf("%-12s N%%%-4u %s\n", k->name, k->align, k->desc);
+    }
+    printf("tile micro-kernel: %s\n", mm_simd_name());
+    printf("typed kernels: %s\n", mm_dtype_simd_name());
+
+    const struct mm_blocking *bl = mm_packed_blocking();
+    printf("packed blocking: MC %u KC %u NC %u\n", bl->mc, bl->kc, bl->nc);
+    printf("numa nodes: %u\n", mm_numa_nodes());
+}
+
+/*
+ *  main - run any registered kernel by name
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    if (argc == 2 && !strcmp(argv[1], "list")) {
+        list_kernels();
+        return 0;
+    }
+    if (argc < 3 || argc > 4)
+        return mm_usage(argv[0], "<kernel|auto|list> <N|MxKxN|A.mmt:B.mmt> [verify]");
+
+    uint32_t M, K, N;
+    uint32_t VERIFY = argc == 4 ? atoi(argv[3]) : 0;
+    struct mm_tfile *fa = NULL, *fb = NULL;
+    char *colon = strchr(argv[2], ':');
+    double load = 0;
+
+    /* A.mmt:B.mmt runs on the mapped files, no copy */
+    if (colon) {
+        double wc_start = mm_wtime();
+        *colon = '\0';
+        if (!(fa = mm_tfile_open(argv[2], 0)) || !(fb = mm_tfile_open(colon + 1, 0)) ||
+            !mm_tfile_map(fa) || !mm_tfile_map(fb)) {
+            perror(fb || !fa ? colon + 1 : argv[2]);
+            return -1;
+        }
+        if (fa->layout != MM_LAYOUT_ROWS || fb->layout != MM_LAYOUT_ROWS ||
+            fa->dtype != MM_DTYPE_I64 || fb->dtype != MM_DTYPE_I64 ||
+            fa->cols != fb->rows) {
+            printf("need row-major i64 files of matching shapes\n");
+            return -1;
+        }
+        M = fa->rows;
+        K = fa->cols;
+        N = fb->cols;
+        load = mm_wtime() - wc_start;
+    } else if (mm_parse_shape(argv[2], &M, &K, &N))
+        return mm_usage(argv[0], "<kernel|auto|list> <N|MxKxN|A.mmt:B.mmt> [verify]");
+
+    /*
+     * auto takes the tuning cache entry of the class if there is one;
+     * otherwise rectangular problems pick the kernel of the same-volume cube
+     */
+    struct mm_tuned tuned;
+    const struct mm_kernel *k;
+    if (strcmp(argv[1], "auto"))
+        k = mm_kernel_find(argv[1]);
+    else if (mm_tune_lookup(M, K, N, MM_DTYPE_I64, 0, NULL, &tuned)) {
+        k = tuned.k;
+        mm_tune_apply(&tuned);
+        printf("tuned: %s block %u threads %u (%.2f GOP/s)\n", k->name,
+               tuned.block, tuned.threads, tuned.gops);
+    } else
+        k = mm_kernel_select(cbrt((double)M * N * K) + 0.5);
+    if (!k) {
+        printf("unknown kernel %s\n", argv[1]);
+        return -1;
+    }
+    if (!mm_kernel_supports(k, M) || !mm_kernel_supports(k, K) ||
+        !mm_kernel_supports(k, N)) {
+        printf("%s needs every dimension to be a multiple of %u\n", k->name, k->align);
+        return -1;
+    }
+
+    /* allocate space for matrices */
+    clock_t t;
+    int64_t  *m1 = fa ? mm_tfile_map(fa) : mm_alloc((uint64_t)M * K * sizeof(int64_t));
+    int64_t  *m2 = fb ? mm_tfile_map(fb) : mm_alloc((uint64_t)K * N * sizeof(int64_t));
+    int64_t  *r  = mm_alloc((uint64_t)M * N * sizeof(int64_t));
+
+    if (!fa) {
+        mm_init_matrix(M, K, m1, K);
+        mm_init_matrix(K, N, m2, N);
+    }
+
+    /* counts the pool threads too, as they are started by the first run */
+    struct mm_perf *pmc = mm_perf_group(NULL, MM_PERF_THREADS);
+
+    /* and each worker on its own */
+    struct mm_perf_threads *pt = NULL;
+    if (k->threaded) {
+        pt = mm_perf_threads_open(NULL, max((uint32_t)N_THREADS, mm_get_num_threads()));
+        mm_perf_threads_attach(pt);
+    }
+
+    double wc_start, wc_end;
+    mm_perf_group_start(pmc);
+    wc_start = mm_wtime();
+    t = clock();
+
+    k->gemm(M, N, K, m1, K, m2, N, r, N, 0);
+
+    t = clock() - t;
+    wc_end = mm_wtime();
+    mm_perf_group_stop(pmc);
+
+    if (M == N && K == N)
+        printf("%s\n%u\n", k->name, N);
+    else
+        printf("%s\n%ux%ux%u\n", k->name, M, K, N);
+    printf("%.6f\n%.6f\n",
+           ((float)t)/CLOCKS_PER_SEC,
+           wc_end-wc_start);
+
+    if (fa)
+        printf("load: %.6f s (mapped)\n", load);
+    if (k->fn == mm_strassen)
+        printf("strassen crossover: %u\n", mm_strassen_crossover());
+    if (k->fn == mm_pt_numa) {
+        const struct mm_numa_stats *st = mm_numa_stats();
+        for (uint32_t n=0; n<st->nodes; n++)
+            printf("node %u: %u threads %.6f s %.2f GB/s\n", n,
+                   st->threads[n], st->seconds[n],
+                   st->seconds[n] > 0 ? st->bytes[n] / st->seconds[n] / 1e9 : 0);
+    }
+
+    uint64_t huge = mm_alloc_huge_bytes(m1) + mm_alloc_huge_bytes(m2) +
+                    mm_alloc_huge_bytes(r);
+    printf("pages: %s, %.1f MiB of 3 matrices on huge pages\n",
+           mm_pages_name(mm_alloc_pages(r)), huge / 1048576.0);
+    mm_perf_group_print(pmc);
+    mm_perf_group_close(pmc);
+    if (pt) {
+        mm_perf_threads_print(pt);
+        mm_perf_threads_close(pt);
+    }
+
+    if (VERIFY)
+        printf("Matrix verification %s\n",
+               mm_verify_gemm(M, N, K, m1, K, m2, N, r, N) ? "ok" : "failed");
+
+    if (fa) {
+        mm_tfile_close(fa);
+        mm_tfile_close(fb);
+    } else {
+        mm_free(m1);
+        mm_free(m2);
+    }
+    mm_free(r);
+    return 0;
+}
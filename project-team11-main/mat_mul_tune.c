@@ -0,0 +1,88 @@
+#include <stdio.h>      /* printf, fprintf                */
+#include <stdlib.h>     /* free, atoi                     */
+#include <string.h>     /* strdup, strtok_r               */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <unistd.h>     /* getopt                         */
+
+#include "matmul.h"
+
+/*
+ *  Fills the tuning cache: every shape x dtype x thread budget given is
+ *  looked up, and searched and saved if it is not cached yet (always with
+ *  -f). mat_mul_run auto and mat_mul_block with b 0 read the result.
+ */
+
+#define MAX_LIST 64
+
+/*
+ *  main - tune the classes of the given problems
+ *      @argc: number of arguments & program name
+ *      @argv: arguments
+ */
+int32_t
+main(int32_t argc, char *argv[])
+{
+    const char *sizes = "1024", *dtypes = "i64", *threads = "0";
+    const struct mm_kernel *only = NULL;
+    int force = 0, opt;
+
+    while ((opt = getopt(argc, argv, "n:d:t:k:f")) != -1) {
+        switch (opt) {
+        case 'n': sizes = optarg; break;
+        case 'd': dtypes = optarg; break;
+        case 't': threads = optarg; break;
+        case 'k':
+            if (!(only = mm_kernel_find(optarg))) {
+                printf("unknown kernel %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'f': force = 1; break;
+        default:
+            return mm_usage(argv[0], "[-n N|MxKxN,...] [-d dtypes] [-t threads] "
+                            "[-k kernel] [-f]");
+        }
+    }
+
+    printf("cpu: %s\ncache: %s\n", mm_cpu_model(), mm_tune_cache_path());
+
+    char *s_dup = strdup(sizes), *s_save = NULL;
+    for (char *s = strtok_r(s_dup, ",", &s_save); s; s = strtok_r(NULL, ",", &s_save)) {
+        uint32_t M, K, N;
+        if (mm_parse_shape(s, &M, &K, &N)) {
+            fprintf(stderr, "bad shape %s, skipped\n", s);
+            continue;
+        }
+
+        char *d_dup = strdup(dtypes), *d_save = NULL;
+        for (char *d = strtok_r(d_dup, ",", &d_save); d; d = strtok_r(NULL, ",", &d_save)) {
+            int dt = mm_dtype_parse(d);
+            if (dt < 0) {
+                fprintf(stderr, "unknown dtype %s, skipped\n", d);
+                continue;
+            }
+
+            char *t_dup = strdup(threads), *t_save = NULL;
+            for (char *t = strtok_r(t_dup, ",", &t_save); t; t = strtok_r(NULL, ",", &t_save)) {
+                uint32_t nt = atoi(t);
+                struct mm_tuned tuned;
+                double start = mm_wtime();
+                int from = force ? mm_tune_search(M, K, N, dt, nt, only, &tuned) :
+                                   mm_tune(M, K, N, dt, nt, only, &tuned);
+
+                printf("%ux%ux%u %s %u threads: ", M, K, N, mm_dtype_name(dt),
+                       nt ? nt : mm_get_num_threads());
+                if (from < 0)
+                    printf("no kernel runs it\n");
+                else
+                    printf("%s block %u on %u threads, %.2f GOP/s (%s, %.1f s)\n",
+                           tuned.k->name, tuned.block, tuned.threads, tuned.gops,
+                           from ? "cached" : "tuned", mm_wtime() - start);
+            }
+            free(t_dup);
+        }
+        free(d_dup);
+    }
+    free(s_dup);
+    return 0;
+}
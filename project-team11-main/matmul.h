@@ -0,0 +1,599 @@
+#ifndef _MATMUL_H
+#define _MATMUL_H
+
+#include <stdint.h>     /* uint32_t, uint64_t             */
+
+/*
+ *  libmatmul - the multiplication kernels of the mat_mul* programs in one
+ *  linkable library. Every kernel computes r = m1 * m2 for square N x N
+ *  int64 matrices stored row-major, and is reachable by name through the
+ *  kernel registry so callers can pick one at runtime. Each one also has a
+ *  general form, C (+)= A * B for an M x K times K x N product with row
+ *  strides, so rectangular operands and sub-views need no copies.
+ */
+
+#ifndef min
+#define min(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a < _b ? _a : _b; })
+#endif
+
+#ifndef max
+#define max(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+#endif
+
+/* pthread variants: thread count and how the output is split between them */
+#define N_THREADS 8
+#define BLOCK_RATIO_W 4
+#define BLOCK_RATIO_H 2
+#define STRIDE 32
+#define STRIDE_K 256    /* depth handed to the tile micro-kernel per call */
+#define MM_LINE 64      /* bytes per cache line; pt grid columns split on it */
+
+#define THREAD_AFFINITY 1
+#define THREAD_AFFINITY_CORE_OFFSET 0
+
+/* default block size of the blocked kernels (see mat_mul_block.c) */
+#define MM_DEFAULT_BLOCK 8
+
+/*
+ *  mm_kernel_fn - signature shared by every kernel in the registry
+ *      @N: square matrix size
+ *      @m1: pointer to matrix 1
+ *      @m2: pointer to matrix 2
+ *      @r: resultant matrix (overwritten)
+ */
+typedef void (*mm_kernel_fn)(uint32_t N, const int64_t *m1,
+                             const int64_t *m2, int64_t *r);
+
+/*
+ *  mm_gemm_fn - general form of a kernel: C (+)= A * B
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides (>= K, N, N)
+ *      @accumulate: add into C instead of overwriting it
+ */
+typedef void (*mm_gemm_fn)(uint32_t M, uint32_t N, uint32_t K,
+                           const int64_t *A, uint64_t lda,
+                           const int64_t *B, uint64_t ldb,
+                           int64_t *C, uint64_t ldc, int accumulate);
+
+/*
+ *  mm_tile_fn - tile micro-kernel, dot-product form (b is m2 transposed):
+ *               c[i*ldc + j] += sum_k a[i*lda + k] * bt[j*ldb + k]
+ *      @mt, @nt, @kt: tile rows, columns and depth
+ */
+typedef void (*mm_tile_fn)(uint32_t mt, uint32_t nt, uint32_t kt,
+                           const int64_t *a, uint32_t lda,
+                           const int64_t *bt, uint32_t ldb,
+                           int64_t *c, uint32_t ldc);
+
+/*
+ *  mm_task_fn - body of a work-stealing task
+ *      @ctx: caller context given to mm_ws_run
+ *      @ws: running scheduler, for mm_ws_spawn
+ *      @task: task id / payload
+ *      @worker: id of the worker running it
+ */
+struct mm_ws;
+typedef void (*mm_task_fn)(void *ctx, struct mm_ws *ws, uintptr_t task,
+                           uint32_t worker);
+
+/*
+ *  mm_job_fn - body of a pool job, run once on every pool thread
+ *      @arg: caller argument given to mm_pool_submit
+ *      @tid: 0..@nthreads-1
+ *      @nthreads: threads running the job
+ */
+struct mm_pool;
+typedef void (*mm_job_fn)(void *arg, uint32_t tid, uint32_t nthreads);
+
+struct mm_kernel {
+    const char   *name;
+    const char   *desc;
+    mm_kernel_fn  fn;
+    mm_gemm_fn    gemm;
+    uint32_t      align;    /* every dimension must be a multiple of this */
+    uint32_t      threaded; /* 0, a fixed worker count or MM_THREADS_ANY */
+};
+
+/* kernel runs on mm_get_num_threads() workers */
+#define MM_THREADS_ANY UINT32_MAX
+
+/* one product of a mm_gemm_batch_list call: C (+)= A * B */
+struct mm_gemm_args {
+    uint32_t       M, N, K;
+    const int64_t *A;
+    uint64_t       lda;
+    const int64_t *B;
+    uint64_t       ldb;
+    int64_t       *C;
+    uint64_t       ldc;
+};
+
+/* configuration picked by the autotuner (mm_tune.c) */
+struct mm_tuned {
+    const struct mm_kernel *k;
+    uint32_t block;         /* block size or crossover, 0 if none */
+    uint32_t threads;       /* workers it ran on */
+    double   gops;
+};
+
+/* data cache sizes in bytes, from sysfs (fallbacks if unavailable) */
+struct mm_cache {
+    uint64_t l1d;
+    uint64_t l2;
+    uint64_t l3;
+};
+
+/* packed GEMM block sizes: MC x KC block of A, KC x NC panel of B */
+struct mm_blocking {
+    uint32_t mc;
+    uint32_t kc;
+    uint32_t nc;
+};
+
+/* largest page size the matrix allocator may use */
+enum mm_pages {
+    MM_PAGES_4K,
+    MM_PAGES_THP,   /* 4 KiB mapping, 2 MiB aligned, MADV_HUGEPAGE */
+    MM_PAGES_2M,    /* hugetlbfs */
+    MM_PAGES_1G,    /* hugetlbfs */
+};
+
+/* perf counter groups, see mm_perf_group */
+#define MM_PERF_MAX_EVENTS 8
+#define MM_PERF_THREADS    1    /* also count threads created later */
+struct mm_perf;
+struct mm_perf_threads;
+
+#define MM_NUMA_MAX_NODES 32
+
+/* per-node view of the last pt_numa multiply */
+struct mm_numa_stats {
+    uint32_t nodes;
+    uint32_t threads[MM_NUMA_MAX_NODES];
+    uint64_t bytes[MM_NUMA_MAX_NODES];      /* modelled load/store traffic */
+    double   seconds[MM_NUMA_MAX_NODES];
+};
+
+/*
+ *  element types of the typed kernels (mm_dtype.c): suffix, type of A and
+ *  B, type of C that the products are summed in
+ */
+#define MM_FOR_EACH_DTYPE(X)            \
+    X(i8,  int8_t,  int32_t)            \
+    X(i16, int16_t, int32_t)            \
+    X(i32, int32_t, int64_t)            \
+    X(f32, float,   float)              \
+    X(f64, double,  double)
+
+/* MM_DTYPE_I64 is the registry kernels, the rest follow MM_FOR_EACH_DTYPE */
+enum mm_dtype {
+    MM_DTYPE_I64,
+    MM_DTYPE_I8,
+    MM_DTYPE_I16,
+    MM_DTYPE_I32,
+    MM_DTYPE_F32,
+    MM_DTYPE_F64,
+};
+
+/* mm_gemm_fn with the element types erased, see mm_dtype_kernel */
+typedef void (*mm_gemm_any_fn)(uint32_t M, uint32_t N, uint32_t K,
+                               const void *A, uint64_t lda,
+                               const void *B, uint64_t ldb,
+                               void *C, uint64_t ldc, int accumulate);
+
+/* data layout of a matrix file (mm_tfile.c) */
+enum mm_layout {
+    MM_LAYOUT_ROWS,             /* row-major, row stride = cols */
+    MM_LAYOUT_TILES,            /* tile x tile blocks in row-major grid order */
+};
+
+/* open matrix file */
+struct mm_tfile {
+    int            fd;
+    int            writable;
+    int            dirty;       /* checksum to be redone on close */
+    enum mm_dtype  dtype;
+    enum mm_layout layout;
+    uint32_t       rows, cols;
+    uint32_t       tile;        /* side of a tile, 0 for rows */
+    uint32_t       trows, tcols;/* tile grid */
+    uint64_t       checksum;    /* as stored in the header */
+    void          *map;         /* whole file once mapped, else NULL */
+};
+
+/* what one mm_gemm_ooc call did */
+struct mm_ooc_stats {
+    uint32_t bm, bn;            /* C block in tiles */
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    double   wait;              /* seconds the multiply waited for I/O */
+    double   seconds;
+};
+
+/*
+ *  what is done to each element of a product on its way into C (mm_epilogue.c):
+ *  v = alpha * (A B) + beta * C + row_bias[i] + col_bias[j], then a rounding
+ *  right shift, then clamped to [lo, hi] and to the range of @out
+ */
+struct mm_epilogue {
+    int64_t        alpha, beta;
+    const int64_t *row_bias;    /* M entries, or NULL */
+    const int64_t *col_bias;    /* N entries, or NULL */
+    uint32_t       shift;       /* v = (v + 2^(shift-1)) >> shift if non-zero */
+    int64_t        lo, hi;
+    enum mm_dtype  out;         /* I64 stores into C, I8/I16/I32 into q */
+    void          *q;
+    uint64_t       ldq;
+};
+
+/* general form with an epilogue; C is read only if beta != 0 */
+typedef void (*mm_gemm_ep_fn)(uint32_t M, uint32_t N, uint32_t K,
+                              const int64_t *A, uint64_t lda,
+                              const int64_t *B, uint64_t ldb,
+                              int64_t *C, uint64_t ldc,
+                              const struct mm_epilogue *ep);
+
+/* mm_util.c */
+int32_t mm_usage(const char *prog, const char *args);
+int     mm_parse_shape(const char *s, uint32_t *M, uint32_t *K, uint32_t *N);
+void    print_matrix(uint32_t N, const int64_t *m);
+void    init_matrices(uint32_t N, int64_t *m1, int64_t *m2);
+int     verify_matrix(uint32_t N, const int64_t *m1, const int64_t *m2,
+                      const int64_t *r);
+int     compare_matrix(uint32_t N, const int64_t *a, const int64_t *b);
+void    mm_init_matrix(uint32_t rows, uint32_t cols, int64_t *m, uint64_t ld);
+void    mm_clear(uint32_t M, uint32_t N, int64_t *C, uint64_t ldc);
+double  mm_wtime(void);
+void    mm_cache_sizes(struct mm_cache *c);
+
+/* mm_verify.c */
+int mm_verify_gemm(uint32_t M, uint32_t N, uint32_t K,
+                   const int64_t *A, uint64_t lda,
+                   const int64_t *B, uint64_t ldb,
+                   const int64_t *C, uint64_t ldc);
+int mm_verify_freivalds(uint32_t M, uint32_t N, uint32_t K,
+                        const int64_t *A, uint64_t lda,
+                        const int64_t *B, uint64_t ldb,
+                        const int64_t *C, uint64_t ldc, uint32_t trials);
+int mm_verify_exact(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    const int64_t *C, uint64_t ldc);
+
+/* mm_alloc.c */
+void         *mm_alloc(uint64_t bytes);
+void          mm_free(void *p);
+void          mm_alloc_set_pages(int pages);
+enum mm_pages mm_alloc_get_pages(void);
+enum mm_pages mm_alloc_pages(const void *p);
+uint64_t      mm_alloc_huge_bytes(const void *p);
+const char   *mm_pages_name(enum mm_pages pages);
+
+/* mm_perf.c */
+int             mm_perf_open(const char *name, int group_fd, int flags);
+int64_t         mm_perf_read(int fd);
+void            mm_perf_close(int fd);
+struct mm_perf *mm_perf_group(const char *list, int flags);
+uint32_t        mm_perf_group_size(const struct mm_perf *g);
+const char     *mm_perf_group_name(const struct mm_perf *g, uint32_t i);
+int             mm_perf_group_rdpmc(const struct mm_perf *g);
+void            mm_perf_group_start(struct mm_perf *g);
+void            mm_perf_group_stop(struct mm_perf *g);
+void            mm_perf_group_read(const struct mm_perf *g, int64_t *v);
+void            mm_perf_group_print(const struct mm_perf *g);
+void            mm_perf_group_close(struct mm_perf *g);
+struct mm_perf_threads *mm_perf_threads_open(const char *list, uint32_t nslots);
+void            mm_perf_threads_close(struct mm_perf_threads *pt);
+void            mm_perf_threads_attach(struct mm_perf_threads *pt);
+struct mm_perf_threads *mm_perf_threads_attached(void);
+void            mm_perf_thread_begin(struct mm_perf_threads *pt, uint32_t tid);
+void            mm_perf_thread_end(struct mm_perf_threads *pt, uint32_t tid);
+void            mm_perf_threads_reset(struct mm_perf_threads *pt);
+void            mm_perf_threads_print(const struct mm_perf_threads *pt);
+
+/* mm_kernels.c */
+void mm_set_block_size(uint32_t b);
+uint32_t mm_get_block_size(void);
+void blk_mat_mul(uint32_t ii, uint32_t jj, uint32_t kk, int b, uint32_t N,
+                 const int64_t *m1, const int64_t *m2, int64_t *rBlk);
+void naive_blk_mat_mul(uint32_t ii, uint32_t jj, uint32_t kk, int b,
+                       uint32_t N, const int64_t *m1, const int64_t *m2,
+                       int64_t *rBlk);
+void mm_naive(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_faster(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_block(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_naive_block(uint32_t N, const int64_t *m1, const int64_t *m2,
+                    int64_t *r);
+void mm_transposed(uint32_t N, const int64_t *m1, const int64_t *m2,
+                   int64_t *r);
+void mm_unroll(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_gemm_naive(uint32_t M, uint32_t N, uint32_t K,
+                  const int64_t *A, uint64_t lda,
+                  const int64_t *B, uint64_t ldb,
+                  int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_faster(uint32_t M, uint32_t N, uint32_t K,
+                   const int64_t *A, uint64_t lda,
+                   const int64_t *B, uint64_t ldb,
+                   int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_block(uint32_t M, uint32_t N, uint32_t K,
+                  const int64_t *A, uint64_t lda,
+                  const int64_t *B, uint64_t ldb,
+                  int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_naive_block(uint32_t M, uint32_t N, uint32_t K,
+                        const int64_t *A, uint64_t lda,
+                        const int64_t *B, uint64_t ldb,
+                        int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_transposed(uint32_t M, uint32_t N, uint32_t K,
+                       const int64_t *A, uint64_t lda,
+                       const int64_t *B, uint64_t ldb,
+                       int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_unroll(uint32_t M, uint32_t N, uint32_t K,
+                   const int64_t *A, uint64_t lda,
+                   const int64_t *B, uint64_t ldb,
+                   int64_t *C, uint64_t ldc, int accumulate);
+
+/* mm_pt.c */
+void mm_pt_rows(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_pt1(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_pt_precopy(uint32_t N, const int64_t *m1, const int64_t *m2,
+                   int64_t *r);
+void mm_pt_stride(uint32_t N, const int64_t *m1, const int64_t *m2,
+                  int64_t *r);
+void mm_pt_steal(uint32_t N, const int64_t *m1, const int64_t *m2,
+                 int64_t *r);
+void mm_pt_numa(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_pt_splitk(uint32_t N, const int64_t *m1, const int64_t *m2,
+                  int64_t *r);
+void mm_gemm_pt_rows(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt1(uint32_t M, uint32_t N, uint32_t K,
+                const int64_t *A, uint64_t lda,
+                const int64_t *B, uint64_t ldb,
+                int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt_precopy(uint32_t M, uint32_t N, uint32_t K,
+                       const int64_t *A, uint64_t lda,
+                       const int64_t *B, uint64_t ldb,
+                       int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt_stride(uint32_t M, uint32_t N, uint32_t K,
+                      const int64_t *A, uint64_t lda,
+                      const int64_t *B, uint64_t ldb,
+                      int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt_steal(uint32_t M, uint32_t N, uint32_t K,
+                     const int64_t *A, uint64_t lda,
+                     const int64_t *B, uint64_t ldb,
+                     int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt_numa(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt_splitk(uint32_t M, uint32_t N, uint32_t K,
+                       const int64_t *A, uint64_t lda,
+                       const int64_t *B, uint64_t ldb,
+                       int64_t *C, uint64_t ldc, int accumulate);
+void mm_gemm_pt_rows_ep(uint32_t M, uint32_t N, uint32_t K,
+                        const int64_t *A, uint64_t lda,
+                        const int64_t *B, uint64_t ldb,
+                        int64_t *C, uint64_t ldc, const struct mm_epilogue *ep);
+void mm_gemm_pt1_ep(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, const struct mm_epilogue *ep);
+void mm_gemm_pt_precopy_ep(uint32_t M, uint32_t N, uint32_t K,
+                           const int64_t *A, uint64_t lda,
+                           const int64_t *B, uint64_t ldb,
+                           int64_t *C, uint64_t ldc,
+                           const struct mm_epilogue *ep);
+void mm_gemm_pt_stride_ep(uint32_t M, uint32_t N, uint32_t K,
+                          const int64_t *A, uint64_t lda,
+                          const int64_t *B, uint64_t ldb,
+                          int64_t *C, uint64_t ldc,
+                          const struct mm_epilogue *ep);
+void mm_gemm_pt_steal_ep(uint32_t M, uint32_t N, uint32_t K,
+                         const int64_t *A, uint64_t lda,
+                         const int64_t *B, uint64_t ldb,
+                         int64_t *C, uint64_t ldc,
+                         const struct mm_epilogue *ep);
+const struct mm_numa_stats *mm_numa_stats(void);
+uint32_t mm_pt_col_split(uint32_t N, uint32_t w, uint32_t line);
+
+/* mm_sched.c */
+void     mm_set_num_threads(uint32_t n);
+uint32_t mm_get_num_threads(void);
+uint32_t mm_num_threads_setting(void);
+uint64_t mm_ws_run(uint32_t nworkers, mm_task_fn fn, void *ctx,
+                   uint64_t ntasks);
+void     mm_ws_spawn(struct mm_ws *ws, uint32_t worker, uintptr_t task);
+
+/* mm_pool.c */
+struct mm_pool *mm_pool_create(uint32_t nthreads, int pin);
+void            mm_pool_destroy(struct mm_pool *pool);
+uint32_t        mm_pool_size(const struct mm_pool *pool);
+void            mm_pool_submit(struct mm_pool *pool, mm_job_fn fn, void *arg);
+void            mm_pool_wait(struct mm_pool *pool);
+void            mm_pool_run(struct mm_pool *pool, mm_job_fn fn, void *arg);
+void            mm_pool_barrier(struct mm_pool *pool, uint32_t nthreads);
+struct mm_pool *mm_pool_get(uint32_t nthreads);
+struct mm_pool *mm_pool_current(void);
+
+/* mm_numa.c */
+uint32_t mm_numa_nodes(void);
+uint32_t mm_numa_worker_node(uint32_t i, uint32_t nthreads);
+uint32_t mm_numa_node_first(uint32_t node, uint32_t nthreads);
+int      mm_numa_worker_cpu(uint32_t i, uint32_t nthreads);
+void    *mm_numa_alloc(uint64_t bytes, int node);
+void     mm_numa_free(void *p, uint64_t bytes);
+int      mm_numa_move(const void *p, uint64_t bytes, int node);
+int      mm_numa_node_of(const void *p);
+
+/* mm_simd.c */
+mm_tile_fn  mm_tile_dot(void);
+const char *mm_simd_name(void);
+int         mm_simd_supports(const char *isa);
+
+/* mm_dtype.c */
+#define MM_DECLARE_DTYPE(sfx, T, ACC)                                          \
+void mm_gemm_block_##sfx(uint32_t M, uint32_t N, uint32_t K,                   \
+                         const T *A, uint64_t lda, const T *B, uint64_t ldb,   \
+                         ACC *C, uint64_t ldc, int accumulate);                \
+void mm_gemm_transposed_##sfx(uint32_t M, uint32_t N, uint32_t K,              \
+                              const T *A, uint64_t lda,                        \
+                              const T *B, uint64_t ldb,                        \
+                              ACC *C, uint64_t ldc, int accumulate);           \
+void mm_gemm_pt_stride_##sfx(uint32_t M, uint32_t N, uint32_t K,               \
+                             const T *A, uint64_t lda,                         \
+                             const T *B, uint64_t ldb,                         \
+                             ACC *C, uint64_t ldc, int accumulate);
+MM_FOR_EACH_DTYPE(MM_DECLARE_DTYPE)
+int            mm_dtype_parse(const char *name);
+const char    *mm_dtype_name(enum mm_dtype dt);
+uint32_t       mm_dtype_size(enum mm_dtype dt);
+uint32_t       mm_dtype_acc_size(enum mm_dtype dt);
+mm_gemm_any_fn mm_dtype_kernel(const struct mm_kernel *k, enum mm_dtype dt);
+void           mm_dtype_init(enum mm_dtype dt, uint32_t rows, uint32_t cols,
+                             void *m, uint64_t ld);
+int            mm_dtype_verify(enum mm_dtype dt, uint32_t M, uint32_t N,
+                               uint32_t K, const void *A, uint64_t lda,
+                               const void *B, uint64_t ldb,
+                               const void *C, uint64_t ldc);
+const char    *mm_dtype_simd_name(void);
+
+/* mm_packed.c */
+const struct mm_blocking *mm_packed_blocking(void);
+void mm_packed_set_blocking(uint32_t mc, uint32_t kc, uint32_t nc);
+void mm_gemm_packed(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, int accumulate);
+void mm_packed(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+
+/* mm_strassen.c */
+uint32_t mm_strassen_crossover(void);
+uint32_t mm_strassen_crossover_setting(void);
+void     mm_strassen_set_crossover(uint32_t n);
+void     mm_gemm_strassen(uint32_t M, uint32_t N, uint32_t K,
+                          const int64_t *A, uint64_t lda,
+                          const int64_t *B, uint64_t ldb,
+                          int64_t *C, uint64_t ldc, int accumulate);
+void     mm_strassen(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+
+/* mm_batch.c */
+void mm_gemm_batch(uint32_t M, uint32_t N, uint32_t K,
+                   const int64_t *const *A, uint64_t lda,
+                   const int64_t *const *B, uint64_t ldb,
+                   int64_t *const *C, uint64_t ldc,
+                   int accumulate, uint64_t count);
+void mm_gemm_batch_strided(uint32_t M, uint32_t N, uint32_t K,
+                           const int64_t *A, uint64_t lda, uint64_t stride_a,
+                           const int64_t *B, uint64_t ldb, uint64_t stride_b,
+                           int64_t *C, uint64_t ldc, uint64_t stride_c,
+                           int accumulate, uint64_t count);
+void mm_gemm_batch_list(const struct mm_gemm_args *p, uint32_t count,
+                        int accumulate);
+void mm_gemm_fixed(uint32_t M, uint32_t N, uint32_t K,
+                   const int64_t *A, uint64_t lda,
+                   const int64_t *B, uint64_t ldb,
+                   int64_t *C, uint64_t ldc, int accumulate);
+void mm_fixed(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+
+/* mm_recursive.c */
+void mm_gemm_recursive(uint32_t M, uint32_t N, uint32_t K,
+                       const int64_t *A, uint64_t lda,
+                       const int64_t *B, uint64_t ldb,
+                       int64_t *C, uint64_t ldc, int accumulate);
+void mm_recursive(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_gemm_morton(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, int accumulate);
+void mm_morton(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+
+/* mm_gemv.c */
+void        mm_gemv(uint32_t M, uint32_t K, const int64_t *A, uint64_t lda,
+                    const int64_t *x, int64_t *y, int accumulate);
+void        mm_gemv_t(uint32_t M, uint32_t N, const int64_t *A, uint64_t lda,
+                      const int64_t *x, int64_t *y, int accumulate);
+void        mm_gemv_f32(uint32_t M, uint32_t K, const float *A, uint64_t lda,
+                        const float *x, float *y, int accumulate);
+void        mm_gemv_t_f32(uint32_t M, uint32_t N, const float *A, uint64_t lda,
+                          const float *x, float *y, int accumulate);
+const char *mm_gemv_simd_name(void);
+
+/* mm_omp.c */
+void mm_gemm_omp_naive(uint32_t M, uint32_t N, uint32_t K,
+                       const int64_t *A, uint64_t lda,
+                       const int64_t *B, uint64_t ldb,
+                       int64_t *C, uint64_t ldc, int accumulate);
+void mm_omp_naive(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+void mm_gemm_omp(uint32_t M, uint32_t N, uint32_t K,
+                 const int64_t *A, uint64_t lda,
+                 const int64_t *B, uint64_t ldb,
+                 int64_t *C, uint64_t ldc, int accumulate);
+void mm_omp(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r);
+
+/* mm_epilogue.c */
+void          mm_epilogue_init(struct mm_epilogue *ep);
+void          mm_epilogue_tile(const struct mm_epilogue *ep, uint32_t i0,
+                               uint32_t j0, uint32_t m, uint32_t n,
+                               const int64_t *acc, uint64_t ldacc,
+                               int64_t *C, uint64_t ldc);
+mm_gemm_ep_fn mm_epilogue_kernel(const struct mm_kernel *k);
+int           mm_gemm_ep(const struct mm_kernel *k, uint32_t M, uint32_t N,
+                         uint32_t K, const int64_t *A, uint64_t lda,
+                         const int64_t *B, uint64_t ldb,
+                         int64_t *C, uint64_t ldc,
+                         const struct mm_epilogue *ep);
+
+/* mm_tfile.c */
+struct mm_tfile *mm_tfile_create(const char *path, uint32_t rows, uint32_t cols,
+                                 enum mm_dtype dt, uint32_t tile);
+struct mm_tfile *mm_tfile_open(const char *path, int writable);
+int              mm_tfile_close(struct mm_tfile *f);
+void            *mm_tfile_map(struct mm_tfile *f);
+void            *mm_tfile_tile(const struct mm_tfile *f, uint32_t ti, uint32_t tj);
+uint64_t         mm_tfile_tile_bytes(const struct mm_tfile *f);
+int              mm_tfile_read(const struct mm_tfile *f, uint32_t ti, uint32_t tj,
+                               void *t);
+int              mm_tfile_write(struct mm_tfile *f, uint32_t ti, uint32_t tj,
+                                const void *t);
+uint64_t         mm_tfile_checksum(const struct mm_tfile *f);
+int              mm_tfile_verify(const struct mm_tfile *f);
+
+/* mm_ooc.c */
+uint64_t mm_ooc_memory(void);
+int      mm_gemm_ooc(const struct mm_tfile *A, const struct mm_tfile *B,
+                     struct mm_tfile *C, const struct mm_kernel *k, uint64_t mem,
+                     struct mm_ooc_stats *st);
+
+/* mm_registry.c */
+uint32_t mm_kernel_count(void);
+const struct mm_kernel *mm_kernel_at(uint32_t i);
+const struct mm_kernel *mm_kernel_find(const char *name);
+int mm_kernel_supports(const struct mm_kernel *k, uint32_t N);
+int mm_kernel_has_block(const struct mm_kernel *k);
+uint32_t mm_kernel_get_block(const struct mm_kernel *k);
+void mm_kernel_set_block(const struct mm_kernel *k, uint32_t b);
+const struct mm_kernel *mm_kernel_select(uint32_t N);
+
+/* mm_tune.c */
+const char *mm_cpu_model(void);
+const char *mm_tune_cache_path(void);
+int  mm_tune_lookup(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+                    uint32_t threads, const struct mm_kernel *only,
+                    struct mm_tuned *t);
+int  mm_tune_search(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+                    uint32_t threads, const struct mm_kernel *only,
+                    struct mm_tuned *t);
+int  mm_tune(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+             uint32_t threads, const struct mm_kernel *only,
+             struct mm_tuned *t);
+void mm_tune_apply(const struct mm_tuned *t);
+
+#endif /* _MATMUL_H */
@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* FILE, fopen, sscanf            */
+#include <stdlib.h>     /* malloc, aligned_alloc, free    */
+#include <string.h>     /* strcmp                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+#include <sys/mman.h>   /* mmap, munmap, madvise          */
+#include <linux/mman.h> /* MAP_HUGE_2MB, MAP_HUGE_1GB     */
+
+#include "matmul.h"
+
+/*
+ *  Matrix allocator. Big buffers are mmap'd so they can sit on huge pages:
+ *  hugetlbfs 1 GiB or 2 MiB pages when the pool has them, else a 2 MiB
+ *  aligned region with MADV_HUGEPAGE for THP, else plain pages. Small
+ *  buffers come from the heap, 64-byte aligned. MM_PAGES=4k|thp|2m|1g caps
+ *  the largest page size tried (default thp: no reserved pool needed).
+ */
+
+#define HUGE_2M (2ull << 20)
+#define HUGE_1G (1ull << 30)
+
+struct region {
+    void *p;
+    uint64_t len;
+    enum mm_pages kind;
+    struct region *next;
+};
+
+static struct region *regions;
+static pthread_mutex_t regions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int pages_set = -1;
+
+static const char *page_names[] = {
+    [MM_PAGES_4K]  = "4k",
+    [MM_PAGES_THP] = "thp",
+    [MM_PAGES_2M]  = "2m",
+    [MM_PAGES_1G]  = "1g",
+};
+
+/*
+ *  mm_alloc_set_pages - largest page size mm_alloc may use
+ *      @pages: MM_PAGES_*, -1 restores the default
+ */
+void
+mm_alloc_set_pages(int pages)
+{
+    pages_set = pages;
+}
+
+/*
+ *  mm_alloc_get_pages - largest page size mm_alloc may use: the value set
+ *                       with mm_alloc_set_pages, MM_PAGES, or THP
+ */
+enum mm_pages
+mm_alloc_get_pages(void)
+{
+    if (pages_set >= 0)
+        return pages_set;
+
+    const char *env = getenv("MM_PAGES");
+    if (env)
+        for (int i=MM_PAGES_4K; i<=MM_PAGES_1G; i++)
+            if (!strcmp(env, page_names[i]))
+                return i;
+    return MM_PAGES_THP;
+}
+
+const char *
+mm_pages_name(enum mm_pages pages)
+{
+    return page_names[pages];
+}
+
+static void *
+map_hugetlb(uint64_t len, int flag)
+{
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/*
+ *  map_thp - @len bytes at a 2 MiB boundary, THP requested when @huge
+ */
+static void *
+map_thp(uint64_t len, int huge)
+{
+    uint8_t *p = mmap(NULL, len + HUGE_2M, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+
+    /* trim the slack so the region starts and ends on 2 MiB boundaries */
+    uint8_t *a = (uint8_t *)(((uintptr_t)p + HUGE_2M - 1) & ~(HUGE_2M - 1));
+    if (a > p)
+        munmap(p, a - p);
+    if (a + len < p + len + HUGE_2M)
+        munmap(a + len, p + len + HUGE_2M - (a + len));
+
+    if (huge)
+        madvise(a, len, MADV_HUGEPAGE);
+    return a;
+}
+
+/*
+ *  mm_alloc - buffer for a matrix or a packed copy of one
+ *      @bytes: size
+ *      @return: 64-byte aligned memory, NULL on failure; release with mm_free
+ */
+void *
+mm_alloc(uint64_t bytes)
+{
+    enum mm_pages max = mm_alloc_get_pages();
+    enum mm_pages kind;
+    uint64_t len;
+    void *p = NULL;
+
+    if (bytes < HUGE_2M)
+        return aligned_alloc(64, (bytes + 63) & ~63ull);
+
+    if (max >= MM_PAGES_1G && bytes >= HUGE_1G) {
+        len = (bytes + HUGE_1G - 1) & ~(HUGE_1G - 1);
+        kind = MM_PAGES_1G;
+        p = map_hugetlb(len, MAP_HUGE_1GB);
+    }
+    if (!p && max >= MM_PAGES_2M) {
+        len = (bytes + HUGE_2M - 1) & ~(HUGE_2M - 1);
+        kind = MM_PAGES_2M;
+        p = map_hugetlb(len, MAP_HUGE_2MB);
+    }
+    if (!p) {
+        len = (bytes + HUGE_2M - 1) & ~(HUGE_2M - 1);
+        kind = max >= MM_PAGES_THP ? MM_PAGES_THP : MM_PAGES_4K;
+        p = map_thp(len, kind == MM_PAGES_THP);
+    }
+    if (!p)
+        return NULL;
+
+    struct region *reg = malloc(sizeof(*reg));
+    reg->p = p;
+    reg->len = len;
+    reg->kind = kind;
+
+    pthread_mutex_lock(&regions_lock);
+    reg->next = regions;
+    regions = reg;
+    pthread_mutex_unlock(&regions_lock);
+    return p;
+}
+
+/*
+ *  find_region - region starting at @p, unlinked from the list if @unlink
+ */
+static struct region *
+find_region(const void *p, int unlink)
+{
+    struct region **pp, *reg;
+
+    pthread_mutex_lock(&regions_lock);
+    for (pp = &regions; (reg = *pp); pp = &reg->next)
+        if (reg->p == p) {
+            if (unlink)
+                *pp = reg->next;
+            break;
+        }
+    pthread_mutex_unlock(&regions_lock);
+    return reg;
+}
+
+void
+mm_free(void *p)
+{
+    struct region *reg;
+
+    if (!p)
+        return;
+    if (!(reg = find_region(p, 1))) {
+        free(p);
+        return;
+    }
+    munmap(reg->p, reg->len);
+    free(reg);
+}
+
+/*
+ *  mm_alloc_pages - page size backing @p, as requested from the kernel
+ *      @return: MM_PAGES_*, MM_PAGES_4K for heap memory
+ */
+enum mm_pages
+mm_alloc_pages(const void *p)
+{
+    struct region *reg = find_region(p, 0);
+
+    return reg ? reg->kind : MM_PAGES_4K;
+}
+
+/*
+ *  mm_alloc_huge_bytes - bytes of @p actually backed by huge pages, from
+ *                        /proc/self/smaps (THP can be refused page by page;
+ *                        a mapping merged with a neighbour counts it too)
+ *      @return: bytes, 0 for heap memory or if smaps is unreadable
+ */
+uint64_t
+mm_alloc_huge_bytes(const void *p)
+{
+    struct region *reg = find_region(p, 0);
+    char line[256];
+    uint64_t huge = 0;
+    int inside = 0;
+
+    if (!reg)
+        return 0;
+    if (reg->kind == MM_PAGES_2M || reg->kind == MM_PAGES_1G)
+        return reg->len;
+
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long lo, hi, kb;
+
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+            inside = lo < (uintptr_t)reg->p + reg->len && hi > (uintptr_t)reg->p;
+        else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+            huge += kb << 10;
+    }
+    fclose(f);
+    return huge;
+}
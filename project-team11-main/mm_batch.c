@@ -0,0 +1,463 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, free, qsort, getenv    */
+#include <string.h>     /* memset, strcmp                 */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+
+#include "matmul.h"
+
+/*
+ *  Batched GEMM: many independent small products in one call.
+ *
+ *  Every product runs blk_mat_mul's kij order over one whole small matrix,
+ *  writing C directly (no scratch, no memset when accumulate is off).
+ *  Square products of a size in BATCH_SIZES take a kernel compiled for
+ *  that size: the loop bounds are constants, so the column loop unrolls
+ *  fully and a MR x BATCH_NV-vector block of C stays in registers over k.
+ *  Those kernels are built once per ISA of mm_simd.c and picked the same
+ *  way.
+ *
+ *  mm_gemm_fixed is the same dispatch for a single product.
+ *
+ *  Products are dealt out in chunks of BATCH_CHUNK as work-stealing tasks,
+ *  unless the whole batch is too small to be worth waking the workers.
+ */
+
+#define BATCH_SIZES(X) X(8) X(16) X(32) X(64) X(128)
+
+/* vectors of C per row in the register block */
+#define BATCH_NV 4
+
+/* products per task, and multiply-adds below which a batch runs inline */
+#define BATCH_CHUNK    8
+#define BATCH_MIN_WORK (1u << 20)
+
+typedef void (*batch_fn)(uint32_t M, uint32_t N, uint32_t K,
+                         const int64_t *A, uint64_t lda,
+                         const int64_t *B, uint64_t ldb,
+                         int64_t *C, uint64_t ldc, int accumulate);
+
+/*
+ *  gemm_small - any shape: row i of C is built in place over k (kij)
+ */
+static void
+gemm_small(uint32_t M, uint32_t N, uint32_t K,
+           const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+           int64_t *C, uint64_t ldc, int accumulate)
+{
+    for (uint32_t i=0; i<M; i++) {
+        int64_t *ci = &C[i*ldc];
+
+        if (!accumulate)
+            memset(ci, 0, N * sizeof(int64_t));
+        for (uint32_t k=0; k<K; k++) {
+            int64_t aik = A[i*lda + k];
+            const int64_t *bk = &B[k*ldb];
+            for (uint32_t j=0; j<N; j++)
+                ci[j] += aik * bk[j];
+        }
+    }
+}
+
+/*
+ *  DEFINE_BATCH_ISA - fixed-size kernels for one ISA
+ *      @vb: vector width in bytes
+ *      @mr: rows of C per register block
+ *      @attr: target attribute, empty for the baseline build
+ */
+#define DEFINE_BATCH_ISA(isa, vb, mr, attr)                                     \
+typedef int64_t v_##isa __attribute__((vector_size(vb)));                       \
+                                                                                \
+attr static inline __attribute__((always_inline)) void                          \
+fixed_##isa##_body(uint32_t n,                                                  \
+                   const int64_t *A, uint64_t lda,                              \
+                   const int64_t *B, uint64_t ldb,                              \
+                   int64_t *C, uint64_t ldc, int accumulate)                    \
+{                                                                               \
+    enum { L = vb / sizeof(int64_t) };                                          \
+    const uint32_t nv = min(n / L, (uint32_t)BATCH_NV);                         \
+                                                                                \
+    for (uint32_t i=0; i<n; i+=mr)                                              \
+        for (uint32_t j=0; j<n; j+=nv*L) {                                      \
+            v_##isa acc[mr][BATCH_NV];                                          \
+                                                                                \
+            _Pragma("GCC unroll 16")                                            \
+            for (uint32_t r=0; r<mr; r++)                                       \
+                _Pragma("GCC unroll 16")                                        \
+                for (uint32_t v=0; v<nv; v++)                                   \
+                    acc[r][v] = (v_##isa){ 0 };                                 \
+                                                                                \
+            for (uint32_t k=0; k<n; k++) {                                      \
+                v_##isa b[BATCH_NV];                                            \
+                _Pragma("GCC unroll 16")                                        \
+                for (uint32_t v=0; v<nv; v++)                                   \
+                    memcpy(&b[v], &B[k*ldb + j + v*L], vb);                     \
+                _Pragma("GCC unroll 16")                                        \
+                for (uint32_t r=0; r<mr; r++) {                                 \
+                    int64_t a = A[(i+r)*lda + k];                               \
+                    _Pragma("GCC unroll 16")                                    \
+                    for (uint32_t v=0; v<nv; v++)                               \
+                        acc[r][v] += a * b[v];                                  \
+                }                                                               \
+            }                                                                   \
+            _Pragma("GCC unroll 16")                                            \
+            for (uint32_t r=0; r<mr; r++)                                       \
+                _Pragma("GCC unroll 16")                                        \
+                for (uint32_t v=0; v<nv; v++) {                                 \
+                    int64_t *c = &C[(i+r)*ldc + j + v*L];                       \
+                    v_##isa t = acc[r][v];                                      \
+                    if (accumulate) {                                           \
+                        v_##isa old;                                            \
+                        memcpy(&old, c, vb);                                    \
+                        t += old;                                               \
+                    }                                                           \
+                    memcpy(c, &t, vb);                                          \
+                }                                                               \
+        }                                                                       \
+}                                                                               \
+                                                                                \
+BATCH_SIZES(DEFINE_FIXED_##isa)                                                 \
+                                                                                \
+static const batch_fn fixed_##isa[] = { BATCH_SIZES(FIXED_ENTRY_##isa) };
+
+/* one size of one ISA build; M, N and K are all @n */
+#define DEFINE_FIXED(isa, n, attr)                                              \
+attr static void                                                                \
+fixed_##isa##_##n(uint32_t M, uint32_t N, uint32_t K,                           \
+                  const int64_t *A, uint64_t lda,                               \
+                  const int64_t *B, uint64_t ldb,                               \
+                  int64_t *C, uint64_t ldc, int accumulate)                     \
+{                                                                               \
+    (void)M, (void)N, (void)K;                                                  \
+    fixed_##isa##_body(n, A, lda, B, ldb, C, ldc, accumulate);                  \
+}
+
+#define TARGET_AVX2     __attribute__((target("avx2")))
+#define TARGET_AVX512   __attribute__((target("avx512f")))
+#define TARGET_AVX512DQ __attribute__((target("avx512f,avx512dq")))
+
+#define DEFINE_FIXED_scalar(n)   DEFINE_FIXED(scalar, n, )
+#define DEFINE_FIXED_avx2(n)     DEFINE_FIXED(avx2, n, TARGET_AVX2)
+#define DEFINE_FIXED_avx512(n)   DEFINE_FIXED(avx512, n, TARGET_AVX512)
+#define DEFINE_FIXED_avx512dq(n) DEFINE_FIXED(avx512dq, n, TARGET_AVX512DQ)
+#define FIXED_ENTRY_scalar(n)    fixed_scalar_##n,
+#define FIXED_ENTRY_avx2(n)      fixed_avx2_##n,
+#define FIXED_ENTRY_avx512(n)    fixed_avx512_##n,
+#define FIXED_ENTRY_avx512dq(n)  fixed_avx512dq_##n,
+
+DEFINE_BATCH_ISA(scalar, 16, 2, )
+DEFINE_BATCH_ISA(avx2, 32, 2, TARGET_AVX2)
+DEFINE_BATCH_ISA(avx512, 64, 4, TARGET_AVX512)
+DEFINE_BATCH_ISA(avx512dq, 64, 4, TARGET_AVX512DQ)
+
+#define SIZE_ENTRY(n) n,
+static const uint32_t fixed_sizes[] = { BATCH_SIZES(SIZE_ENTRY) };
+
+#define N_FIXED (sizeof(fixed_sizes) / sizeof(fixed_sizes[0]))
+
+static const struct {
+    const char     *name;
+    const batch_fn *fn;
+} fixed_impls[] = {
+    { "scalar",   fixed_scalar   },
+    { "avx2",     fixed_avx2     },
+    { "avx512",   fixed_avx512   },
+    { "avx512dq", fixed_avx512dq },
+};
+
+/* index into fixed_impls, set once on the first call */
+static int fixed_sel;
+static pthread_once_t fixed_once = PTHREAD_ONCE_INIT;
+
+/*
+ *  time_fixed - seconds for a few products through kernel @i of @fn
+ */
+static double
+time_fixed(const batch_fn *fn, uint32_t i)
+{
+    static int64_t a[128*128], b[128*128], c[128*128];
+    uint32_t n = fixed_sizes[i];
+    double best = 0;
+
+    for (uint32_t x=0; x<n*n; x++)
+        a[x] = b[x] = x;
+    for (int rep=0; rep<5; rep++) {
+        double t = mm_wtime();
+        fn[i](n, n, n, a, n, b, n, c, n, 0);
+        t = mm_wtime() - t;
+        if (rep == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/*
+ *  select_fixed - as select_tile in mm_simd.c: best supported ISA, or
+ *                 MM_SIMD if set and supported, timing vpmullq against the
+ *                 three-multiply AVX-512 build
+ */
+static int
+select_fixed(void)
+{
+    const char *env = getenv("MM_SIMD");
+    int n = sizeof(fixed_impls) / sizeof(fixed_impls[0]);
+
+    if (env)
+        for (int i=0; i<n; i++)
+            if (!strcmp(env, fixed_impls[i].name) && mm_simd_supports(env))
+                return i;
+
+    for (int i=n-1; i>0; i--) {
+        if (!mm_simd_supports(fixed_impls[i].name))
+            continue;
+        if (!strcmp(fixed_impls[i].name, "avx512dq") &&
+            time_fixed(fixed_impls[i-1].fn, 2) < time_fixed(fixed_impls[i].fn, 2))
+            return i-1;
+        return i;
+    }
+    return 0;
+}
+
+static void
+init_fixed(void)
+{
+    fixed_sel = select_fixed();
+}
+
+/* batch chunks on several workers can ask first at once: time under once */
+static const batch_fn *
+fixed_kernels(void)
+{
+    pthread_once(&fixed_once, init_fixed);
+    return fixed_impls[fixed_sel].fn;
+}
+
+/*
+ *  batch_kernel - fixed-size kernel for M x K x N if there is one, else
+ *                 gemm_small
+ */
+static batch_fn
+batch_kernel(uint32_t M, uint32_t N, uint32_t K)
+{
+    if (M == N && K == N)
+        for (uint32_t i=0; i<N_FIXED; i++)
+            if (fixed_sizes[i] == N)
+                return fixed_kernels()[i];
+    return gemm_small;
+}
+
+/*
+ *  mm_gemm_fixed - one product: the kernel compiled for its size if it is
+ *                  square 8..128 (see BATCH_SIZES), mm_gemm_block otherwise
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @accumulate: add into C instead of overwriting it
+ */
+void
+mm_gemm_fixed(uint32_t M, uint32_t N, uint32_t K,
+              const int64_t *A, uint64_t lda,
+              const int64_t *B, uint64_t ldb,
+              int64_t *C, uint64_t ldc, int accumulate)
+{
+    batch_fn fn = batch_kernel(M, N, K);
+
+    if (fn == gemm_small)
+        fn = mm_gemm_block;
+    fn(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+}
+
+/*
+ *  mm_fixed - registry entry, square N
+ */
+void
+mm_fixed(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_fixed(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+/* one batch call, in any of the three layouts */
+struct batch {
+    uint64_t count;
+    int accumulate;
+
+    /* pointer array / strided: every product is M x K x N */
+    uint32_t M, N, K;
+    uint64_t lda, ldb, ldc;
+    const int64_t *const *Ap, *const *Bp;
+    int64_t *const *Cp;
+    const int64_t *A, *B;
+    int64_t *C;
+    uint64_t stride_a, stride_b, stride_c;
+
+    /* list: products sorted by shape through order[] */
+    const struct mm_gemm_args *list;
+    const uint32_t *order;
+};
+
+/*
+ *  batch_item - operands of product @i
+ */
+static void
+batch_item(const struct batch *b, uint64_t i, struct mm_gemm_args *p)
+{
+    if (b->list) {
+        *p = b->list[b->order[i]];
+        return;
+    }
+
+    p->M = b->M;
+    p->N = b->N;
+    p->K = b->K;
+    p->lda = b->lda;
+    p->ldb = b->ldb;
+    p->ldc = b->ldc;
+    if (b->Ap) {
+        p->A = b->Ap[i];
+        p->B = b->Bp[i];
+        p->C = b->Cp[i];
+    } else {
+        p->A = &b->A[i*b->stride_a];
+        p->B = &b->B[i*b->stride_b];
+        p->C = &b->C[i*b->stride_c];
+    }
+}
+
+/*
+ *  batch_range - products @lo..@hi-1; the kernel is looked up again only
+ *                when the shape changes, so a group of one shape pays once
+ */
+static void
+batch_range(const struct batch *b, uint64_t lo, uint64_t hi)
+{
+    struct mm_gemm_args p, last = { 0 };
+    batch_fn fn = NULL;
+
+    for (uint64_t i=lo; i<hi; i++) {
+        batch_item(b, i, &p);
+        if (!fn || p.M != last.M || p.N != last.N || p.K != last.K) {
+            fn = batch_kernel(p.M, p.N, p.K);
+            last = p;
+        }
+        fn(p.M, p.N, p.K, p.A, p.lda, p.B, p.ldb, p.C, p.ldc, b->accumulate);
+    }
+}
+
+static void
+batch_task(void *ctx, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct batch *b = ctx;
+    uint64_t lo = (uint64_t)task * BATCH_CHUNK;
+
+    (void)ws;
+    (void)worker;
+    batch_range(b, lo, min(lo + BATCH_CHUNK, b->count));
+}
+
+/*
+ *  batch_run - run every product, threaded if there is enough work
+ *      @work: multiply-adds of the whole batch
+ */
+static void
+batch_run(const struct batch *b, uint64_t work)
+{
+    if (!b->count)
+        return;
+
+    /* pick the ISA here, not racing in the workers */
+    fixed_kernels();
+    if (work < BATCH_MIN_WORK || mm_get_num_threads() == 1) {
+        batch_range(b, 0, b->count);
+        return;
+    }
+    mm_ws_run(0, batch_task, (void *)b,
+              (b->count + BATCH_CHUNK - 1) / BATCH_CHUNK);
+}
+
+/*
+ *  mm_gemm_batch - C[i] (+)= A[i] * B[i] for i < @count, pointer arrays
+ *      @M, @N, @K: shape shared by every product
+ *      @lda, @ldb, @ldc: row strides shared by every product
+ *      @accumulate: add into C[i] instead of overwriting it
+ */
+void
+mm_gemm_batch(uint32_t M, uint32_t N, uint32_t K,
+              const int64_t *const *A, uint64_t lda,
+              const int64_t *const *B, uint64_t ldb,
+              int64_t *const *C, uint64_t ldc,
+              int accumulate, uint64_t count)
+{
+    struct batch b = {
+        .count = count, .accumulate = accumulate,
+        .M = M, .N = N, .K = K,
+        .lda = lda, .ldb = ldb, .ldc = ldc,
+        .Ap = A, .Bp = B, .Cp = C,
+    };
+    batch_run(&b, (uint64_t)M * N * K * count);
+}
+
+/*
+ *  mm_gemm_batch_strided - mm_gemm_batch with product i at
+ *                          A + i * @stride_a, B + i * @stride_b and
+ *                          C + i * @stride_c (in elements)
+ */
+void
+mm_gemm_batch_strided(uint32_t M, uint32_t N, uint32_t K,
+                      const int64_t *A, uint64_t lda, uint64_t stride_a,
+                      const int64_t *B, uint64_t ldb, uint64_t stride_b,
+                      int64_t *C, uint64_t ldc, uint64_t stride_c,
+                      int accumulate, uint64_t count)
+{
+    struct batch b = {
+        .count = count, .accumulate = accumulate,
+        .M = M, .N = N, .K = K,
+        .lda = lda, .ldb = ldb, .ldc = ldc,
+        .A = A, .B = B, .C = C,
+        .stride_a = stride_a, .stride_b = stride_b, .stride_c = stride_c,
+    };
+    batch_run(&b, (uint64_t)M * N * K * count);
+}
+
+/* qsort passes no context: the list the indices point into, per thread */
+static __thread const struct mm_gemm_args *sort_list;
+
+static int
+cmp_shape(const void *a, const void *b)
+{
+    const struct mm_gemm_args *x = &sort_list[*(const uint32_t *)a];
+    const struct mm_gemm_args *y = &sort_list[*(const uint32_t *)b];
+
+    if (x->M != y->M)
+        return x->M < y->M ? -1 : 1;
+    if (x->N != y->N)
+        return x->N < y->N ? -1 : 1;
+    if (x->K != y->K)
+        return x->K < y->K ? -1 : 1;
+    return 0;
+}
+
+/*
+ *  mm_gemm_batch_list - products of any shapes, grouped by shape before
+ *                       they run so each group shares one kernel
+ *      @p: @count problems
+ *      @accumulate: add into every C instead of overwriting it
+ */
+void
+mm_gemm_batch_list(const struct mm_gemm_args *p, uint32_t count, int accumulate)
+{
+    uint32_t *order = malloc((uint64_t)count * sizeof(uint32_t));
+    uint64_t work = 0;
+
+    for (uint32_t i=0; i<count; i++) {
+        order[i] = i;
+        work += (uint64_t)p[i].M * p[i].N * p[i].K;
+    }
+    sort_list = p;
+    qsort(order, count, sizeof(uint32_t), cmp_shape);
+
+    struct batch b = {
+        .count = count, .accumulate = accumulate,
+        .list = p, .order = order,
+    };
+    batch_run(&b, work);
+    free(order);
+}
@@ -0,0 +1,597 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* getenv                         */
+#include <string.h>     /* memset, strcmp                 */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <math.h>       /* fabs                           */
+#include <pthread.h>
+
+#include "matmul.h"
+
+/*
+ *  Typed kernels: block, transposed and pt_stride for narrow integer and
+ *  floating-point elements. Operands keep their own width (int8 A and B
+ *  are read as bytes) and products are summed in the wider accumulator
+ *  type of MM_FOR_EACH_DTYPE, so int8 runs at an eighth of the int64
+ *  bandwidth. The bodies are plain loops written once per element type by
+ *  DEFINE_DTYPE and compiled once per ISA (scalar, AVX2+FMA, AVX-512BW);
+ *  the vectorizer does the widening and the float/double FMAs, and the
+ *  ISA is picked with CPUID like the int64 micro-kernels.
+ *
+ *  pt_stride runs on an outer-product tile: DTYPE_MR rows x two vectors
+ *  of C stay in registers across k, each k broadcasting one element of A
+ *  per row against a widened row of B. That is why its precopy keeps B
+ *  row-major rather than transposing it as the int64 worker does. The tile
+ *  uses GCC vector types sized for the ISA: an array of scalars indexed by
+ *  runtime bounds is kept in memory under -fPIC, a vector is not.
+ */
+
+/* independent partial sums per dot product: two zmm of int32/float */
+#define DTYPE_LANES 32
+
+/* outer-product tile rows; columns are two vectors of the accumulator */
+#define DTYPE_MR 6
+
+/* pt_stride: C columns per tile (rows are STRIDE, depth STRIDE_K) */
+#define DTYPE_TILE_N 128
+
+#define ISA_SCALAR 0
+#define ISA_AVX2   1
+#define ISA_AVX512 2
+
+static const char *const isa_names[] = { "scalar", "avx2", "avx512" };
+
+/* ISA of the typed kernels, set once on the first call */
+static int isa_sel;
+static pthread_once_t isa_once = PTHREAD_ONCE_INIT;
+
+/*
+ *  select_isa - widest supported ISA, or MM_SIMD if set and supported
+ *               (avx512dq counts as avx512 here)
+ */
+static int
+select_isa(void)
+{
+    const char *env = getenv("MM_SIMD");
+    int best = ISA_SCALAR;
+
+    if (mm_simd_supports("avx2") && mm_simd_supports("fma"))
+        best = ISA_AVX2;
+    if (best == ISA_AVX2 && mm_simd_supports("avx512bw"))
+        best = ISA_AVX512;
+
+    if (env)
+        for (int i=best; i>=0; i--)
+            if (!strncmp(env, isa_names[i], strlen(isa_names[i])))
+                return i;
+    return best;
+}
+
+static void
+init_isa(void)
+{
+    isa_sel = select_isa();
+}
+
+static int
+dtype_isa(void)
+{
+    pthread_once(&isa_once, init_isa);
+    return isa_sel;
+}
+
+/*
+ *  mm_dtype_simd_name - ISA the typed kernels run on
+ */
+const char *
+mm_dtype_simd_name(void)
+{
+    return isa_names[dtype_isa()];
+}
+
+/*
+ *  DEFINE_DTYPE_ISA - one ISA build of the typed bodies
+ *      @vb:   vector width in bytes (16 for the SSE2 baseline)
+ *      @attr: target attribute, empty for the baseline build
+ */
+#define DEFINE_DTYPE_ISA(sfx, T, ACC, isa, vb, attr)                            \
+attr static void                                                                \
+tile_dot_##sfx##_##isa(uint32_t mt, uint32_t nt, uint32_t kt,                   \
+                       const T *a, uint64_t lda, const T *bt, uint64_t ldb,     \
+                       ACC *c, uint64_t ldc)                                    \
+{                                                                               \
+    tile_dot_##sfx##_body(mt, nt, kt, a, lda, bt, ldb, c, ldc);                 \
+}                                                                               \
+                                                                                \
+/* c[i*ldc + j] += sum_k a[i*lda + k] * b[k*ldb + j], DTYPE_MR x 2 vectors */   \
+attr static void                                                                \
+tile_outer_##sfx##_##isa(uint32_t mt, uint32_t nt, uint32_t kt,                 \
+                         const T *a, uint64_t lda, const T *b, uint64_t ldb,    \
+                         ACC *c, uint64_t ldc)                                  \
+{                                                                               \
+    enum { L = vb / sizeof(ACC), NR = 2 * L };                                  \
+    typedef ACC vacc __attribute__((vector_size(vb)));                          \
+    typedef T vt __attribute__((vector_size(L * sizeof(T))));                   \
+    uint32_t i = 0;                                                             \
+                                                                                \
+    if (sizeof(T) < 4) {                                                        \
+        tile_narrow_##sfx##_body(mt, nt, kt, a, lda, b, ldb, c, ldc);           \
+        return;                                                                 \
+    }                                                                           \
+                                                                                \
+    for (; i+DTYPE_MR<=mt; i+=DTYPE_MR) {                                       \
+        uint32_t j = 0;                                                         \
+        for (; j+NR<=nt; j+=NR) {                                               \
+            vacc acc[DTYPE_MR][2];                                              \
+            for (uint32_t r=0; r<DTYPE_MR; r++)                                 \
+                acc[r][0] = acc[r][1] = (vacc){ 0 };                            \
+                                                                                \
+            for (uint32_t k=0; k<kt; k++) {                                     \
+                vt b0, b1;                                                      \
+                memcpy(&b0, &b[k*ldb + j], sizeof(vt));                         \
+                memcpy(&b1, &b[k*ldb + j + L], sizeof(vt));                     \
+                vacc w0 = __builtin_convertvector(b0, vacc);                    \
+                vacc w1 = __builtin_convertvector(b1, vacc);                    \
+                for (uint32_t r=0; r<DTYPE_MR; r++) {                           \
+                    ACC ar = a[(i+r)*lda + k];                                  \
+                    acc[r][0] += ar * w0;                                       \
+                    acc[r][1] += ar * w1;                                       \
+                }                                                               \
+            }                                                                   \
+            for (uint32_t r=0; r<DTYPE_MR; r++) {                               \
+                ACC *cr = &c[(i+r)*ldc + j];                                    \
+                vacc c0, c1;                                                    \
+                memcpy(&c0, cr, vb);                                            \
+                memcpy(&c1, cr + L, vb);                                        \
+                c0 += acc[r][0];                                                \
+                c1 += acc[r][1];                                                \
+                memcpy(cr, &c0, vb);                                            \
+                memcpy(cr + L, &c1, vb);                                        \
+            }                                                                   \
+        }                                                                       \
+        tile_edge_##sfx##_body(DTYPE_MR, nt-j, kt, &a[i*lda], lda, &b[j], ldb,  \
+                               &c[i*ldc + j], ldc);                             \
+    }                                                                           \
+    tile_edge_##sfx##_body(mt-i, nt, kt, &a[i*lda], lda, b, ldb,                \
+                           &c[i*ldc], ldc);                                     \
+}                                                                               \
+                                                                                \
+attr static void                                                                \
+block_##sfx##_##isa(uint32_t M, uint32_t N, uint32_t K,                         \
+                    const T *A, uint64_t lda, const T *B, uint64_t ldb,         \
+                    ACC *C, uint64_t ldc, uint32_t b)                           \
+{                                                                               \
+    block_##sfx##_body(M, N, K, A, lda, B, ldb, C, ldc, b);                     \
+}
+
+/*
+ *  DEFINE_DTYPE - block, transposed and pt_stride for element type @T
+ *                 summed in @ACC, named mm_gemm_<kernel>_@sfx
+ */
+#define DEFINE_DTYPE(sfx, T, ACC)                                               \
+                                                                                \
+/*                                                                              \
+ * c[i*ldc + j] += sum_k a[i*lda + k] * bt[j*ldb + k], as mm_tile_fn. The      \
+ * DTYPE_LANES partial sums vectorize without reassociating float adds, and    \
+ * give the same float result on every ISA.                                    \
+ */                                                                             \
+static inline __attribute__((always_inline)) void                               \
+tile_dot_##sfx##_body(uint32_t mt, uint32_t nt, uint32_t kt,                    \
+                      const T *a, uint64_t lda, const T *bt, uint64_t ldb,      \
+                      ACC *c, uint64_t ldc)                                     \
+{                                                                               \
+    for (uint32_t i=0; i<mt; i++)                                               \
+        for (uint32_t j=0; j<nt; j++) {                                         \
+            const T *ai = &a[i*lda];                                            \
+            const T *bj = &bt[j*ldb];                                           \
+            ACC part[DTYPE_LANES] = { 0 };                                      \
+            ACC acc = 0;                                                        \
+            uint32_t k = 0;                                                     \
+                                                                                \
+            for (; k+DTYPE_LANES<=kt; k+=DTYPE_LANES)                           \
+                for (uint32_t l=0; l<DTYPE_LANES; l++)                          \
+                    part[l] += (ACC)ai[k+l] * (ACC)bj[k+l];                     \
+            for (uint32_t l=0; l<DTYPE_LANES; l++)                              \
+                acc += part[l];                                                 \
+            for (; k<kt; k++)                                                   \
+                acc += (ACC)ai[k] * (ACC)bj[k];                                 \
+            c[i*ldc + j] += acc;                                                \
+        }                                                                       \
+}                                                                               \
+                                                                                \
+/* c[i*ldc + j] += sum_k a[i*lda + k] * b[k*ldb + j], plain kij */            \
+static inline __attribute__((always_inline)) void                               \
+tile_edge_##sfx##_body(uint32_t mt, uint32_t nt, uint32_t kt,                   \
+                       const T *a, uint64_t lda, const T *b, uint64_t ldb,      \
+                       ACC *c, uint64_t ldc)                                    \
+{                                                                               \
+    for (uint32_t k=0; k<kt; k++)                                               \
+        for (uint32_t i=0; i<mt; i++) {                                         \
+            ACC aik = a[i*lda + k];                                             \
+            for (uint32_t j=0; j<nt; j++)                                       \
+                c[i*ldc + j] += aik * (ACC)b[k*ldb + j];                        \
+        }                                                                       \
+}                                                                               \
+                                                                                \
+/*                                                                              \
+ * the outer tile for 8/16-bit operands: plain arrays, a full vector of T per   \
+ * row, which the vectorizer multiplies at the narrow width before widening     \
+ */                                                                             \
+static inline __attribute__((always_inline)) void                               \
+tile_narrow_##sfx##_body(uint32_t mt, uint32_t nt, uint32_t kt,                 \
+                         const T *a, uint64_t lda, const T *b, uint64_t ldb,    \
+                         ACC *c, uint64_t ldc)                                  \
+{                                                                               \
+    enum { MR = 8, NR = 64 / sizeof(T) };                                       \
+    uint32_t i = 0;                                                             \
+                                                                                \
+    for (; i+MR<=mt; i+=MR) {                                                   \
+        uint32_t j = 0;                                                         \
+        for (; j+NR<=nt; j+=NR) {                                               \
+            ACC acc[MR][NR] = { { 0 } };                                        \
+                                                                                \
+            for (uint32_t k=0; k<kt; k++) {                                     \
+                const T *bk = &b[k*ldb + j];                                    \
+                for (uint32_t r=0; r<MR; r++) {                                 \
+                    ACC ar = a[(i+r)*lda + k];                                  \
+                    for (uint32_t x=0; x<NR; x++)                               \
+                        acc[r][x] += ar * (ACC)bk[x];                           \
+                }                                                               \
+            }                                                                   \
+            for (uint32_t r=0; r<MR; r++)                                       \
+                for (uint32_t x=0; x<NR; x++)                                   \
+                    c[(i+r)*ldc + j + x] += acc[r][x];                          \
+        }                                                                       \
+        tile_edge_##sfx##_body(MR, nt-j, kt, &a[i*lda], lda, &b[j], ldb,        \
+                               &c[i*ldc + j], ldc);                             \
+    }                                                                           \
+    tile_edge_##sfx##_body(mt-i, nt, kt, &a[i*lda], lda, b, ldb,                \
+                           &c[i*ldc], ldc);                                     \
+}                                                                               \
+                                                                                \
+/* blk_mat_mul over every block: kij inside, unit stride over B and C */        \
+static inline __attribute__((always_inline)) void                               \
+block_##sfx##_body(uint32_t M, uint32_t N, uint32_t K,                          \
+                   const T *A, uint64_t lda, const T *B, uint64_t ldb,          \
+                   ACC *C, uint64_t ldc, uint32_t b)                            \
+{                                                                               \
+    for (uint32_t ii=0; ii<M; ii+=b)                                            \
+        for (uint32_t jj=0; jj<N; jj+=b)                                        \
+            for (uint32_t kk=0; kk<K; kk+=b) {                                  \
+                uint32_t min_i = min(ii+b, M);                                  \
+                uint32_t min_j = min(jj+b, N);                                  \
+                uint32_t min_k = min(kk+b, K);                                  \
+                for (uint32_t k=kk; k<min_k; k++)                               \
+                    for (uint32_t i=ii; i<min_i; i++) {                         \
+                        ACC aik = A[i*lda + k];                                 \
+                        const T *bk = &B[k*ldb];                                \
+                        ACC *ci = &C[i*ldc];                                    \
+                        for (uint32_t j=jj; j<min_j; j++)                       \
+                            ci[j] += aik * (ACC)bk[j];                          \
+                    }                                                           \
+            }                                                                   \
+}                                                                               \
+                                                                                \
+DEFINE_DTYPE_ISA(sfx, T, ACC, scalar, 16, )                                     \
+DEFINE_DTYPE_ISA(sfx, T, ACC, avx2, 32, __attribute__((target("avx2,fma"))))    \
+DEFINE_DTYPE_ISA(sfx, T, ACC, avx512, 64,                                       \
+                 __attribute__((target("avx512f,avx512bw,avx512vl,fma"))))      \
+                                                                                \
+typedef void (*tile_##sfx##_fn)(uint32_t mt, uint32_t nt, uint32_t kt,          \
+                                const T *a, uint64_t lda,                       \
+                                const T *b, uint64_t ldb,                       \
+                                ACC *c, uint64_t ldc);                          \
+static const tile_##sfx##_fn tile_dot_##sfx[] = {                               \
+    tile_dot_##sfx##_scalar, tile_dot_##sfx##_avx2, tile_dot_##sfx##_avx512,    \
+};                                                                              \
+static const tile_##sfx##_fn tile_outer_##sfx[] = {                             \
+    tile_outer_##sfx##_scalar, tile_outer_##sfx##_avx2,                         \
+    tile_outer_##sfx##_avx512,                                                  \
+};                                                                              \
+                                                                                \
+typedef void (*block_##sfx##_fn)(uint32_t M, uint32_t N, uint32_t K,            \
+                                 const T *A, uint64_t lda,                      \
+                                 const T *B, uint64_t ldb,                      \
+                                 ACC *C, uint64_t ldc, uint32_t b);             \
+static const block_##sfx##_fn block_##sfx[] = {                                 \
+    block_##sfx##_scalar, block_##sfx##_avx2, block_##sfx##_avx512,             \
+};                                                                              \
+                                                                                \
+void                                                                            \
+mm_gemm_block_##sfx(uint32_t M, uint32_t N, uint32_t K,                         \
+                    const T *A, uint64_t lda, const T *B, uint64_t ldb,         \
+                    ACC *C, uint64_t ldc, int accumulate)                       \
+{                                                                               \
+    if (!accumulate)                                                            \
+        for (uint32_t i=0; i<M; i++)                                            \
+            memset(&C[i*ldc], 0, N * sizeof(ACC));                              \
+    block_##sfx[dtype_isa()](M, N, K, A, lda, B, ldb, C, ldc,                   \
+                             mm_get_block_size());                              \
+}                                                                               \
+                                                                                \
+void                                                                            \
+mm_gemm_transposed_##sfx(uint32_t M, uint32_t N, uint32_t K,                    \
+                         const T *A, uint64_t lda, const T *B, uint64_t ldb,    \
+                         ACC *C, uint64_t ldc, int accumulate)                  \
+{                                                                               \
+    T *Bt = mm_alloc((uint64_t)N * K * sizeof(T));                              \
+                                                                                \
+    for (uint32_t k=0; k<K; k++)                                                \
+        for (uint32_t j=0; j<N; j++)                                            \
+            Bt[(uint64_t)j*K + k] = B[k*ldb + j];                               \
+                                                                                \
+    if (!accumulate)                                                            \
+        for (uint32_t i=0; i<M; i++)                                            \
+            memset(&C[i*ldc], 0, N * sizeof(ACC));                              \
+    tile_dot_##sfx[dtype_isa()](M, N, K, A, lda, Bt, K, C, ldc);                \
+                                                                                \
+    mm_free(Bt);                                                                \
+}                                                                               \
+                                                                                \
+struct stride_##sfx {                                                           \
+    uint32_t M, N, K;                                                           \
+    const T *A;                                                                 \
+    uint64_t lda;                                                               \
+    const T *B;                                                                 \
+    uint64_t ldb;                                                               \
+    ACC *C;                                                                     \
+    uint64_t ldc;                                                               \
+    int accumulate;                                                             \
+    tile_##sfx##_fn tile;                                                       \
+};                                                                              \
+                                                                                \
+/* one tile of the BLOCK_RATIO_H x BLOCK_RATIO_W grid, as worker_stride; the    \
+   micro-kernel adds straight into C, each piece cleared just before its        \
+   first K slice, so there is no private result to copy back */                 \
+static void                                                                     \
+stride_slice_##sfx(const struct stride_##sfx *s, uint32_t id)                   \
+{                                                                               \
+    uint32_t h = id / BLOCK_RATIO_W, w = id % BLOCK_RATIO_W;                    \
+    uint32_t line = MM_LINE / sizeof(ACC);                                      \
+    uint32_t i0 = (uint64_t)s->M * h / BLOCK_RATIO_H;                           \
+    uint32_t j0 = mm_pt_col_split(s->N, w, line);                               \
+    uint32_t bh = (uint64_t)s->M * (h+1) / BLOCK_RATIO_H - i0;                  \
+    uint32_t bw = mm_pt_col_split(s->N, w+1, line) - j0;                        \
+    uint32_t K = s->K;                                                          \
+    ACC *C = &s->C[i0*s->ldc + j0];                                             \
+    uint64_t ldc = s->ldc;                                                      \
+                                                                                \
+    if (!bh || !bw)                                                             \
+        return;                                                                 \
+    if (!K) {                                                                   \
+        for (uint32_t i=0; i<bh && !s->accumulate; i++)                         \
+            memset(&C[i*ldc], 0, bw * sizeof(ACC));                             \
+        return;                                                                 \
+    }                                                                           \
+                                                                                \
+    uint64_t lda = K, ldb = bw;                                                 \
+    T *a = mm_alloc((uint64_t)bh * lda * sizeof(T));                            \
+    T *b = mm_alloc((uint64_t)K * ldb * sizeof(T));                             \
+                                                                                \
+    for (uint32_t i=0; i<bh; i++)                                               \
+        memcpy(&a[i*lda], &s->A[(i0+i)*s->lda], K * sizeof(T));                 \
+    for (uint32_t k=0; k<K; k++)                                                \
+        memcpy(&b[k*ldb], &s->B[k*s->ldb + j0], bw * sizeof(T));                \
+                                                                                \
+    for (uint32_t jj=0; jj<bw; jj+=DTYPE_TILE_N)                                \
+        for (uint32_t kk=0; kk<K; kk+=STRIDE_K)                                 \
+            for (uint32_t ii=0; ii<bh; ii+=STRIDE) {                            \
+                uint32_t mt = min(STRIDE, bh-ii), nt = min(DTYPE_TILE_N, bw-jj);\
+                ACC *c = &C[ii*ldc + jj];                                       \
+                                                                                \
+                if (!kk && !s->accumulate)                                      \
+                    for (uint32_t i=0; i<mt; i++)                               \
+                        memset(&c[i*ldc], 0, nt * sizeof(ACC));                 \
+                s->tile(mt, nt, min(STRIDE_K, K-kk),                            \
+                        &a[ii*lda + kk], lda,                                   \
+                        &b[kk*ldb + jj], ldb,                                   \
+                        c, ldc);                                                \
+            }                                                                   \
+                                                                                \
+    mm_free(a);                                                                 \
+    mm_free(b);                                                                 \
+}                                                                               \
+                                                                                \
+static void                                                                     \
+stride_job_##sfx(void *arg, uint32_t tid, uint32_t nthreads)                    \
+{                                                                               \
+    for (uint32_t id=tid; id<N_THREADS; id+=nthreads)                           \
+        stride_slice_##sfx(arg, id);                                            \
+}                                                                               \
+                                                                                \
+void                                                                            \
+mm_gemm_pt_stride_##sfx(uint32_t M, uint32_t N, uint32_t K,                     \
+                        const T *A, uint64_t lda, const T *B, uint64_t ldb,     \
+                        ACC *C, uint64_t ldc, int accumulate)                   \
+{                                                                               \
+    struct stride_##sfx s = {                                                   \
+        .M = M, .N = N, .K = K,                                                 \
+        .A = A, .lda = lda,                                                     \
+        .B = B, .ldb = ldb,                                                     \
+        .C = C, .ldc = ldc,                                                     \
+        .accumulate = accumulate,                                               \
+        .tile = tile_outer_##sfx[dtype_isa()],                                  \
+    };                                                                          \
+    mm_pool_run(mm_pool_get(N_THREADS), stride_job_##sfx, &s);                  \
+}                                                                               \
+                                                                                \
+static void                                                                     \
+any_block_##sfx(uint32_t M, uint32_t N, uint32_t K,                             \
+                const void *A, uint64_t lda, const void *B, uint64_t ldb,       \
+                void *C, uint64_t ldc, int accumulate)                          \
+{                                                                               \
+    mm_gemm_block_##sfx(M, N, K, A, lda, B, ldb, C, ldc, accumulate);           \
+}                                                                               \
+                                                                                \
+static void                                                                     \
+any_transposed_##sfx(uint32_t M, uint32_t N, uint32_t K,                        \
+                     const void *A, uint64_t lda, const void *B, uint64_t ldb,  \
+                     void *C, uint64_t ldc, int accumulate)                     \
+{                                                                               \
+    mm_gemm_transposed_##sfx(M, N, K, A, lda, B, ldb, C, ldc, accumulate);      \
+}                                                                               \
+                                                                                \
+static void                                                                     \
+any_pt_stride_##sfx(uint32_t M, uint32_t N, uint32_t K,                         \
+                    const void *A, uint64_t lda, const void *B, uint64_t ldb,   \
+                    void *C, uint64_t ldc, int accumulate)                      \
+{                                                                               \
+    mm_gemm_pt_stride_##sfx(M, N, K, A, lda, B, ldb, C, ldc, accumulate);       \
+}                                                                               \
+                                                                                \
+static void                                                                     \
+init_##sfx(uint32_t rows, uint32_t cols, void *m, uint64_t ld)                  \
+{                                                                               \
+    T *t = m;                                                                   \
+    for (uint32_t i=0; i<rows; i++)                                             \
+        for (uint32_t j=0; j<cols; j++)                                         \
+            t[i*ld + j] = (T)((int)(((uint64_t)i*cols + j) % 7) - 3);           \
+}                                                                               \
+                                                                                \
+static int                                                                      \
+verify_##sfx(uint32_t M, uint32_t N, uint32_t K,                                \
+             const void *A, uint64_t lda, const void *B, uint64_t ldb,          \
+             const void *C, uint64_t ldc)                                       \
+{                                                                               \
+    const T *a = A, *b = B;                                                     \
+    const ACC *c = C;                                                           \
+    ACC *v = mm_alloc((uint64_t)N * sizeof(ACC));                               \
+    int valid = 1;                                                              \
+                                                                                \
+    for (uint32_t i=0; i<M && valid; i++) {                                     \
+        memset(v, 0, N * sizeof(ACC));                                          \
+        for (uint32_t k=0; k<K; k++)                                            \
+            for (uint32_t j=0; j<N; j++)                                        \
+                v[j] += (ACC)a[i*lda + k] * (ACC)b[k*ldb + j];                  \
+        /* the float kernels sum in another order: allow for rounding */        \
+        for (uint32_t j=0; j<N; j++)                                            \
+            if (c[i*ldc + j] != v[j] &&                                         \
+                ((ACC)1 / 2 == 0 ||                                             \
+                 fabs((double)c[i*ldc + j] - v[j]) > 1e-5 * (fabs(v[j]) + 1))) {\
+                valid = 0;                                                      \
+                break;                                                          \
+            }                                                                   \
+    }                                                                           \
+                                                                                \
+    mm_free(v);                                                                 \
+    return valid;                                                               \
+}
+
+MM_FOR_EACH_DTYPE(DEFINE_DTYPE)
+
+/* int64 has no typed build: the registry kernels are it */
+static void
+init_i64(uint32_t rows, uint32_t cols, void *m, uint64_t ld)
+{
+    mm_init_matrix(rows, cols, m, ld);
+}
+
+static int
+verify_i64(uint32_t M, uint32_t N, uint32_t K,
+           const void *A, uint64_t lda, const void *B, uint64_t ldb,
+           const void *C, uint64_t ldc)
+{
+    return mm_verify_gemm(M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+#define DTYPE_ENTRY(sfx, T, ACC)                                                \
+    { #sfx, sizeof(T), sizeof(ACC), any_block_##sfx, any_transposed_##sfx,      \
+      any_pt_stride_##sfx, init_##sfx, verify_##sfx },
+
+/* indexed by enum mm_dtype */
+static const struct {
+    const char    *name;
+    uint32_t       size;
+    uint32_t       acc_size;
+    mm_gemm_any_fn block;
+    mm_gemm_any_fn transposed;
+    mm_gemm_any_fn pt_stride;
+    void         (*init)(uint32_t rows, uint32_t cols, void *m, uint64_t ld);
+    int          (*verify)(uint32_t M, uint32_t N, uint32_t K,
+                           const void *A, uint64_t lda,
+                           const void *B, uint64_t ldb,
+                           const void *C, uint64_t ldc);
+} dtypes[] = {
+    { "i64", sizeof(int64_t), sizeof(int64_t), NULL, NULL, NULL,
+      init_i64, verify_i64 },
+    MM_FOR_EACH_DTYPE(DTYPE_ENTRY)
+};
+
+#define N_DTYPES (sizeof(dtypes) / sizeof(dtypes[0]))
+
+/*
+ *  mm_dtype_parse - dtype by name (i64, i8, i16, i32, f32, f64)
+ *      @return: the enum mm_dtype value, -1 if unknown
+ */
+int
+mm_dtype_parse(const char *name)
+{
+    for (uint32_t i=0; i<N_DTYPES; i++)
+        if (!strcmp(dtypes[i].name, name))
+            return i;
+    return -1;
+}
+
+const char *
+mm_dtype_name(enum mm_dtype dt)
+{
+    return dtypes[dt].name;
+}
+
+/*
+ *  mm_dtype_size - bytes per element of A and B
+ */
+uint32_t
+mm_dtype_size(enum mm_dtype dt)
+{
+    return dtypes[dt].size;
+}
+
+/*
+ *  mm_dtype_acc_size - bytes per element of C
+ */
+uint32_t
+mm_dtype_acc_size(enum mm_dtype dt)
+{
+    return dtypes[dt].acc_size;
+}
+
+/*
+ *  mm_dtype_kernel - typed build of registry kernel @k
+ *      @return: the kernel, NULL for MM_DTYPE_I64 (use k->gemm) or if @k
+ *               has no typed build
+ */
+mm_gemm_any_fn
+mm_dtype_kernel(const struct mm_kernel *k, enum mm_dtype dt)
+{
+    if (k->gemm == mm_gemm_block)
+        return dtypes[dt].block;
+    if (k->gemm == mm_gemm_transposed)
+        return dtypes[dt].transposed;
+    if (k->gemm == mm_gemm_pt_stride)
+        return dtypes[dt].pt_stride;
+    return NULL;
+}
+
+/*
+ *  mm_dtype_init - small values (-3..3) that no dtype overflows on
+ *      @ld: row stride in elements
+ */
+void
+mm_dtype_init(enum mm_dtype dt, uint32_t rows, uint32_t cols, void *m,
+              uint64_t ld)
+{
+    dtypes[dt].init(rows, cols, m, ld);
+}
+
+/*
+ *  mm_dtype_verify - mm_verify_gemm for any dtype; float and double
+ *                    results may differ from the reference by rounding
+ *      @return: 1 if C == A * B, 0 otherwise
+ */
+int
+mm_dtype_verify(enum mm_dtype dt, uint32_t M, uint32_t N, uint32_t K,
+                const void *A, uint64_t lda, const void *B, uint64_t ldb,
+                const void *C, uint64_t ldc)
+{
+    return dtypes[dt].verify(M, N, K, A, lda, B, ldb, C, ldc);
+}
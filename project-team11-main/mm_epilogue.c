@@ -0,0 +1,185 @@
+#include <errno.h>      /* errno, EINVAL, ENOMEM          */
+#include <stddef.h>     /* NULL                           */
+#include <stdint.h>     /* uint32_t, uint64_t, INT64_MIN  */
+
+#include "matmul.h"
+
+/*
+ *  Epilogues: C = alpha * A B + beta * C plus a per-row and per-column
+ *  bias, a rounding shift and a clamp, with the result stored as int64 in
+ *  C or requantized (saturated) to int8/int16/int32 in a separate array.
+ *
+ *  The pt kernels sum each tile into a private buffer and then copy it to
+ *  C; their _ep forms run the epilogue in that copy instead, so the output
+ *  is written once and never read back (read once more only if beta != 0).
+ *  mm_gemm_ep uses those when the kernel has one, and otherwise runs the
+ *  plain kernel and a separate parallel pass over the result.
+ */
+
+#define EP_ROWS 64              /* rows per task of the separate pass */
+
+/*
+ *  mm_epilogue_init - the identity: alpha 1, beta 0, no bias, no shift,
+ *                     no clamp, int64 into C
+ */
+void
+mm_epilogue_init(struct mm_epilogue *ep)
+{
+    *ep = (struct mm_epilogue){
+        .alpha = 1,
+        .lo = INT64_MIN,
+        .hi = INT64_MAX,
+        .out = MM_DTYPE_I64,
+    };
+}
+
+/* @lo, @hi narrowed to what @dt holds */
+static void
+out_range(enum mm_dtype dt, int64_t *lo, int64_t *hi)
+{
+    int64_t l = INT64_MIN, h = INT64_MAX;
+
+    switch (dt) {
+    case MM_DTYPE_I8:  l = INT8_MIN;  h = INT8_MAX;  break;
+    case MM_DTYPE_I16: l = INT16_MIN; h = INT16_MAX; break;
+    case MM_DTYPE_I32: l = INT32_MIN; h = INT32_MAX; break;
+    default: break;
+    }
+    *lo = max(*lo, l);
+    *hi = min(*hi, h);
+}
+
+/* one row of the tile, stored as T; the loop is the same for every T */
+#define EP_ROW(T, dst)                                                  \
+    for (uint32_t j=0; j<n; j++) {                                      \
+        int64_t v = alpha * a[j] + rb + (beta ? beta * c[j] : 0) +      \
+                    (cb ? cb[j] : 0);                                   \
+        v = (v + round) >> shift;                                       \
+        ((T *)(dst))[j] = v < lo ? lo : v > hi ? hi : v;                \
+    }
+
+/*
+ *  mm_epilogue_tile - write an m x n tile of sums through @ep
+ *      @i0, @j0: where the tile sits in C (and in the bias vectors)
+ *      @acc: the sums, row stride @ldacc; may be the tile of C itself
+ *      @C, @ldc: the whole of C, read if beta != 0, written if out is I64
+ */
+void
+mm_epilogue_tile(const struct mm_epilogue *ep, uint32_t i0, uint32_t j0,
+                 uint32_t m, uint32_t n, const int64_t *acc, uint64_t ldacc,
+                 int64_t *C, uint64_t ldc)
+{
+    int64_t alpha = ep->alpha, beta = ep->beta, lo = ep->lo, hi = ep->hi;
+    int64_t round = ep->shift ? (int64_t)1 << (ep->shift - 1) : 0;
+    uint32_t shift = ep->shift;
+    const int64_t *cb = ep->col_bias ? &ep->col_bias[j0] : NULL;
+
+    out_range(ep->out, &lo, &hi);
+
+    for (uint32_t i=0; i<m; i++) {
+        const int64_t *a = &acc[i*ldacc];
+        int64_t *c = C ? &C[(i0+i)*ldc + j0] : NULL;
+        int64_t rb = ep->row_bias ? ep->row_bias[i0+i] : 0;
+        uint64_t q = (i0+i)*ep->ldq + j0;
+
+        switch (ep->out) {
+        case MM_DTYPE_I8:  EP_ROW(int8_t,  &((int8_t *)ep->q)[q]);  break;
+        case MM_DTYPE_I16: EP_ROW(int16_t, &((int16_t *)ep->q)[q]); break;
+        case MM_DTYPE_I32: EP_ROW(int32_t, &((int32_t *)ep->q)[q]); break;
+        default:           EP_ROW(int64_t, c);                      break;
+        }
+    }
+}
+
+/*
+ *  mm_epilogue_kernel - the fused form of registry kernel @k
+ *      @return: the kernel, NULL if @k has none
+ */
+mm_gemm_ep_fn
+mm_epilogue_kernel(const struct mm_kernel *k)
+{
+    if (k->gemm == mm_gemm_pt_rows)
+        return mm_gemm_pt_rows_ep;
+    if (k->gemm == mm_gemm_pt1)
+        return mm_gemm_pt1_ep;
+    if (k->gemm == mm_gemm_pt_precopy)
+        return mm_gemm_pt_precopy_ep;
+    if (k->gemm == mm_gemm_pt_stride)
+        return mm_gemm_pt_stride_ep;
+    if (k->gemm == mm_gemm_pt_steal)
+        return mm_gemm_pt_steal_ep;
+    return NULL;
+}
+
+/* the separate pass: EP_ROWS rows of sums per task */
+struct ep_pass {
+    const struct mm_epilogue *ep;
+    uint32_t M, N;
+    const int64_t *acc;
+    uint64_t ldacc;
+    int64_t *C;
+    uint64_t ldc;
+};
+
+static void
+ep_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct ep_pass *p = arg;
+    uint32_t i0 = task * EP_ROWS;
+
+    (void)ws, (void)worker;
+    mm_epilogue_tile(p->ep, i0, 0, min((uint32_t)EP_ROWS, p->M - i0), p->N,
+                     &p->acc[i0*p->ldacc], p->ldacc, p->C, p->ldc);
+}
+
+/*
+ *  mm_gemm_ep - C = epilogue(A * B) with registry kernel @k, fused into the
+ *               tile write-back if @k has a fused form
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @C: may be NULL if the output is requantized and beta is 0
+ *      @return: 0, -1 with errno set (EINVAL: bad output type or no C
+ *               where one is needed, ENOMEM)
+ */
+int
+mm_gemm_ep(const struct mm_kernel *k, uint32_t M, uint32_t N, uint32_t K,
+           const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+           int64_t *C, uint64_t ldc, const struct mm_epilogue *ep)
+{
+    mm_gemm_ep_fn fused = mm_epilogue_kernel(k);
+    int quant = ep->out != MM_DTYPE_I64;
+
+    if ((quant && (ep->out > MM_DTYPE_I32 || !ep->q)) ||
+        (!C && (!quant || ep->beta)) || ep->shift > 62) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!M || !N)
+        return 0;
+    if (fused) {
+        fused(M, N, K, A, lda, B, ldb, C, ldc, ep);
+        return 0;
+    }
+
+    /* int64 into C with beta 0: the sums can go to C and be rewritten there */
+    struct ep_pass p = {
+        .ep = ep, .M = M, .N = N,
+        .acc = C, .ldacc = ldc,
+        .C = C, .ldc = ldc,
+    };
+    int64_t *tmp = NULL;
+
+    if (quant || ep->beta) {
+        if (!(tmp = mm_alloc((uint64_t)M * N * sizeof(int64_t)))) {
+            errno = ENOMEM;
+            return -1;
+        }
+        p.acc = tmp;
+        p.ldacc = N;
+    }
+    k->gemm(M, N, K, A, lda, B, ldb, (int64_t *)p.acc, p.ldacc, 0);
+    mm_ws_run(0, ep_task, &p, (M + EP_ROWS - 1) / EP_ROWS);
+
+    mm_free(tmp);
+    return 0;
+}
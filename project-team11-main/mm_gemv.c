@@ -0,0 +1,391 @@
+#include <stdlib.h>     /* getenv                         */
+#include <string.h>     /* memcpy, memset, strcmp         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+
+#include "matmul.h"
+
+/*
+ *  Matrix-vector products. Every element of A is used once, so these run
+ *  at memory bandwidth, not at the multiply rate the GEMM kernels tune
+ *  for; a GEMM kernel handed an N x 1 B spends its blocking on a one-wide
+ *  j loop. Two forms, both reading A row by row with unit stride, as
+ *  mat_mut_transposed does for m2:
+ *      mm_gemv:   y = A x, a dot product per row of A. Tasks are bands
+ *                 of rows, about GEMV_TASK_BYTES of A each.
+ *      mm_gemv_t: y = A^T x (y^T = x^T A), a row of A scaled by x[i] and
+ *                 added into y per row. Tasks are GEMV_STRIP columns of y,
+ *                 which stay in L1 while the rows stream past; if y has
+ *                 too few strips for the workers, the rows are cut into
+ *                 bands too, summed into private copies of y and added up.
+ *  The bodies are GCC vector loops with GEMV_UNROLL independent sums,
+ *  compiled once per ISA like the fixed-size kernels (mm_batch.c) and
+ *  picked with CPUID or MM_SIMD. A is prefetched GEMV_PREFETCH elements
+ *  ahead with the non-temporal hint, so the stream does not push x, y and
+ *  the other workers' data out of the caches.
+ */
+
+#define GEMV_UNROLL     4
+#define GEMV_PREFETCH   256             /* elements */
+#define GEMV_TASK_BYTES (256u << 10)    /* of A per row task, at most */
+#define GEMV_TASK_MIN   (16u << 10)     /* and at least, one task runs inline */
+#define GEMV_STRIP      1024            /* columns of y per gemv_t task */
+#define GEMV_BAND_MIN   256             /* least rows per gemv_t band */
+#define GEMV_TASKS_PER_THREAD 4
+
+/*
+ *  DEFINE_GEMV_ISA - the two bodies for element type @T in one ISA build
+ *      @vb: vector width in bytes
+ *      @attr: target attribute, empty for the baseline build
+ */
+#define DEFINE_GEMV_ISA(sfx, T, isa, vb, attr)                                  \
+/* y[i] (+)= A[i,:] . x for @rows rows */                                       \
+attr static void                                                                \
+dot_##sfx##_##isa(uint32_t rows, uint32_t K, const T *A, uint64_t lda,          \
+                  const T *x, T *y, int accumulate)                             \
+{                                                                               \
+    enum { L = vb / sizeof(T), W = GEMV_UNROLL * L };                           \
+    typedef T v __attribute__((vector_size(vb)));                               \
+                                                                                \
+    for (uint32_t i=0; i<rows; i++) {                                           \
+        const T *a = &A[i*lda];                                                 \
+        v acc[GEMV_UNROLL] = { { 0 } };                                         \
+        uint32_t k = 0;                                                         \
+                                                                                \
+        for (; k+W<=K; k+=W) {                                                  \
+            __builtin_prefetch(&a[k + GEMV_PREFETCH], 0, 0);                    \
+            _Pragma("GCC unroll 8")                                             \
+            for (uint32_t u=0; u<GEMV_UNROLL; u++) {                            \
+                v va, vx;                                                       \
+                memcpy(&va, &a[k + u*L], vb);                                   \
+                memcpy(&vx, &x[k + u*L], vb);                                   \
+                acc[u] += va * vx;                                              \
+            }                                                                   \
+        }                                                                       \
+        for (uint32_t u=1; u<GEMV_UNROLL; u++)                                  \
+            acc[0] += acc[u];                                                   \
+        T sum = 0;                                                              \
+        for (uint32_t l=0; l<L; l++)                                            \
+            sum += acc[0][l];                                                   \
+        for (; k<K; k++)                                                        \
+            sum += a[k] * x[k];                                                 \
+        y[i] = accumulate ? y[i] + sum : sum;                                   \
+    }                                                                           \
+}                                                                               \
+                                                                                \
+/* y[0..n) += sum_i x[i] A[i, 0..n) for @rows rows */                           \
+attr static void                                                                \
+axpy_##sfx##_##isa(uint32_t rows, uint32_t n, const T *A, uint64_t lda,         \
+                   const T *x, T *y)                                            \
+{                                                                               \
+    enum { L = vb / sizeof(T), W = GEMV_UNROLL * L };                           \
+    typedef T v __attribute__((vector_size(vb)));                               \
+                                                                                \
+    for (uint32_t i=0; i<rows; i++) {                                           \
+        const T *a = &A[i*lda];                                                 \
+        v xi = (v){ 0 } + x[i];                                                 \
+        uint32_t j = 0;                                                         \
+                                                                                \
+        for (; j+W<=n; j+=W) {                                                  \
+            __builtin_prefetch(&a[j + GEMV_PREFETCH], 0, 0);                    \
+            _Pragma("GCC unroll 8")                                             \
+            for (uint32_t u=0; u<GEMV_UNROLL; u++) {                            \
+                v va, vy;                                                       \
+                memcpy(&va, &a[j + u*L], vb);                                   \
+                memcpy(&vy, &y[j + u*L], vb);                                   \
+                vy += xi * va;                                                  \
+                memcpy(&y[j + u*L], &vy, vb);                                   \
+            }                                                                   \
+        }                                                                       \
+        for (; j<n; j++)                                                        \
+            y[j] += x[i] * a[j];                                                \
+    }                                                                           \
+}
+
+#define TARGET_AVX2     __attribute__((target("avx2,fma")))
+#define TARGET_AVX512   __attribute__((target("avx512f,fma")))
+#define TARGET_AVX512DQ __attribute__((target("avx512f,avx512dq,fma")))
+
+#define DEFINE_GEMV_TYPE(sfx, T)                                                \
+DEFINE_GEMV_ISA(sfx, T, scalar, 16, )                                           \
+DEFINE_GEMV_ISA(sfx, T, avx2, 32, TARGET_AVX2)                                  \
+DEFINE_GEMV_ISA(sfx, T, avx512, 64, TARGET_AVX512)                              \
+DEFINE_GEMV_ISA(sfx, T, avx512dq, 64, TARGET_AVX512DQ)
+
+DEFINE_GEMV_TYPE(i64, int64_t)
+DEFINE_GEMV_TYPE(f32, float)
+
+/* a body taking either element type, through void pointers */
+typedef void (*dot_fn)(uint32_t rows, uint32_t K, const void *A, uint64_t lda,
+                       const void *x, void *y, int accumulate);
+typedef void (*axpy_fn)(uint32_t rows, uint32_t n, const void *A, uint64_t lda,
+                        const void *x, void *y);
+
+#define GEMV_ENTRY(isa)                                                         \
+    { .name = #isa,                                                             \
+      .dot  = { (dot_fn)dot_i64_##isa, (dot_fn)dot_f32_##isa },                 \
+      .axpy = { (axpy_fn)axpy_i64_##isa, (axpy_fn)axpy_f32_##isa } }
+
+static const struct {
+    const char *name;
+    dot_fn      dot[2];         /* i64, f32 */
+    axpy_fn     axpy[2];
+} gemv_impls[] = {
+    GEMV_ENTRY(scalar),
+    GEMV_ENTRY(avx2),
+    GEMV_ENTRY(avx512),
+    GEMV_ENTRY(avx512dq),
+};
+
+/* index into gemv_impls, set once on the first call */
+static int gemv_sel;
+static pthread_once_t gemv_once = PTHREAD_ONCE_INIT;
+
+/*
+ *  select_gemv - MM_SIMD if set and supported, else the widest ISA; no
+ *                timing as in select_fixed, the loads bound these bodies
+ */
+static int
+select_gemv(void)
+{
+    const char *env = getenv("MM_SIMD");
+    int n = sizeof(gemv_impls) / sizeof(gemv_impls[0]);
+
+    if (env)
+        for (int i=0; i<n; i++)
+            if (!strcmp(env, gemv_impls[i].name) && mm_simd_supports(env))
+                return i;
+    /* the vector builds all target FMA for the float bodies */
+    for (int i=n-1; i>0; i--)
+        if (mm_simd_supports(gemv_impls[i].name) && mm_simd_supports("fma"))
+            return i;
+    return 0;
+}
+
+static void
+init_gemv(void)
+{
+    gemv_sel = select_gemv();
+}
+
+static int
+gemv_isa(void)
+{
+    pthread_once(&gemv_once, init_gemv);
+    return gemv_sel;
+}
+
+/*
+ *  mm_gemv_simd_name - ISA the matrix-vector bodies run on
+ */
+const char *
+mm_gemv_simd_name(void)
+{
+    return gemv_impls[gemv_isa()].name;
+}
+
+/* one mm_gemv / mm_gemv_t call; A is M x N */
+struct gemv {
+    uint32_t M, N;
+    const char *A;
+    uint64_t lda;
+    const char *x;
+    char *y;
+    int accumulate;
+    uint32_t size;              /* element bytes */
+    dot_fn dot;
+    axpy_fn axpy;
+
+    uint32_t rows;              /* per row task / per band */
+    uint32_t strips;            /* gemv_t: columns of y / GEMV_STRIP */
+    uint32_t bands;             /* gemv_t: 1 unless y is too narrow */
+    char *part;                 /* gemv_t: bands - 1 private copies of y */
+};
+
+static void
+dot_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct gemv *g = arg;
+    uint64_t i0 = (uint64_t)task * g->rows;
+
+    (void)ws, (void)worker;
+    g->dot(min((uint64_t)g->rows, g->M - i0), g->N, g->A + i0 * g->lda * g->size,
+           g->lda, g->x, g->y + i0 * g->size, g->accumulate);
+}
+
+/* y, or the private copy of band @b */
+static char *
+band_y(const struct gemv *g, uint32_t b)
+{
+    return b ? g->part + (uint64_t)(b-1) * g->N * g->size : g->y;
+}
+
+static void
+axpy_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct gemv *g = arg;
+    uint32_t b = task / g->strips;
+    uint64_t j0 = (uint64_t)(task % g->strips) * GEMV_STRIP;
+    uint64_t i0 = (uint64_t)b * g->rows;
+    uint32_t n = min((uint64_t)GEMV_STRIP, g->N - j0);
+    char *y = band_y(g, b) + j0 * g->size;
+
+    (void)ws, (void)worker;
+    if (b || !g->accumulate)
+        memset(y, 0, (uint64_t)n * g->size);
+    g->axpy(min((uint64_t)g->rows, g->M - i0), n,
+            g->A + (i0 * g->lda + j0) * g->size, g->lda,
+            g->x + i0 * g->size, y);
+}
+
+/* one strip of y += the bands' copies */
+static void
+sum_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct gemv *g = arg;
+    uint64_t j0 = (uint64_t)task * GEMV_STRIP;
+    uint32_t n = min((uint64_t)GEMV_STRIP, g->N - j0);
+
+    (void)ws, (void)worker;
+    for (uint32_t b=1; b<g->bands; b++) {
+        const char *p = band_y(g, b) + j0 * g->size;
+        if (g->size == sizeof(float))
+            for (uint32_t j=0; j<n; j++)
+                ((float *)g->y)[j0 + j] += ((const float *)p)[j];
+        else
+            for (uint32_t j=0; j<n; j++)
+                ((int64_t *)g->y)[j0 + j] += ((const int64_t *)p)[j];
+    }
+}
+
+/* @ntasks of @fn, on the workers if there is more than one */
+static void
+run_tasks(mm_task_fn fn, struct gemv *g, uint64_t ntasks)
+{
+    if (ntasks == 1)
+        fn(g, NULL, 0, 0);
+    else
+        mm_ws_run(0, fn, g, ntasks);
+}
+
+static void
+gemv_run(struct gemv *g)
+{
+    uint32_t want = GEMV_TASKS_PER_THREAD * mm_get_num_threads();
+    uint64_t row_bytes = max((uint64_t)g->N * g->size, 1ul);
+    uint64_t rows = ((uint64_t)g->M + want - 1) / want;
+
+    if (!g->M)
+        return;
+    rows = max(rows, GEMV_TASK_MIN / row_bytes);
+    rows = min(rows, max(GEMV_TASK_BYTES / row_bytes, 1ul));
+    g->rows = min(rows, (uint64_t)g->M);
+    run_tasks(dot_task, g, (g->M + g->rows - 1) / g->rows);
+}
+
+static void
+gemv_t_run(struct gemv *g)
+{
+    uint32_t want = GEMV_TASKS_PER_THREAD * mm_get_num_threads();
+
+    if (!g->N)
+        return;
+    g->strips = (g->N + GEMV_STRIP - 1) / GEMV_STRIP;
+    g->bands = 1;
+    if (g->strips < want)
+        g->bands = max(1u, min((want + g->strips - 1) / g->strips,
+                               g->M / GEMV_BAND_MIN));
+    /* no room for the partial sums: one band, straight into y */
+    if (g->bands > 1 &&
+        !(g->part = mm_alloc((uint64_t)(g->bands - 1) * g->N * g->size)))
+        g->bands = 1;
+    g->rows = (g->M + g->bands - 1) / g->bands;
+
+    run_tasks(axpy_task, g, (uint64_t)g->bands * g->strips);
+    if (g->bands > 1) {
+        run_tasks(sum_task, g, g->strips);
+        mm_free(g->part);
+    }
+}
+
+/*
+ *  mm_gemv - y (+)= A x
+ *      @M, @K: A is M x K, x has K elements, y has M
+ *      @lda: row stride of A
+ *      @accumulate: add into y instead of overwriting it
+ */
+void
+mm_gemv(uint32_t M, uint32_t K, const int64_t *A, uint64_t lda,
+        const int64_t *x, int64_t *y, int accumulate)
+{
+    struct gemv g = {
+        .M = M, .N = K,
+        .A = (const char *)A, .lda = lda,
+        .x = (const char *)x, .y = (char *)y,
+        .accumulate = accumulate,
+        .size = sizeof(int64_t),
+        .dot = gemv_impls[gemv_isa()].dot[0],
+    };
+
+    gemv_run(&g);
+}
+
+/*
+ *  mm_gemv_t - y (+)= A^T x, that is y^T (+)= x^T A
+ *      @M, @N: A is M x N, x has M elements, y has N
+ *      @lda: row stride of A
+ *      @accumulate: add into y instead of overwriting it
+ */
+void
+mm_gemv_t(uint32_t M, uint32_t N, const int64_t *A, uint64_t lda,
+          const int64_t *x, int64_t *y, int accumulate)
+{
+    struct gemv g = {
+        .M = M, .N = N,
+        .A = (const char *)A, .lda = lda,
+        .x = (const char *)x, .y = (char *)y,
+        .accumulate = accumulate,
+        .size = sizeof(int64_t),
+        .axpy = gemv_impls[gemv_isa()].axpy[0],
+    };
+
+    gemv_t_run(&g);
+}
+
+/*
+ *  mm_gemv_f32 - mm_gemv on float, summed in float
+ */
+void
+mm_gemv_f32(uint32_t M, uint32_t K, const float *A, uint64_t lda,
+            const float *x, float *y, int accumulate)
+{
+    struct gemv g = {
+        .M = M, .N = K,
+        .A = (const char *)A, .lda = lda,
+        .x = (const char *)x, .y = (char *)y,
+        .accumulate = accumulate,
+        .size = sizeof(float),
+        .dot = gemv_impls[gemv_isa()].dot[1],
+    };
+
+    gemv_run(&g);
+}
+
+/*
+ *  mm_gemv_t_f32 - mm_gemv_t on float, summed in float
+ */
+void
+mm_gemv_t_f32(uint32_t M, uint32_t N, const float *A, uint64_t lda,
+              const float *x, float *y, int accumulate)
+{
+    struct gemv g = {
+        .M = M, .N = N,
+        .A = (const char *)A, .lda = lda,
+        .x = (const char *)x, .y = (char *)y,
+        .accumulate = accumulate,
+        .size = sizeof(float),
+        .axpy = gemv_impls[gemv_isa()].axpy[1],
+    };
+
+    gemv_t_run(&g);
+}
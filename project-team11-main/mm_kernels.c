@@ -0,0 +1,354 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, calloc, free, atoi     */
+#include <string.h>     /* memset, strcmp                 */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+
+#include "matmul.h"
+
+static uint32_t block_size = MM_DEFAULT_BLOCK;
+
+/*
+ *  mm_set_block_size - block size used by mm_block / mm_naive_block
+ *      @b: block size (0 restores the default)
+ */
+void
+mm_set_block_size(uint32_t b)
+{
+    block_size = b ? b : MM_DEFAULT_BLOCK;
+}
+
+uint32_t
+mm_get_block_size(void)
+{
+    return block_size;
+}
+
+/*
+ *  block matrix multiplication
+ *      @ii: block row index
+ *      @jj: block col index
+ *      @kk: block depth index
+ *      @b: block size
+ *      @N: number of rows and cols
+ *      @m1: pointer to matrix 1
+ *      @m2: pointer to matrix 2
+ *      @rBlk: resultant matrix
+ */
+void
+blk_mat_mul(uint32_t ii, uint32_t jj, uint32_t kk, int b, uint32_t N,
+            const int64_t *m1, const int64_t *m2, int64_t *rBlk)
+{
+    uint32_t min_i = min(((ii+1)*b), N);
+    uint32_t min_j = min(((jj+1)*b), N);
+    uint32_t min_k = min(((kk+1)*b), N);
+    for (uint32_t k=kk*b; k<min_k; k++)
+        for (uint32_t i=ii*b; i<min_i; i++)         /* line   */
+            for (uint32_t j=jj*b; j<min_j; j++)     /* column */
+                rBlk[i*N + j] += m1[i*N + k] * m2[k*N + j];
+}
+
+void
+naive_blk_mat_mul(uint32_t ii, uint32_t jj, uint32_t kk, int b, uint32_t N,
+                  const int64_t *m1, const int64_t *m2, int64_t *rBlk)
+{
+    uint32_t min_i = min(((ii+1)*b), N);
+    uint32_t min_j = min(((jj+1)*b), N);
+    uint32_t min_k = min(((kk+1)*b), N);
+    for (uint32_t i=ii*b; i<min_i; i++)         /* line   */
+        for (uint32_t j=jj*b; j<min_j; j++)     /* column */
+            for (uint32_t k=kk*b; k<min_k; k++)
+                rBlk[i*N + j] += m1[i*N + k] * m2[k*N + j];
+}
+
+/*
+ *  mm_gemm_naive - ijk order, strided walk over B
+ */
+void
+mm_gemm_naive(uint32_t M, uint32_t N, uint32_t K,
+              const int64_t *A, uint64_t lda,
+              const int64_t *B, uint64_t ldb,
+              int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (!accumulate)
+        mm_clear(M, N, C, ldc);
+    for (uint32_t i=0; i<M; ++i)             /* line   */
+        for (uint32_t j=0; j<N; ++j)         /* column */
+            for (uint32_t k=0; k<K; ++k)
+                C[i*ldc + j] += A[i*lda + k] * B[k*ldb + j];
+}
+
+/*
+ *  mm_gemm_faster - kij order, unit stride over B and C
+ */
+void
+mm_gemm_faster(uint32_t M, uint32_t N, uint32_t K,
+               const int64_t *A, uint64_t lda,
+               const int64_t *B, uint64_t ldb,
+               int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (!accumulate)
+        mm_clear(M, N, C, ldc);
+    for (uint32_t k=0; k<K; ++k)
+        for (uint32_t i=0; i<M; ++i)         /* line   */
+            for (uint32_t j=0; j<N; ++j)     /* column */
+                C[i*ldc + j] += A[i*lda + k] * B[k*ldb + j];
+}
+
+/*
+ *  block_tile - one mt x nt x kt block, kij inside; with constant bounds
+ *               every loop has a known trip count
+ */
+static inline __attribute__((always_inline)) void
+block_tile(uint32_t mt, uint32_t nt, uint32_t kt,
+           const int64_t *restrict A, uint64_t lda,
+           const int64_t *restrict B, uint64_t ldb,
+           int64_t *restrict C, uint64_t ldc)
+{
+    for (uint32_t k=0; k<kt; k++)
+        for (uint32_t i=0; i<mt; i++)           /* line   */
+            #pragma GCC unroll 8
+            for (uint32_t j=0; j<nt; j++)       /* column */
+                C[i*ldc + j] += A[i*lda + k] * B[k*ldb + j];
+}
+
+/* as block_tile, ijk inside */
+static inline __attribute__((always_inline)) void
+naive_block_tile(uint32_t mt, uint32_t nt, uint32_t kt,
+                 const int64_t *restrict A, uint64_t lda,
+                 const int64_t *restrict B, uint64_t ldb,
+                 int64_t *restrict C, uint64_t ldc)
+{
+    for (uint32_t i=0; i<mt; i++)               /* line   */
+        for (uint32_t j=0; j<nt; j++)           /* column */
+            for (uint32_t k=0; k<kt; k++)
+                C[i*ldc + j] += A[i*lda + k] * B[k*ldb + j];
+}
+
+/*
+ *  DEFINE_BLOCKED - loop over b x b x b blocks of C (+)= A * B calling
+ *                   @tile; full blocks get the constant @b, edge blocks
+ *                   their clipped size. @b = 0 builds the runtime-size one.
+ *      @attr: target attribute, empty for the baseline build
+ */
+#define DEFINE_BLOCKED(name, tile, b, attr)                                     \
+attr static void                                                                \
+name(uint32_t M, uint32_t N, uint32_t K,                                        \
+     const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,            \
+     int64_t *C, uint64_t ldc, uint32_t bs)                                     \
+{                                                                               \
+    if (b)                                                                      \
+        bs = b;                                                                 \
+    for (uint32_t ii=0; ii<M; ii+=bs)                                           \
+        for (uint32_t jj=0; jj<N; jj+=bs)                                       \
+            for (uint32_t kk=0; kk<K; kk+=bs) {                                 \
+                const int64_t *a = &A[ii*lda + kk];                             \
+                const int64_t *bk = &B[kk*ldb + jj];                            \
+                int64_t *c = &C[ii*ldc + jj];                                   \
+                if (b && ii+bs <= M && jj+bs <= N && kk+bs <= K)                \
+                    tile(bs, bs, bs, a, lda, bk, ldb, c, ldc);                  \
+                else                                                            \
+                    tile(min(bs, M-ii), min(bs, N-jj), min(bs, K-kk),           \
+                         a, lda, bk, ldb, c, ldc);                              \
+            }                                                                   \
+}
+
+typedef void (*blocked_fn)(uint32_t M, uint32_t N, uint32_t K,
+                           const int64_t *A, uint64_t lda,
+                           const int64_t *B, uint64_t ldb,
+                           int64_t *C, uint64_t ldc, uint32_t bs);
+
+DEFINE_BLOCKED(block_any, block_tile, 0, )
+DEFINE_BLOCKED(naive_block_any, naive_block_tile, 0, )
+
+/*
+ *  Block sizes with builds of their own, one per ISA of mm_simd.c: with
+ *  the trip counts known the inner loops vectorize with no remainder.
+ */
+#define BLOCK_SIZES(X) X(8) X(16) X(32) X(64)
+
+#define DEFINE_BLOCK_ISA(b, isa, attr)                                          \
+    DEFINE_BLOCKED(block_##b##_##isa, block_tile, b, attr)                      \
+    DEFINE_BLOCKED(naive_block_##b##_##isa, naive_block_tile, b, attr)
+
+#define DEFINE_BLOCK_SIZE(b)                                                    \
+    DEFINE_BLOCK_ISA(b, scalar, )                                               \
+    DEFINE_BLOCK_ISA(b, avx2, __attribute__((target("avx2"))))                  \
+    DEFINE_BLOCK_ISA(b, avx512, __attribute__((target("avx512f"))))             \
+    DEFINE_BLOCK_ISA(b, avx512dq, __attribute__((target("avx512f,avx512dq"))))
+BLOCK_SIZES(DEFINE_BLOCK_SIZE)
+
+/* ISA names of mm_simd.c, in the column order of blocked[] */
+static const char *const block_isas[] = { "scalar", "avx2", "avx512", "avx512dq" };
+
+#define N_BLOCK_ISAS (sizeof(block_isas) / sizeof(block_isas[0]))
+
+#define BLOCK_ENTRY(b)                                                          \
+    { b, { block_##b##_scalar, block_##b##_avx2, block_##b##_avx512,            \
+           block_##b##_avx512dq },                                              \
+         { naive_block_##b##_scalar, naive_block_##b##_avx2,                    \
+           naive_block_##b##_avx512, naive_block_##b##_avx512dq } },
+static const struct {
+    uint32_t   b;
+    blocked_fn block[N_BLOCK_ISAS];
+    blocked_fn naive_block[N_BLOCK_ISAS];
+} blocked[] = {
+    BLOCK_SIZES(BLOCK_ENTRY)
+};
+
+/* column of blocked[] for the ISA mm_simd.c picked, set once when needed */
+static int block_isa;
+static pthread_once_t block_once = PTHREAD_ONCE_INIT;
+
+static void
+init_block_isa(void)
+{
+    const char *isa = mm_simd_name();
+
+    for (uint32_t i=0; i<N_BLOCK_ISAS; i++)
+        if (!strcmp(isa, block_isas[i]))
+            block_isa = i;
+}
+
+/*
+ *  blocked_for - build of the kij (@naive 0) or ijk (@naive 1) block
+ *                kernel for block size @b on this CPU
+ */
+static blocked_fn
+blocked_for(uint32_t b, int naive)
+{
+    pthread_once(&block_once, init_block_isa);
+
+    for (uint32_t i=0; i<sizeof(blocked)/sizeof(blocked[0]); i++)
+        if (blocked[i].b == b)
+            return naive ? blocked[i].naive_block[block_isa] :
+                           blocked[i].block[block_isa];
+    return naive ? naive_block_any : block_any;
+}
+
+/*
+ *  mm_gemm_block - b x b x b blocks, kij inside each; edge blocks are
+ *                  clipped to the matrix. Block sizes 8, 16, 32 and 64
+ *                  run a build with b fixed at compile time.
+ */
+void
+mm_gemm_block(uint32_t M, uint32_t N, uint32_t K,
+              const int64_t *A, uint64_t lda,
+              const int64_t *B, uint64_t ldb,
+              int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (!accumulate)
+        mm_clear(M, N, C, ldc);
+    blocked_for(block_size, 0)(M, N, K, A, lda, B, ldb, C, ldc, block_size);
+}
+
+/*
+ *  mm_gemm_naive_block - as mm_gemm_block, ijk inside each block
+ */
+void
+mm_gemm_naive_block(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (!accumulate)
+        mm_clear(M, N, C, ldc);
+    blocked_for(block_size, 1)(M, N, K, A, lda, B, ldb, C, ldc, block_size);
+}
+
+/*
+ *  mm_gemm_transposed - transpose B first so the inner loop is a dot product
+ */
+void
+mm_gemm_transposed(uint32_t M, uint32_t N, uint32_t K,
+                   const int64_t *A, uint64_t lda,
+                   const int64_t *B, uint64_t ldb,
+                   int64_t *C, uint64_t ldc, int accumulate)
+{
+    int64_t *Bt = mm_alloc((uint64_t)N * K * sizeof(int64_t));
+
+    for (uint32_t k=0; k<K; k++)
+        for (uint32_t j=0; j<N; j++)
+            Bt[(uint64_t)j*K + k] = B[k*ldb + j];
+
+    for (uint32_t i=0; i<M; i++)         /* line   */
+        for (uint32_t j=0; j<N; j++) {   /* column */
+            int64_t acc = accumulate ? C[i*ldc + j] : 0;
+            for (uint32_t k=0; k<K; k++)
+                acc += A[i*lda + k] * Bt[(uint64_t)j*K + k];
+            C[i*ldc + j] = acc;
+        }
+
+    mm_free(Bt);
+}
+
+/*
+ *  mm_gemm_unroll - ijk order with the k loop unrolled by 8, plain loop for
+ *                   the K % 8 tail
+ */
+void
+mm_gemm_unroll(uint32_t M, uint32_t N, uint32_t K,
+               const int64_t *A, uint64_t lda,
+               const int64_t *B, uint64_t ldb,
+               int64_t *C, uint64_t ldc, int accumulate)
+{
+    uint32_t K8 = K & ~7u;
+
+    if (!accumulate)
+        mm_clear(M, N, C, ldc);
+    for (uint32_t i=0; i<M; ++i) {
+        const int64_t *a = &A[i*lda];
+        for (uint32_t j=0; j<N; ++j) {
+            int64_t *c = &C[i*ldc + j];
+            uint32_t k = 0;
+            for (; k<K8; k+=8) {
+                *c += a[k]   * B[k*ldb + j];
+                *c += a[k+1] * B[(k+1)*ldb + j];
+                *c += a[k+2] * B[(k+2)*ldb + j];
+                *c += a[k+3] * B[(k+3)*ldb + j];
+                *c += a[k+4] * B[(k+4)*ldb + j];
+                *c += a[k+5] * B[(k+5)*ldb + j];
+                *c += a[k+6] * B[(k+6)*ldb + j];
+                *c += a[k+7] * B[(k+7)*ldb + j];
+            }
+            for (; k<K; k++)
+                *c += a[k] * B[k*ldb + j];
+        }
+    }
+}
+
+void
+mm_naive(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_naive(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+void
+mm_faster(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_faster(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+void
+mm_block(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_block(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+void
+mm_naive_block(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_naive_block(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+void
+mm_transposed(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_transposed(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+void
+mm_unroll(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_unroll(N, N, N, m1, N, m2, N, r, N, 0);
+}
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* FILE, fopen, snprintf          */
+#include <stdlib.h>     /* malloc, realloc, strtoul       */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+#include <unistd.h>     /* sysconf, syscall               */
+#include <sys/mman.h>   /* mmap, munmap, madvise          */
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "matmul.h"
+
+/*
+ *  NUMA topology and placement. Nodes and their CPUs come from sysfs,
+ *  memory is placed with raw mbind(2) and move_pages(2), so there is no
+ *  libnuma dependency.
+ *  A host without /sys/devices/system/node is one node holding every CPU.
+ */
+
+struct numa_node {
+    int id;             /* sysfs / mbind node number */
+    uint32_t ncpus;
+    int *cpus;
+};
+
+static struct numa_node nodes[MM_NUMA_MAX_NODES];
+static uint32_t nnodes;
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+/*
+ *  parse_cpulist - "0-3,8-11" into @node
+ */
+static void
+parse_cpulist(const char *s, struct numa_node *node)
+{
+    uint32_t cap = 16;
+
+    node->cpus = malloc(cap * sizeof(int));
+    node->ncpus = 0;
+    while (*s && *s != '\n') {
+        char *end;
+        unsigned long lo = strtoul(s, &end, 10);
+        unsigned long hi = lo;
+
+        if (end == s)
+            break;
+        if (*end == '-')
+            hi = strtoul(end+1, &end, 10);
+        for (unsigned long c=lo; c<=hi; c++) {
+            if (node->ncpus == cap) {
+                cap *= 2;
+                node->cpus = realloc(node->cpus, cap * sizeof(int));
+            }
+            node->cpus[node->ncpus++] = c;
+        }
+        s = *end == ',' ? end+1 : end;
+    }
+}
+
+static void
+read_topology(void)
+{
+    char path[64], buf[4096];
+
+    for (uint32_t n=0; n<MM_NUMA_MAX_NODES; n++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", n);
+        FILE *f = fopen(path, "r");
+        if (!f)
+            continue;
+        if (fgets(buf, sizeof(buf), f)) {
+            parse_cpulist(buf, &nodes[nnodes]);
+            nodes[nnodes].id = n;
+            /* memory-only nodes cannot run workers */
+            if (nodes[nnodes].ncpus)
+                nnodes++;
+            else
+                free(nodes[nnodes].cpus);
+        }
+        fclose(f);
+    }
+
+    if (nnodes == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nodes[0].id = 0;
+        nodes[0].ncpus = ncpu;
+        nodes[0].cpus = malloc(ncpu * sizeof(int));
+        for (long c=0; c<ncpu; c++)
+            nodes[0].cpus[c] = c;
+        nnodes = 1;
+    }
+}
+
+/*
+ *  mm_numa_nodes - number of nodes that have CPUs
+ */
+uint32_t
+mm_numa_nodes(void)
+{
+    pthread_once(&topo_once, read_topology);
+    return nnodes;
+}
+
+/*
+ *  mm_numa_worker_node - node of worker @i out of @nthreads
+ *
+ *  Workers are dealt to nodes in contiguous runs, as evenly as possible;
+ *  with fewer workers than nodes only the first @nthreads nodes are used.
+ */
+uint32_t
+mm_numa_worker_node(uint32_t i, uint32_t nthreads)
+{
+    uint32_t used = min(mm_numa_nodes(), nthreads);
+
+    return (uint64_t)i * used / nthreads;
+}
+
+/*
+ *  mm_numa_node_first - first worker of @node out of @nthreads
+ */
+uint32_t
+mm_numa_node_first(uint32_t node, uint32_t nthreads)
+{
+    uint32_t used = min(mm_numa_nodes(), nthreads);
+
+    return ((uint64_t)node * nthreads + used - 1) / used;
+}
+
+/*
+ *  mm_numa_worker_cpu - CPU to pin worker @i out of @nthreads to: the next
+ *                       CPU of its node, wrapping when the node is full
+ */
+int
+mm_numa_worker_cpu(uint32_t i, uint32_t nthreads)
+{
+    uint32_t node = mm_numa_worker_node(i, nthreads);
+    uint32_t local = i - mm_numa_node_first(node, nthreads);
+
+    return nodes[node].cpus[(local + THREAD_AFFINITY_CORE_OFFSET) % nodes[node].ncpus];
+}
+
+/*
+ *  mm_numa_alloc - page-aligned zero-fill-on-demand memory
+ *      @bytes: size
+ *      @node: node index the pages must come from, < 0 for the default
+ *             policy
+ *      @return: the memory, NULL on failure; release with mm_numa_free
+ */
+void *
+mm_numa_alloc(uint64_t bytes, int node)
+{
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED)
+        return NULL;
+    if (node >= 0 && mm_numa_nodes() > 1) {
+        unsigned long mask = 1ul << nodes[node].id;
+        /* if the kernel refuses, first touch from the node still places it */
+        syscall(SYS_mbind, p, bytes, MPOL_BIND, &mask, sizeof(mask) * 8, 0);
+    }
+    if (mm_alloc_get_pages() >= MM_PAGES_THP)
+        madvise(p, bytes, MADV_HUGEPAGE);
+    return p;
+}
+
+void
+mm_numa_free(void *p, uint64_t bytes)
+{
+    if (p)
+        munmap(p, bytes);
+}
+
+/* pages per move_pages(2) call */
+#define MOVE_BATCH 512
+
+/*
+ *  mm_numa_move - migrate the faulted-in whole pages inside [@p, @p+@bytes)
+ *                 to node index @node with move_pages(2), which moves the
+ *                 pages without touching the memory policy of the range
+ *      @return: 0, -1 if the kernel refused (memory left where it was)
+ */
+int
+mm_numa_move(const void *p, uint64_t bytes, int node)
+{
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t lo = ((uintptr_t)p + page - 1) & ~(page - 1);
+    uintptr_t hi = ((uintptr_t)p + bytes) & ~(page - 1);
+    void *pages[MOVE_BATCH];
+    int to[MOVE_BATCH], status[MOVE_BATCH];
+    int ret = 0;
+
+    if (mm_numa_nodes() <= 1 || hi <= lo)
+        return 0;
+
+    for (uint32_t i=0; i<MOVE_BATCH; i++)
+        to[i] = nodes[node].id;
+    while (lo < hi) {
+        uint32_t n = 0;
+        for (; n<MOVE_BATCH && lo<hi; n++, lo+=page)
+            pages[n] = (void *)lo;
+        if (syscall(SYS_move_pages, 0, n, pages, to, status, MPOL_MF_MOVE) < 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+/*
+ *  mm_numa_node_of - node number (as in sysfs) holding the page at @p,
+ *                    -1 if not faulted in
+ */
+int
+mm_numa_node_of(const void *p)
+{
+    int node = -1;
+
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, p, MPOL_F_NODE | MPOL_F_ADDR))
+        return -1;
+    return node;
+}
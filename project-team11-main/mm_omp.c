@@ -0,0 +1,134 @@
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <omp.h>
+
+#include "matmul.h"
+
+/*
+ *  OpenMP kernels without reductions or atomics.
+ *
+ *  mat_mut_openmp2 splits the k loop between threads, so every thread adds
+ *  into all of r and needs its own N x N copy to reduce (threads x 8 N^2
+ *  bytes, on the stack); mat_mut_openmp1 makes each += atomic instead.
+ *  Here the threads split C: the two tile loops are collapsed into one
+ *  iteration space of OMP_TILE x OMP_TILE tiles of C, each tile is written
+ *  by the one thread that runs it and sums over the whole of K itself, so
+ *  threads never write the same element and need no extra memory.
+ *
+ *  The tile loop is schedule(runtime): OMP_SCHEDULE picks static, dynamic
+ *  or guided and the chunk (libgomp's default is dynamic,1). The team is
+ *  proc_bind(spread) over OMP_PLACES, e.g. OMP_PLACES=cores, and unbound if
+ *  no places are set. Threads come from mm_get_num_threads(); called from a
+ *  pool worker the kernels run on that thread alone, as mm_ws_run does.
+ */
+
+#define OMP_TILE   64           /* side of a C tile */
+#define OMP_TILE_K 256          /* depth per pass over a tile, B panel in L2 */
+
+/* one C tile, C (+)= A * B on mt x nt, ijk: a dot product per element */
+static void
+tile_naive(uint32_t mt, uint32_t nt, uint32_t K,
+           const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+           int64_t *C, uint64_t ldc, int accumulate)
+{
+    for (uint32_t i=0; i<mt; i++)
+        for (uint32_t j=0; j<nt; j++) {
+            int64_t sum = accumulate ? C[i*ldc + j] : 0;
+            for (uint32_t k=0; k<K; k++)
+                sum += A[i*lda + k] * B[k*ldb + j];
+            C[i*ldc + j] = sum;
+        }
+}
+
+/* one C tile, kij over OMP_TILE_K slices of K: rows of B and C contiguous */
+static void
+tile_kij(uint32_t mt, uint32_t nt, uint32_t K,
+         const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+         int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (!accumulate)
+        mm_clear(mt, nt, C, ldc);
+    for (uint32_t kk=0; kk<K; kk+=OMP_TILE_K) {
+        uint32_t kend = min(kk + OMP_TILE_K, K);
+        for (uint32_t i=0; i<mt; i++) {
+            int64_t *c = &C[i*ldc];
+            for (uint32_t k=kk; k<kend; k++) {
+                int64_t a = A[i*lda + k];
+                const int64_t *b = &B[k*ldb];
+                for (uint32_t j=0; j<nt; j++)
+                    c[j] += a * b[j];
+            }
+        }
+    }
+}
+
+typedef void (*tile_fn)(uint32_t mt, uint32_t nt, uint32_t K,
+                        const int64_t *A, uint64_t lda,
+                        const int64_t *B, uint64_t ldb,
+                        int64_t *C, uint64_t ldc, int accumulate);
+
+static void
+omp_tiles(tile_fn tile, uint32_t M, uint32_t N, uint32_t K,
+          const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+          int64_t *C, uint64_t ldc, int accumulate)
+{
+    uint32_t mtiles = (M + OMP_TILE - 1) / OMP_TILE;
+    uint32_t ntiles = (N + OMP_TILE - 1) / OMP_TILE;
+    uint32_t nt = mm_pool_current() ? 1 : mm_get_num_threads();
+    struct mm_perf_threads *pt = mm_perf_threads_attached();
+
+    #pragma omp parallel num_threads(nt) if(nt > 1) proc_bind(spread)
+    {
+        if (pt)
+            mm_perf_thread_begin(pt, omp_get_thread_num());
+
+        /* nowait: the counters stop when a thread runs out of tiles */
+        #pragma omp for collapse(2) schedule(runtime) nowait
+        for (uint32_t ti=0; ti<mtiles; ti++)
+            for (uint32_t tj=0; tj<ntiles; tj++) {
+                uint64_t i = (uint64_t)ti * OMP_TILE, j = (uint64_t)tj * OMP_TILE;
+                tile(min((uint32_t)OMP_TILE, M - (uint32_t)i),
+                     min((uint32_t)OMP_TILE, N - (uint32_t)j), K,
+                     &A[i*lda], lda, &B[j], ldb, &C[i*ldc + j], ldc,
+                     accumulate);
+            }
+
+        if (pt)
+            mm_perf_thread_end(pt, omp_get_thread_num());
+    }
+}
+
+/*
+ *  mm_gemm_omp_naive - OpenMP over C tiles, ijk inside each tile
+ */
+void
+mm_gemm_omp_naive(uint32_t M, uint32_t N, uint32_t K,
+                  const int64_t *A, uint64_t lda,
+                  const int64_t *B, uint64_t ldb,
+                  int64_t *C, uint64_t ldc, int accumulate)
+{
+    omp_tiles(tile_naive, M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+}
+
+void
+mm_omp_naive(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_omp_naive(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+/*
+ *  mm_gemm_omp - OpenMP over C tiles, kij inside each tile
+ */
+void
+mm_gemm_omp(uint32_t M, uint32_t N, uint32_t K,
+            const int64_t *A, uint64_t lda,
+            const int64_t *B, uint64_t ldb,
+            int64_t *C, uint64_t ldc, int accumulate)
+{
+    omp_tiles(tile_kij, M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+}
+
+void
+mm_omp(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_omp(N, N, N, m1, N, m2, N, r, N, 0);
+}
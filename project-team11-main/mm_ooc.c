@@ -0,0 +1,320 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* getenv, strtoull               */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <errno.h>      /* errno, EINVAL, ENOMEM          */
+#include <pthread.h>
+#include <unistd.h>     /* sysconf                        */
+
+#include "matmul.h"
+
+/*
+ *  Out-of-core multiplication over tiled matrix files (mm_tfile.c).
+ *
+ *  C is computed one block of bm x bn tiles at a time, held in memory
+ *  while the block's row of A and column of B stream past it one tile
+ *  column / tile row (a step) at a time. Three threads overlap:
+ *      reader:  reads the tiles of the next steps into a ring of
+ *               OOC_SLOTS buffers
+ *      caller:  multiplies each A tile by each B tile of a step into the
+ *               C block with a registry kernel (pt_stride by default)
+ *      writer:  writes the finished C block back while the caller starts
+ *               on the next one in a second C buffer
+ *  The block is as large as the memory budget allows, so A and B are
+ *  read as few times as possible.
+ */
+
+#define OOC_SLOTS 2
+
+struct ooc {
+    const struct mm_tfile *A, *B;
+    struct mm_tfile *C;
+    const struct mm_kernel *k;
+    uint32_t bm, bn;            /* block of C in tiles */
+    uint32_t mblocks, nblocks;
+    uint64_t tile;              /* elements in a tile */
+    uint64_t steps;             /* blocks x K tiles */
+
+    int64_t *slot[OOC_SLOTS];   /* bm A tiles then bn B tiles */
+    int64_t *cbuf[2];           /* bm x bn C tiles */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t filled, consumed;  /* steps read / multiplied */
+    uint64_t handed, written;   /* blocks given to / written by the writer */
+    int err;                    /* errno of a failed read or write */
+
+    struct mm_ooc_stats *st;
+};
+
+/* tile rows and columns of C block @b, edge blocks are smaller */
+static void
+block_dims(const struct ooc *o, uint64_t b, uint32_t *i0, uint32_t *j0,
+           uint32_t *m, uint32_t *n)
+{
+    *i0 = b / o->nblocks * o->bm;
+    *j0 = b % o->nblocks * o->bn;
+    *m = min(o->bm, o->C->trows - *i0);
+    *n = min(o->bn, o->C->tcols - *j0);
+}
+
+/* wait on the condition with the lock held, counting the time if asked */
+static void
+ooc_wait(struct ooc *o, double *waited)
+{
+    double start = waited ? mm_wtime() : 0;
+
+    pthread_cond_wait(&o->cond, &o->lock);
+    if (waited)
+        *waited += mm_wtime() - start;
+}
+
+static void
+ooc_fail(struct ooc *o, int e)
+{
+    pthread_mutex_lock(&o->lock);
+    if (!o->err)
+        o->err = e ? e : EIO;
+    pthread_cond_broadcast(&o->cond);
+    pthread_mutex_unlock(&o->lock);
+}
+
+static void *
+ooc_reader(void *arg)
+{
+    struct ooc *o = arg;
+    uint32_t kt = o->A->tcols;
+
+    for (uint64_t s=0; s<o->steps; s++) {
+        pthread_mutex_lock(&o->lock);
+        while (s - o->consumed >= OOC_SLOTS && !o->err)
+            ooc_wait(o, NULL);
+        int err = o->err;
+        pthread_mutex_unlock(&o->lock);
+        if (err)
+            break;
+
+        uint32_t i0, j0, m, n, k = s % kt;
+        int64_t *p = o->slot[s % OOC_SLOTS];
+        block_dims(o, s / kt, &i0, &j0, &m, &n);
+
+        for (uint32_t a=0; a<m; a++)
+            if (mm_tfile_read(o->A, i0 + a, k, &p[a * o->tile])) {
+                ooc_fail(o, errno);
+                return NULL;
+            }
+        for (uint32_t b=0; b<n; b++)
+            if (mm_tfile_read(o->B, k, j0 + b, &p[(o->bm + b) * o->tile])) {
+                ooc_fail(o, errno);
+                return NULL;
+            }
+
+        pthread_mutex_lock(&o->lock);
+        o->filled = s + 1;
+        o->st->bytes_read += (uint64_t)(m + n) * o->tile * sizeof(int64_t);
+        pthread_cond_broadcast(&o->cond);
+        pthread_mutex_unlock(&o->lock);
+    }
+    return NULL;
+}
+
+static void *
+ooc_writer(void *arg)
+{
+    struct ooc *o = arg;
+    uint64_t blocks = (uint64_t)o->mblocks * o->nblocks;
+
+    for (uint64_t b=0; b<blocks; b++) {
+        pthread_mutex_lock(&o->lock);
+        while (o->handed == b && !o->err)
+            ooc_wait(o, NULL);
+        int err = o->err;
+        pthread_mutex_unlock(&o->lock);
+        if (err)
+            break;
+
+        uint32_t i0, j0, m, n;
+        const int64_t *c = o->cbuf[b % 2];
+        block_dims(o, b, &i0, &j0, &m, &n);
+
+        for (uint32_t i=0; i<m; i++)
+            for (uint32_t j=0; j<n; j++)
+                if (mm_tfile_write(o->C, i0 + i, j0 + j,
+                                   &c[((uint64_t)i * o->bn + j) * o->tile])) {
+                    ooc_fail(o, errno);
+                    return NULL;
+                }
+
+        pthread_mutex_lock(&o->lock);
+        o->written = b + 1;
+        o->st->bytes_written += (uint64_t)m * n * o->tile * sizeof(int64_t);
+        pthread_cond_broadcast(&o->cond);
+        pthread_mutex_unlock(&o->lock);
+    }
+    return NULL;
+}
+
+/*
+ *  ooc_compute - the caller's part: every step of every block
+ *      @return: 0, or the errno of the reader / writer
+ */
+static int
+ooc_compute(struct ooc *o)
+{
+    uint32_t T = o->A->tile, kt = o->A->tcols;
+    uint64_t blocks = (uint64_t)o->mblocks * o->nblocks;
+
+    for (uint64_t b=0; b<blocks; b++) {
+        uint32_t i0, j0, m, n;
+        int64_t *c = o->cbuf[b % 2];
+        block_dims(o, b, &i0, &j0, &m, &n);
+
+        /* the writer must be done with the block before last */
+        pthread_mutex_lock(&o->lock);
+        while (o->written + 2 <= b && !o->err)
+            ooc_wait(o, &o->st->wait);
+        pthread_mutex_unlock(&o->lock);
+
+        for (uint32_t k=0; k<kt; k++) {
+            uint64_t s = b * kt + k;
+
+            pthread_mutex_lock(&o->lock);
+            while (o->filled <= s && !o->err)
+                ooc_wait(o, &o->st->wait);
+            int err = o->err;
+            pthread_mutex_unlock(&o->lock);
+            if (err)
+                return err;
+
+            const int64_t *p = o->slot[s % OOC_SLOTS];
+            for (uint32_t i=0; i<m; i++)
+                for (uint32_t j=0; j<n; j++)
+                    o->k->gemm(T, T, T, &p[i * o->tile], T,
+                               &p[(o->bm + j) * o->tile], T,
+                               &c[((uint64_t)i * o->bn + j) * o->tile], T, k > 0);
+
+            pthread_mutex_lock(&o->lock);
+            o->consumed = s + 1;
+            pthread_cond_broadcast(&o->cond);
+            pthread_mutex_unlock(&o->lock);
+        }
+
+        pthread_mutex_lock(&o->lock);
+        o->handed = b + 1;
+        pthread_cond_broadcast(&o->cond);
+        pthread_mutex_unlock(&o->lock);
+    }
+
+    /* and the last one */
+    pthread_mutex_lock(&o->lock);
+    while (o->written < blocks && !o->err)
+        ooc_wait(o, &o->st->wait);
+    int err = o->err;
+    pthread_mutex_unlock(&o->lock);
+    return err;
+}
+
+/*
+ *  mm_ooc_memory - default memory budget of mm_gemm_ooc: MM_OOC_MEM MiB,
+ *                  else a quarter of physical memory
+ */
+uint64_t
+mm_ooc_memory(void)
+{
+    const char *env = getenv("MM_OOC_MEM");
+
+    if (env && *env)
+        return strtoull(env, NULL, 10) << 20;
+    return (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 4;
+}
+
+/*
+ *  mm_gemm_ooc - C = A * B on int64 matrix files of the tiles layout
+ *      @k: kernel for the tile products, NULL for pt_stride
+ *      @mem: memory budget in bytes for tile buffers (0: mm_ooc_memory())
+ *      @st: filled in with I/O volume and time, may be NULL
+ *      @return: 0, -1 with errno set on failure (EINVAL: wrong layout or
+ *               dtype, shapes or tile sizes differ, ENOMEM: @mem holds
+ *               less than one block or the buffers cannot be allocated)
+ */
+int
+mm_gemm_ooc(const struct mm_tfile *A, const struct mm_tfile *B,
+            struct mm_tfile *C, const struct mm_kernel *k, uint64_t mem,
+            struct mm_ooc_stats *st)
+{
+    struct mm_ooc_stats local;
+    struct ooc o = {
+        .A = A, .B = B, .C = C,
+        .k = k ? k : mm_kernel_find("pt_stride"),
+        .tile = (uint64_t)A->tile * A->tile,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+        .st = st ? st : &local,
+    };
+
+    memset(o.st, 0, sizeof(*o.st));
+    if (A->layout != MM_LAYOUT_TILES || A->dtype != MM_DTYPE_I64 ||
+        B->layout != MM_LAYOUT_TILES || B->dtype != MM_DTYPE_I64 ||
+        C->layout != MM_LAYOUT_TILES || C->dtype != MM_DTYPE_I64 ||
+        A->tile != B->tile || A->tile != C->tile || A->cols != B->rows ||
+        C->rows != A->rows || C->cols != B->cols) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* 2 bm bn tiles of C plus OOC_SLOTS (bm + bn) of A and B, bm = bn */
+    uint64_t tiles = (mem ? mem : mm_ooc_memory()) / mm_tfile_tile_bytes(A);
+    uint32_t b = 0;
+    while (2ull * (b+1) * (b+1) + OOC_SLOTS * 2ull * (b+1) <= tiles)
+        b++;
+    if (!b) {
+        errno = ENOMEM;
+        return -1;
+    }
+    /* a block of fewer tile rows than allowed leaves room for more columns */
+    o.bm = min(b, C->trows);
+    o.bn = b;
+    while (2ull * o.bm * (o.bn+1) + OOC_SLOTS * (o.bm + o.bn + 1ull) <= tiles)
+        o.bn++;
+    o.bn = min(o.bn, C->tcols);
+    o.mblocks = (C->trows + o.bm - 1) / o.bm;
+    o.nblocks = (C->tcols + o.bn - 1) / o.bn;
+    o.steps = (uint64_t)o.mblocks * o.nblocks * A->tcols;
+
+    for (uint32_t s=0; s<OOC_SLOTS; s++)
+        o.slot[s] = mm_alloc((o.bm + o.bn) * o.tile * sizeof(int64_t));
+    for (uint32_t s=0; s<2; s++)
+        o.cbuf[s] = mm_alloc((uint64_t)o.bm * o.bn * o.tile * sizeof(int64_t));
+
+    /* the budget can be most of memory: any buffer may fail */
+    int err = 0;
+    for (uint32_t s=0; s<OOC_SLOTS; s++)
+        if (!o.slot[s])
+            err = ENOMEM;
+    for (uint32_t s=0; s<2; s++)
+        if (!o.cbuf[s])
+            err = ENOMEM;
+
+    if (!err) {
+        pthread_t reader, writer;
+        double start = mm_wtime();
+        pthread_create(&reader, NULL, ooc_reader, &o);
+        pthread_create(&writer, NULL, ooc_writer, &o);
+        err = ooc_compute(&o);
+        pthread_join(reader, NULL);
+        pthread_join(writer, NULL);
+        o.st->seconds = mm_wtime() - start;
+        o.st->bm = o.bm;
+        o.st->bn = o.bn;
+    }
+
+    for (uint32_t s=0; s<OOC_SLOTS; s++)
+        mm_free(o.slot[s]);
+    for (uint32_t s=0; s<2; s++)
+        mm_free(o.cbuf[s]);
+    if (err) {
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
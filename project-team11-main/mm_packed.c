@@ -0,0 +1,350 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* getenv                         */
+#include <string.h>     /* memset, strcmp                 */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "matmul.h"
+#include "mm_simd.h"
+
+/*
+ *  GotoBLAS-style three-level blocked GEMM.
+ *
+ *  B is packed into KC x NC panels (NR columns interleaved per k) sized for
+ *  L3, A into MC x KC blocks (MR rows interleaved per k) sized for L2, and
+ *  an MR x NR register micro-kernel walks both packed buffers with unit
+ *  stride, so a KC x NR sliver of B stays in L1 across the whole MC block.
+ *  Edges are zero-padded at pack time; the micro-kernel never sees them.
+ */
+
+#define MR 8
+#define NR 8
+
+/* micro-kernel: c[MR x NR] (+)= a_panel * b_panel over kc */
+typedef void (*ukernel_fn)(uint32_t kc, const int64_t *a, const int64_t *b,
+                           int64_t *c, uint64_t ldc, uint32_t mr, uint32_t nr);
+
+/* set once by init_packed */
+static struct mm_blocking blocking;
+static ukernel_fn ukernel_sel;
+static pthread_once_t packed_once = PTHREAD_ONCE_INIT;
+
+/*
+ *  store_tile - add an MR x NR register tile into c, clipped to mr x nr
+ */
+static inline void
+store_tile(const int64_t *t, int64_t *c, uint64_t ldc, uint32_t mr, uint32_t nr)
+{
+    for (uint32_t i=0; i<mr; i++)
+        for (uint32_t j=0; j<nr; j++)
+            c[i*ldc + j] += t[i*NR + j];
+}
+
+static void
+ukernel_scalar(uint32_t kc, const int64_t *a, const int64_t *b,
+               int64_t *c, uint64_t ldc, uint32_t mr, uint32_t nr)
+{
+    int64_t t[MR*NR] = { 0 };
+
+    for (uint32_t k=0; k<kc; k++)
+        for (uint32_t i=0; i<MR; i++)
+            for (uint32_t j=0; j<NR; j++)
+                t[i*NR + j] += a[k*MR + i] * b[k*NR + j];
+
+    store_tile(t, c, ldc, mr, nr);
+}
+
+/* AVX2: 16 ymm cannot hold 8x8 int64 plus temporaries, so do 4 rows twice */
+__attribute__((target("avx2")))
+static void
+ukernel_avx2(uint32_t kc, const int64_t *a, const int64_t *b,
+             int64_t *c, uint64_t ldc, uint32_t mr, uint32_t nr)
+{
+    int64_t t[MR*NR] __attribute__((aligned(32)));
+
+    for (uint32_t h=0; h<MR; h+=4) {
+        __m256i acc[4][2];
+#pragma GCC unroll 4
+        for (uint32_t i=0; i<4; i++)
+            acc[i][0] = acc[i][1] = _mm256_setzero_si256();
+
+        for (uint32_t k=0; k<kc; k++) {
+            __m256i b0 = _mm256_load_si256((const __m256i *)&b[k*NR]);
+            __m256i b1 = _mm256_load_si256((const __m256i *)&b[k*NR + 4]);
+#pragma GCC unroll 4
+            for (uint32_t i=0; i<4; i++) {
+                __m256i ai = _mm256_set1_epi64x(a[k*MR + h + i]);
+                acc[i][0] = _mm256_add_epi64(acc[i][0], mullo_epi64_avx2(ai, b0));
+                acc[i][1] = _mm256_add_epi64(acc[i][1], mullo_epi64_avx2(ai, b1));
+            }
+        }
+
+#pragma GCC unroll 4
+        for (uint32_t i=0; i<4; i++) {
+            _mm256_store_si256((__m256i *)&t[(h+i)*NR], acc[i][0]);
+            _mm256_store_si256((__m256i *)&t[(h+i)*NR + 4], acc[i][1]);
+        }
+    }
+
+    store_tile(t, c, ldc, mr, nr);
+}
+
+/* AVX-512: one zmm of B per k, MR accumulators; emulated and vpmullq */
+#define DEFINE_UKERNEL_AVX512(name, isa, mul)                                   \
+__attribute__((target(isa)))                                                    \
+static void                                                                     \
+name(uint32_t kc, const int64_t *a, const int64_t *b,                           \
+     int64_t *c, uint64_t ldc, uint32_t mr, uint32_t nr)                        \
+{                                                                               \
+    __m512i acc[MR];                                                            \
+                                                                                \
+    _Pragma("GCC unroll 8")                                                     \
+    for (uint32_t i=0; i<MR; i++)                                               \
+        acc[i] = _mm512_setzero_si512();                                        \
+                                                                                \
+    for (uint32_t k=0; k<kc; k++) {                                             \
+        __m512i bk = _mm512_load_si512(&b[k*NR]);                               \
+        _Pragma("GCC unroll 8")                                                 \
+        for (uint32_t i=0; i<MR; i++)                                           \
+            acc[i] = _mm512_add_epi64(acc[i],                                   \
+                         mul(_mm512_set1_epi64(a[k*MR + i]), bk));              \
+    }                                                                           \
+                                                                                \
+    if (mr == MR && nr == NR) {                                                 \
+        _Pragma("GCC unroll 8")                                                 \
+        for (uint32_t i=0; i<MR; i++) {                                         \
+            int64_t *ci = &c[i*ldc];                                            \
+            _mm512_storeu_si512(ci, _mm512_add_epi64(_mm512_loadu_si512(ci),    \
+                                                     acc[i]));                  \
+        }                                                                       \
+        return;                                                                 \
+    }                                                                           \
+                                                                                \
+    int64_t t[MR*NR] __attribute__((aligned(64)));                              \
+    _Pragma("GCC unroll 8")                                                     \
+    for (uint32_t i=0; i<MR; i++)                                               \
+        _mm512_store_si512(&t[i*NR], acc[i]);                                   \
+    store_tile(t, c, ldc, mr, nr);                                              \
+}
+
+DEFINE_UKERNEL_AVX512(ukernel_avx512, "avx512f", mullo_epi64_avx512)
+DEFINE_UKERNEL_AVX512(ukernel_avx512dq, "avx512f,avx512dq", mullo_epi64_avx512dq)
+
+static const struct {
+    const char *name;
+    ukernel_fn  fn;
+} ukernels[] = {
+    { "scalar",   ukernel_scalar   },
+    { "avx2",     ukernel_avx2     },
+    { "avx512",   ukernel_avx512   },
+    { "avx512dq", ukernel_avx512dq },
+};
+
+/*
+ *  time_ukernel - best of a few runs over one KC-deep panel pair
+ */
+static double
+time_ukernel(ukernel_fn fn)
+{
+    static int64_t a[MR*256] __attribute__((aligned(64)));
+    static int64_t b[NR*256] __attribute__((aligned(64)));
+    int64_t c[MR*NR] = { 0 };
+    double best = 0;
+
+    for (uint32_t i=0; i<MR*256; i++)
+        a[i] = b[i] = i;
+    for (int rep=0; rep<5; rep++) {
+        double t = mm_wtime();
+        fn(256, a, b, c, NR, MR, NR);
+        t = mm_wtime() - t;
+        if (rep == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/*
+ *  select_ukernel - MM_SIMD if set and supported, else the widest ISA.
+ *                   This kernel is multiply-bound, so emulated and native
+ *                   vpmullq are timed rather than assumed.
+ */
+static ukernel_fn
+select_ukernel(void)
+{
+    const char *env = getenv("MM_SIMD");
+    int n = sizeof(ukernels) / sizeof(ukernels[0]);
+
+    if (env)
+        for (int i=0; i<n; i++)
+            if (!strcmp(env, ukernels[i].name) && mm_simd_supports(env))
+                return ukernels[i].fn;
+
+    for (int i=n-1; i>0; i--) {
+        if (!mm_simd_supports(ukernels[i].name))
+            continue;
+        if (!strcmp(ukernels[i].name, "avx512dq") &&
+            time_ukernel(ukernels[i-1].fn) < time_ukernel(ukernels[i].fn))
+            return ukernels[i-1].fn;
+        return ukernels[i].fn;
+    }
+    return ukernel_scalar;
+}
+
+/*
+ *  pack_a - A[mc x kc] -> MR-row slivers, k-major inside each sliver
+ */
+static void
+pack_a(uint32_t mc, uint32_t kc, const int64_t *A, uint64_t lda, int64_t *Ap)
+{
+    for (uint32_t ir=0; ir<mc; ir+=MR) {
+        uint32_t mr = min(MR, mc-ir);
+        for (uint32_t k=0; k<kc; k++) {
+            for (uint32_t i=0; i<mr; i++)
+                Ap[k*MR + i] = A[(ir+i)*lda + k];
+            for (uint32_t i=mr; i<MR; i++)
+                Ap[k*MR + i] = 0;
+        }
+        Ap += (uint64_t)kc * MR;
+    }
+}
+
+/*
+ *  pack_b - B[kc x nc] -> NR-column slivers, k-major inside each sliver
+ */
+static void
+pack_b(uint32_t kc, uint32_t nc, const int64_t *B, uint64_t ldb, int64_t *Bp)
+{
+    for (uint32_t jr=0; jr<nc; jr+=NR) {
+        uint32_t nr = min(NR, nc-jr);
+        for (uint32_t k=0; k<kc; k++) {
+            const int64_t *bk = &B[k*ldb + jr];
+            for (uint32_t j=0; j<nr; j++)
+                Bp[k*NR + j] = bk[j];
+            for (uint32_t j=nr; j<NR; j++)
+                Bp[k*NR + j] = 0;
+        }
+        Bp += (uint64_t)kc * NR;
+    }
+}
+
+static uint32_t
+round_down(uint64_t v, uint32_t m, uint32_t lo, uint32_t hi)
+{
+    v -= v % m;
+    if (v < lo)
+        v = lo;
+    if (v > hi)
+        v = hi;
+    return v;
+}
+
+/*
+ *  init_packed - block sizes and micro-kernel, once: Strassen's products
+ *                and the exact verifier's bands reach the packed kernel
+ *                together on first use
+ *      KC: an MR x KC sliver of A plus a KC x NR sliver of B fill half of L1
+ *      MC: the packed MC x KC block of A fills half of L2
+ *      NC: the packed KC x NC panel of B fills half of L3
+ */
+static void
+init_packed(void)
+{
+    struct mm_cache cache;
+    mm_cache_sizes(&cache);
+
+    blocking.kc = round_down(cache.l1d / 2 / ((MR + NR) * sizeof(int64_t)),
+                             8, 64, 1024);
+    blocking.mc = round_down(cache.l2 / 2 / (blocking.kc * sizeof(int64_t)),
+                             MR, MR, 4096);
+    blocking.nc = round_down(cache.l3 / 2 / (blocking.kc * sizeof(int64_t)),
+                             NR, NR, 8192);
+    ukernel_sel = select_ukernel();
+}
+
+/*
+ *  mm_packed_blocking - MC/KC/NC derived from the cache hierarchy
+ */
+const struct mm_blocking *
+mm_packed_blocking(void)
+{
+    pthread_once(&packed_once, init_packed);
+    return &blocking;
+}
+
+/*
+ *  mm_packed_set_blocking - override the cache-derived block sizes
+ *      (0 keeps the current value)
+ */
+void
+mm_packed_set_blocking(uint32_t mc, uint32_t kc, uint32_t nc)
+{
+    mm_packed_blocking();
+    if (mc)
+        blocking.mc = (mc + MR - 1) / MR * MR;
+    if (kc)
+        blocking.kc = kc;
+    if (nc)
+        blocking.nc = (nc + NR - 1) / NR * NR;
+}
+
+/*
+ *  mm_gemm_packed - C (+)= A * B through packed panels
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @accumulate: add into C instead of overwriting it
+ */
+void
+mm_gemm_packed(uint32_t M, uint32_t N, uint32_t K,
+               const int64_t *A, uint64_t lda,
+               const int64_t *B, uint64_t ldb,
+               int64_t *C, uint64_t ldc, int accumulate)
+{
+    const struct mm_blocking *bl = mm_packed_blocking();
+    ukernel_fn ukernel = ukernel_sel;
+
+    if (!accumulate)
+        mm_clear(M, N, C, ldc);
+    if (!M || !N || !K)
+        return;
+
+    uint32_t mcmax = min(bl->mc, (M + MR - 1) / MR * MR);
+    uint32_t ncmax = min(bl->nc, (N + NR - 1) / NR * NR);
+    uint32_t kcmax = min(bl->kc, K);
+    int64_t *Ap = mm_alloc((uint64_t)mcmax * kcmax * sizeof(int64_t));
+    int64_t *Bp = mm_alloc((uint64_t)kcmax * ncmax * sizeof(int64_t));
+
+    for (uint32_t jc=0; jc<N; jc+=bl->nc) {
+        uint32_t nc = min(bl->nc, N-jc);
+
+        for (uint32_t pc=0; pc<K; pc+=bl->kc) {
+            uint32_t kc = min(bl->kc, K-pc);
+            pack_b(kc, nc, &B[pc*ldb + jc], ldb, Bp);
+
+            for (uint32_t ic=0; ic<M; ic+=bl->mc) {
+                uint32_t mc = min(bl->mc, M-ic);
+                pack_a(mc, kc, &A[ic*lda + pc], lda, Ap);
+
+                for (uint32_t jr=0; jr<nc; jr+=NR) {
+                    for (uint32_t ir=0; ir<mc; ir+=MR) {
+                        ukernel(kc, &Ap[(uint64_t)ir*kc], &Bp[(uint64_t)jr*kc],
+                                &C[(ic+ir)*ldc + jc+jr], ldc,
+                                min(MR, mc-ir), min(NR, nc-jr));
+                    }
+                }
+            }
+        }
+    }
+
+    mm_free(Ap);
+    mm_free(Bp);
+}
+
+/*
+ *  mm_packed - registry entry, square N
+ */
+void
+mm_packed(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_packed(N, N, N, m1, N, m2, N, r, N, 0);
+}
@@ -0,0 +1,532 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* calloc, free, strtoull         */
+#include <string.h>     /* memset, strcmp, strdup         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <stdatomic.h>
+#include <unistd.h>     /* syscall, read, close, sysconf  */
+#include <sys/ioctl.h>
+#include <sys/mman.h>   /* mmap, munmap                   */
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "matmul.h"
+
+/*
+ *  Hardware counters through perf_event_open(2), counting this process in
+ *  user space only so the default perf_event_paranoid level is enough; no
+ *  kernel module has to set CR4.PCE. Events are opened by name and grouped
+ *  so they are scheduled on the PMU together. A group counting only the
+ *  calling thread is read with rdpmc through the event's mmap'd page when
+ *  the kernel allows it, everything else with read(2).
+ */
+
+#define CACHE_EVENT(cache, op, result) \
+        ((cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | \
+         (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+/* L2 demand misses have no generic perf event: raw codes per vendor */
+#define INTEL_L2_RQSTS_MISS 0x3f24
+#define AMD_L2_CACHE_MISS   0x0964
+
+#define DEFAULT_EVENTS \
+        "cycles,instructions,l1d-misses,l2-misses,llc-misses,dtlb-misses"
+#define DEFAULT_THREAD_EVENTS "cycles,instructions,cache-misses"
+
+struct perf_event {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const struct perf_event events[] = {
+    { "cycles",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+    { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { "l1d-loads",    PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, READ, ACCESS) },
+    { "l1d-misses",   PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, READ, MISS) },
+    { "llc-loads",    PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, READ, ACCESS) },
+    { "llc-misses",   PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, READ, MISS) },
+    { "dtlb-loads",   PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, READ, ACCESS) },
+    { "dtlb-misses",  PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, READ, MISS) },
+    { "task-clock",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page-faults",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+#define N_EVENTS (sizeof(events) / sizeof(events[0]))
+
+struct mm_perf {
+    uint32_t n;
+    int leader;
+    char *names;                            /* storage for name[] */
+    const char *name[MM_PERF_MAX_EVENTS];
+    int fd[MM_PERF_MAX_EVENTS];             /* -1: not available */
+    int own[MM_PERF_MAX_EVENTS];            /* leads its own group */
+    struct perf_event_mmap_page *page[MM_PERF_MAX_EVENTS];
+    int64_t base[MM_PERF_MAX_EVENTS];       /* raw counts at start */
+};
+
+/*
+ *  lookup - perf type and config of event @name
+ *      @return: 0, -1 if unknown here
+ */
+static int
+lookup(const char *name, uint32_t *type, uint64_t *config)
+{
+    if (!strncmp(name, "raw:", 4)) {
+        *type = PERF_TYPE_RAW;
+        *config = strtoull(name + 4, NULL, 0);
+        return 0;
+    }
+    if (!strcmp(name, "l2-misses")) {
+        *type = PERF_TYPE_RAW;
+        if (__builtin_cpu_is("intel"))
+            *config = INTEL_L2_RQSTS_MISS;
+        else if (__builtin_cpu_is("amd"))
+            *config = AMD_L2_CACHE_MISS;
+        else
+            return -1;
+        return 0;
+    }
+    for (uint32_t i=0; i<N_EVENTS; i++)
+        if (!strcmp(events[i].name, name)) {
+            *type = events[i].type;
+            *config = events[i].config;
+            return 0;
+        }
+    return -1;
+}
+
+static int
+open_event(uint32_t type, uint64_t config, int group_fd, int flags)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd < 0;
+    attr.inherit = !!(flags & MM_PERF_THREADS);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/*
+ *  mm_perf_open - open one named counter, disabled if it leads a group
+ *      @name: event name, see events[], "l2-misses" or "raw:<config>"
+ *      @group_fd: leader to group with, -1 for a new group
+ *      @flags: MM_PERF_THREADS to also count threads created later
+ *      @return: counter fd, -1 if unknown or not available on this host
+ */
+int
+mm_perf_open(const char *name, int group_fd, int flags)
+{
+    uint32_t type;
+    uint64_t config;
+
+    if (lookup(name, &type, &config))
+        return -1;
+    return open_event(type, config, group_fd, flags);
+}
+
+/*
+ *  mm_perf_read - current count of a single counter
+ *      @return: count, -1 if @fd is not open
+ */
+int64_t
+mm_perf_read(int fd)
+{
+    uint64_t v;
+
+    if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v))
+        return -1;
+    return v;
+}
+
+void
+mm_perf_close(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+/*
+ *  mm_perf_group - open a group of named counters
+ *
+ *  Events the host cannot count stay in the group as not available (read
+ *  as -1), so callers can always print the same columns.
+ *      @list: comma separated event names, NULL for cycles, instructions,
+ *             L1D/L2/LLC misses and dTLB misses (or MM_PERF if set)
+ *      @flags: MM_PERF_THREADS to also count threads created after the
+ *              open (e.g. the worker pool started by the first multiply);
+ *              such groups are read with read(2), not rdpmc
+ *      @return: the group, release with mm_perf_group_close
+ */
+struct mm_perf *
+mm_perf_group(const char *list, int flags)
+{
+    struct mm_perf *g = calloc(1, sizeof(*g));
+    long pagesz = sysconf(_SC_PAGESIZE);
+    char *save = NULL;
+
+    if (!list)
+        list = getenv("MM_PERF") ? getenv("MM_PERF") : DEFAULT_EVENTS;
+    g->names = strdup(list);
+    g->leader = -1;
+
+    for (char *tok = strtok_r(g->names, ",", &save);
+         tok && g->n < MM_PERF_MAX_EVENTS;
+         tok = strtok_r(NULL, ",", &save)) {
+        uint32_t i = g->n++;
+        uint32_t type;
+        uint64_t config;
+
+        g->name[i] = tok;
+        g->fd[i] = -1;
+        if (lookup(tok, &type, &config))
+            continue;
+
+        g->fd[i] = open_event(type, config, g->leader, flags);
+        g->own[i] = g->leader < 0;
+        if (g->fd[i] < 0 && g->leader >= 0) {
+            /* the PMU may not fit it beside the others: count it alone */
+            g->fd[i] = open_event(type, config, -1, flags);
+            g->own[i] = 1;
+        }
+        if (g->fd[i] < 0)
+            continue;
+        if (g->leader < 0)
+            g->leader = g->fd[i];
+
+        if (!(flags & MM_PERF_THREADS)) {
+            void *p = mmap(NULL, pagesz, PROT_READ, MAP_SHARED, g->fd[i], 0);
+            g->page[i] = p == MAP_FAILED ? NULL : p;
+        }
+    }
+    return g;
+}
+
+uint32_t
+mm_perf_group_size(const struct mm_perf *g)
+{
+    return g->n;
+}
+
+const char *
+mm_perf_group_name(const struct mm_perf *g, uint32_t i)
+{
+    return g->name[i];
+}
+
+/*
+ *  read_rdpmc - count of event @i from user space, seqlock protected
+ *      @return: count, -1 if the counter is not on the PMU right now
+ */
+static int64_t
+read_rdpmc(const struct mm_perf *g, uint32_t i)
+{
+    volatile struct perf_event_mmap_page *pc = g->page[i];
+    uint32_t seq, idx;
+    int64_t count;
+
+    do {
+        seq = pc->lock;
+        __sync_synchronize();
+        idx = pc->index;
+        if (!pc->cap_user_rdpmc || !idx)
+            return -1;
+        count = pc->offset;
+
+        uint32_t lo, hi;
+        uint16_t width = pc->pmc_width;
+        __asm__ volatile ("rdpmc" : "=a"(lo), "=d"(hi) : "c"(idx - 1));
+        int64_t pmc = (uint64_t)hi << 32 | lo;
+        /* sign-extend the counter from its hardware width */
+        count += (pmc << (64 - width)) >> (64 - width);
+        __sync_synchronize();
+    } while (pc->lock != seq);
+    return count;
+}
+
+/*
+ *  read_raw - counts since open of every event, -1 where not available
+ */
+static void
+read_raw(const struct mm_perf *g, int64_t *v)
+{
+    for (uint32_t i=0; i<g->n; i++) {
+        v[i] = -1;
+        if (g->fd[i] < 0)
+            continue;
+        if (g->page[i])
+            v[i] = read_rdpmc(g, i);
+        if (v[i] < 0)
+            v[i] = mm_perf_read(g->fd[i]);
+    }
+}
+
+/*
+ *  mm_perf_group_rdpmc - whether reads of @g avoid the read(2) syscall
+ */
+int
+mm_perf_group_rdpmc(const struct mm_perf *g)
+{
+    for (uint32_t i=0; i<g->n; i++)
+        if (g->page[i] && g->page[i]->cap_user_rdpmc)
+            return 1;
+    return 0;
+}
+
+/*
+ *  mm_perf_group_start - enable every counter of @g and take the baseline
+ */
+void
+mm_perf_group_start(struct mm_perf *g)
+{
+    for (uint32_t i=0; i<g->n; i++)
+        if (g->fd[i] >= 0 && g->own[i])
+            ioctl(g->fd[i], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    read_raw(g, g->base);
+}
+
+void
+mm_perf_group_stop(struct mm_perf *g)
+{
+    for (uint32_t i=0; i<g->n; i++)
+        if (g->fd[i] >= 0 && g->own[i])
+            ioctl(g->fd[i], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/*
+ *  mm_perf_group_read - counts since mm_perf_group_start
+ *      @v: one value per event, -1 where not available
+ */
+void
+mm_perf_group_read(const struct mm_perf *g, int64_t *v)
+{
+    read_raw(g, v);
+    for (uint32_t i=0; i<g->n; i++)
+        if (v[i] >= 0 && g->base[i] >= 0)
+            v[i] -= g->base[i];
+}
+
+/*
+ *  mm_perf_group_print - "name: count" per event, "n/a" where not available
+ */
+void
+mm_perf_group_print(const struct mm_perf *g)
+{
+    int64_t v[MM_PERF_MAX_EVENTS];
+
+    mm_perf_group_read(g, v);
+    for (uint32_t i=0; i<g->n; i++)
+        if (v[i] >= 0)
+            printf("%s: %ld\n", g->name[i], v[i]);
+        else
+            printf("%s: n/a\n", g->name[i]);
+}
+
+void
+mm_perf_group_close(struct mm_perf *g)
+{
+    long pagesz = sysconf(_SC_PAGESIZE);
+
+    for (uint32_t i=0; i<g->n; i++) {
+        if (g->page[i])
+            munmap(g->page[i], pagesz);
+        mm_perf_close(g->fd[i]);
+    }
+    free(g->names);
+    free(g);
+}
+
+/*
+ *  Per-thread collection. Every worker opens its own group for itself on
+ *  first use (kept in TLS, read with rdpmc where permitted) and adds the
+ *  counts of each job it runs to its slot, so counts are never mixed
+ *  between threads and no inherited counters are needed.
+ */
+struct mm_perf_threads {
+    uint64_t gen;                   /* TLS groups of older collectors are stale */
+    char *list;
+    uint32_t nslots;
+    uint32_t nevents;
+    char *names;
+    const char *name[MM_PERF_MAX_EVENTS];
+    int64_t *v;                     /* nslots x MM_PERF_MAX_EVENTS, -1: n/a */
+    uint32_t *runs;                 /* jobs per slot */
+};
+
+static _Atomic(struct mm_perf_threads *) attached;
+static _Atomic uint64_t threads_gen;
+
+static __thread struct mm_perf *tls_group;
+static __thread uint64_t tls_gen;
+
+/*
+ *  mm_perf_threads_open - per-thread counters for workers 0..@nslots-1
+ *      @list: as for mm_perf_group, NULL for cycles, instructions and
+ *             cache-misses (or MM_PERF if set)
+ *      @nslots: highest worker id + 1
+ */
+struct mm_perf_threads *
+mm_perf_threads_open(const char *list, uint32_t nslots)
+{
+    struct mm_perf_threads *pt = calloc(1, sizeof(*pt));
+    char *save = NULL;
+
+    if (!list)
+        list = getenv("MM_PERF") ? getenv("MM_PERF") : DEFAULT_THREAD_EVENTS;
+    pt->gen = atomic_fetch_add(&threads_gen, 1) + 1;
+    pt->list = strdup(list);
+    pt->names = strdup(list);
+    pt->nslots = nslots;
+    for (char *tok = strtok_r(pt->names, ",", &save);
+         tok && pt->nevents < MM_PERF_MAX_EVENTS;
+         tok = strtok_r(NULL, ",", &save))
+        pt->name[pt->nevents++] = tok;
+    pt->v = calloc((uint64_t)nslots * MM_PERF_MAX_EVENTS, sizeof(int64_t));
+    pt->runs = calloc(nslots, sizeof(uint32_t));
+    return pt;
+}
+
+void
+mm_perf_threads_close(struct mm_perf_threads *pt)
+{
+    if (atomic_load(&attached) == pt)
+        mm_perf_threads_attach(NULL);
+    free(pt->list);
+    free(pt->names);
+    free(pt->v);
+    free(pt->runs);
+    free(pt);
+}
+
+/*
+ *  mm_perf_threads_attach - make @pt the collector the worker pool feeds
+ *                           (NULL detaches); picked up at each submit
+ */
+void
+mm_perf_threads_attach(struct mm_perf_threads *pt)
+{
+    atomic_store(&attached, pt);
+}
+
+struct mm_perf_threads *
+mm_perf_threads_attached(void)
+{
+    return atomic_load(&attached);
+}
+
+/*
+ *  mm_perf_thread_begin - start counting the calling thread as worker @tid
+ */
+void
+mm_perf_thread_begin(struct mm_perf_threads *pt, uint32_t tid)
+{
+    if (tid >= pt->nslots)
+        return;
+    if (tls_gen != pt->gen) {
+        if (tls_group)
+            mm_perf_group_close(tls_group);
+        tls_group = mm_perf_group(pt->list, 0);
+        tls_gen = pt->gen;
+    }
+    mm_perf_group_start(tls_group);
+}
+
+/*
+ *  mm_perf_thread_end - add the counts since mm_perf_thread_begin to @tid
+ */
+void
+mm_perf_thread_end(struct mm_perf_threads *pt, uint32_t tid)
+{
+    int64_t v[MM_PERF_MAX_EVENTS];
+
+    if (tid >= pt->nslots || tls_gen != pt->gen)
+        return;
+    mm_perf_group_read(tls_group, v);
+
+    int64_t *slot = &pt->v[(uint64_t)tid * MM_PERF_MAX_EVENTS];
+    for (uint32_t e=0; e<pt->nevents; e++)
+        slot[e] = v[e] < 0 || slot[e] < 0 ? -1 : slot[e] + v[e];
+    pt->runs[tid]++;
+}
+
+/*
+ *  mm_perf_threads_reset - zero every slot
+ */
+void
+mm_perf_threads_reset(struct mm_perf_threads *pt)
+{
+    memset(pt->v, 0, (uint64_t)pt->nslots * MM_PERF_MAX_EVENTS * sizeof(int64_t));
+    memset(pt->runs, 0, pt->nslots * sizeof(uint32_t));
+}
+
+/*
+ *  mm_perf_threads_print - one row per worker that ran, then min, max and
+ *                          sum over them and the imbalance max / mean
+ */
+void
+mm_perf_threads_print(const struct mm_perf_threads *pt)
+{
+    uint32_t nran = 0;
+
+    printf("%-8s", "thread");
+    for (uint32_t e=0; e<pt->nevents; e++)
+        printf(" %16s", pt->name[e]);
+    printf("\n");
+
+    for (uint32_t t=0; t<pt->nslots; t++) {
+        if (!pt->runs[t])
+            continue;
+        nran++;
+        printf("%-8u", t);
+        for (uint32_t e=0; e<pt->nevents; e++) {
+            int64_t x = pt->v[(uint64_t)t * MM_PERF_MAX_EVENTS + e];
+            if (x >= 0)
+                printf(" %16ld", x);
+            else
+                printf(" %16s", "n/a");
+        }
+        printf("\n");
+    }
+    if (!nran)
+        return;
+
+    const char *rows[] = { "min", "max", "sum", "imbal" };
+    for (uint32_t r=0; r<4; r++) {
+        printf("%-8s", rows[r]);
+        for (uint32_t e=0; e<pt->nevents; e++) {
+            int64_t lo = INT64_MAX, hi = 0, sum = 0;
+            int na = 0;
+
+            for (uint32_t t=0; t<pt->nslots; t++) {
+                int64_t x = pt->v[(uint64_t)t * MM_PERF_MAX_EVENTS + e];
+                if (!pt->runs[t])
+                    continue;
+                if (x < 0)
+                    na = 1;
+                lo = x < lo ? x : lo;
+                hi = x > hi ? x : hi;
+                sum += x;
+            }
+            if (na)
+                printf(" %16s", "n/a");
+            else if (r == 0)
+                printf(" %16ld", lo);
+            else if (r == 1)
+                printf(" %16ld", hi);
+            else if (r == 2)
+                printf(" %16ld", sum);
+            else
+                printf(" %16.3f", sum ? (double)hi * nran / sum : 0.0);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,276 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, calloc, free           */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <stdatomic.h>
+#include <limits.h>     /* INT_MAX                        */
+#include <pthread.h>
+#include <sched.h>      /* cpu_set_t                      */
+#include <unistd.h>     /* sysconf, syscall               */
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <immintrin.h>  /* _mm_pause                      */
+
+#include "matmul.h"
+
+/*
+ *  Persistent worker pool. Threads are created and pinned once, then
+ *  sleep between jobs. Every wait (new job, job done, barrier) spins for
+ *  a while first, since back-to-back multiplies usually arrive within
+ *  microseconds, and only then parks on a futex. An oversubscribed pool
+ *  (no spare core for the submitting thread) skips the spinning, which
+ *  would only burn the timeslice of the thread being waited for.
+ */
+
+#define SPIN_ITERS 4096
+
+struct mm_pool {
+    uint32_t nthreads;
+    uint32_t spin;          /* pause rounds before sleeping */
+    pthread_t *threads;
+    pthread_mutex_t lock;   /* one job at a time */
+
+    mm_job_fn fn;
+    void *arg;
+    struct mm_perf_threads *perf;   /* per-worker counters of this job */
+    _Atomic int stop;
+
+    _Atomic uint32_t gen __attribute__((aligned(64)));      /* job sequence */
+    _Atomic uint32_t remaining __attribute__((aligned(64))); /* workers busy */
+    _Atomic uint32_t bar_count __attribute__((aligned(64)));
+    _Atomic uint32_t bar_gen;
+
+    struct mm_pool *next;   /* shared pool list */
+};
+
+struct pool_worker {
+    struct mm_pool *pool;
+    uint32_t id;
+};
+
+/* set while a thread runs a pool job, nested calls then run inline */
+static __thread struct mm_pool *current_pool;
+
+static struct mm_pool *shared_pools;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+futex_wait(_Atomic uint32_t *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void
+futex_wake(_Atomic uint32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ *  wait_change - spin, then sleep, until *@addr != @val
+ */
+static uint32_t
+wait_change(_Atomic uint32_t *addr, uint32_t val, uint32_t spin)
+{
+    uint32_t v;
+
+    for (uint32_t i=0; i<spin; i++) {
+        if ((v = atomic_load_explicit(addr, memory_order_acquire)) != val)
+            return v;
+        _mm_pause();
+    }
+    while ((v = atomic_load_explicit(addr, memory_order_acquire)) == val)
+        futex_wait(addr, val);
+    return v;
+}
+
+static void *
+pool_worker_main(void *arg)
+{
+    struct pool_worker *w = arg;
+    struct mm_pool *pool = w->pool;
+    uint32_t id = w->id;
+    uint32_t seen = 0;
+
+    free(w);
+    current_pool = pool;
+
+    for (;;) {
+        seen = wait_change(&pool->gen, seen, pool->spin);
+        if (atomic_load_explicit(&pool->stop, memory_order_acquire))
+            break;
+
+        if (pool->perf)
+            mm_perf_thread_begin(pool->perf, id);
+        pool->fn(pool->arg, id, pool->nthreads);
+        if (pool->perf)
+            mm_perf_thread_end(pool->perf, id);
+
+        if (atomic_fetch_sub_explicit(&pool->remaining, 1, memory_order_acq_rel) == 1)
+            futex_wake(&pool->remaining);
+    }
+    return NULL;
+}
+
+/*
+ *  mm_pool_create - start @nthreads workers
+ *      @nthreads: worker count (0: mm_get_num_threads())
+ *      @pin: pin the workers, node by node (see mm_numa_worker_cpu)
+ */
+struct mm_pool *
+mm_pool_create(uint32_t nthreads, int pin)
+{
+    struct mm_pool *pool = aligned_alloc(64, sizeof(*pool));
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    memset(pool, 0, sizeof(*pool));
+    pool->nthreads = nthreads ? nthreads : mm_get_num_threads();
+    pool->spin = pool->nthreads < ncpu ? SPIN_ITERS : 0;
+    pool->threads = calloc(pool->nthreads, sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+
+    for (uint32_t i=0; i<pool->nthreads; i++) {
+        struct pool_worker *w = malloc(sizeof(*w));
+        w->pool = pool;
+        w->id = i;
+        pthread_create(&pool->threads[i], NULL, pool_worker_main, w);
+
+        if (pin) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(mm_numa_worker_cpu(i, pool->nthreads), &cpuset);
+            pthread_setaffinity_np(pool->threads[i], sizeof(cpu_set_t), &cpuset);
+        }
+    }
+    return pool;
+}
+
+/*
+ *  mm_pool_destroy - stop and join the workers
+ */
+void
+mm_pool_destroy(struct mm_pool *pool)
+{
+    atomic_store_explicit(&pool->stop, 1, memory_order_release);
+    atomic_fetch_add_explicit(&pool->gen, 1, memory_order_release);
+    futex_wake(&pool->gen);
+
+    for (uint32_t i=0; i<pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+uint32_t
+mm_pool_size(const struct mm_pool *pool)
+{
+    return pool->nthreads;
+}
+
+/*
+ *  mm_pool_submit - start @fn(@arg, id, nthreads) on every worker
+ *
+ *  Holds the pool until mm_pool_wait; a second submitter blocks. Called
+ *  from inside a pool job (of any pool), @fn runs inline as a single
+ *  thread, so nested kernels cannot deadlock waiting for busy workers.
+ */
+void
+mm_pool_submit(struct mm_pool *pool, mm_job_fn fn, void *arg)
+{
+    if (current_pool) {
+        fn(arg, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->perf = mm_perf_threads_attached();
+    atomic_store_explicit(&pool->remaining, pool->nthreads, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->gen, 1, memory_order_release);
+    futex_wake(&pool->gen);
+}
+
+/*
+ *  mm_pool_wait - wait for the job started by mm_pool_submit
+ */
+void
+mm_pool_wait(struct mm_pool *pool)
+{
+    uint32_t v;
+
+    if (current_pool)
+        return;
+
+    while ((v = atomic_load_explicit(&pool->remaining, memory_order_acquire)))
+        wait_change(&pool->remaining, v, pool->spin);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ *  mm_pool_run - submit and wait
+ */
+void
+mm_pool_run(struct mm_pool *pool, mm_job_fn fn, void *arg)
+{
+    mm_pool_submit(pool, fn, arg);
+    mm_pool_wait(pool);
+}
+
+/*
+ *  mm_pool_barrier - all workers of the running job meet here
+ *      @nthreads: as passed to the job (1 when running inline)
+ */
+void
+mm_pool_barrier(struct mm_pool *pool, uint32_t nthreads)
+{
+    if (nthreads <= 1)
+        return;
+
+    uint32_t gen = atomic_load_explicit(&pool->bar_gen, memory_order_acquire);
+    if (atomic_fetch_add_explicit(&pool->bar_count, 1, memory_order_acq_rel) == nthreads-1) {
+        atomic_store_explicit(&pool->bar_count, 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pool->bar_gen, 1, memory_order_release);
+        futex_wake(&pool->bar_gen);
+        return;
+    }
+    wait_change(&pool->bar_gen, gen, pool->spin);
+}
+
+/*
+ *  mm_pool_get - shared pinned pool of @nthreads workers, created on first
+ *                use and kept for the life of the process
+ *      @nthreads: worker count (0: mm_get_num_threads())
+ */
+struct mm_pool *
+mm_pool_get(uint32_t nthreads)
+{
+    struct mm_pool *pool;
+
+    if (!nthreads)
+        nthreads = mm_get_num_threads();
+
+    pthread_mutex_lock(&shared_lock);
+    for (pool = shared_pools; pool; pool = pool->next)
+        if (pool->nthreads == nthreads)
+            break;
+    if (!pool) {
+        pool = mm_pool_create(nthreads, THREAD_AFFINITY);
+        pool->next = shared_pools;
+        shared_pools = pool;
+    }
+    pthread_mutex_unlock(&shared_lock);
+    return pool;
+}
+
+/*
+ *  mm_pool_current - pool whose job the calling thread is running, or NULL
+ */
+struct mm_pool *
+mm_pool_current(void)
+{
+    return current_pool;
+}
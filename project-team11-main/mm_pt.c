@@ -0,0 +1,884 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, calloc, free, atoi     */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <stdatomic.h>
+
+#include "matmul.h"
+
+struct targ {
+    uint32_t M, N, K;
+    const int64_t *A;
+    uint64_t lda;
+    const int64_t *B;
+    uint64_t ldb;
+    int64_t *C;
+    uint64_t ldc;
+    int accumulate;
+    const struct mm_epilogue *ep;   /* fused into the write-back, or NULL */
+
+    uint32_t id;
+};
+
+/*
+ *  The pt1, precopy and stride workers each own one tile of the
+ *  BLOCK_RATIO_H x BLOCK_RATIO_W grid over C. They walk it in STRIDE x STRIDE
+ *  sub-tiles, sum each one over the whole of K in a buffer on the stack (it
+ *  stays in L1), and store it into C once. The tile is neither copied out
+ *  of a malloc'd private result nor written twice. Column boundaries
+ *  between threads fall on multiples of LINE_ELEMS, so two threads never
+ *  write the same cache line of a row when C is 64-byte aligned and ldc is
+ *  a multiple of LINE_ELEMS (true for mm_alloc'd N x N matrices with N a
+ *  multiple of 8).
+ */
+#define LINE_ELEMS (MM_LINE / sizeof(int64_t))
+
+/*
+ *  mm_pt_col_split - start of column slice @w of N in the pt grid, rounded
+ *                    to a cache line; slice BLOCK_RATIO_W starts at N
+ *      @line: elements of C per cache line
+ */
+uint32_t
+mm_pt_col_split(uint32_t N, uint32_t w, uint32_t line)
+{
+    uint64_t j = (uint64_t)N * w / BLOCK_RATIO_W;
+
+    if (w == BLOCK_RATIO_W)
+        return N;
+    j = (j + line/2) / line * line;
+    return min(j, (uint64_t)N);
+}
+
+/*
+ *  tile_bounds - rows [i0, i0+bh) and columns [j0, j0+bw) of C owned by
+ *                thread @id of the BLOCK_RATIO_H x BLOCK_RATIO_W grid;
+ *                rows are split evenly up to one row and columns up to a
+ *                cache line, so nothing is dropped when M or N is not a
+ *                multiple of the ratio (a narrow C leaves some threads none)
+ */
+static void
+tile_bounds(const struct targ *t, uint32_t *i0, uint32_t *j0,
+            uint32_t *bh, uint32_t *bw)
+{
+    uint32_t h = t->id / BLOCK_RATIO_W;
+    uint32_t w = t->id % BLOCK_RATIO_W;
+
+    *i0 = (uint64_t)t->M * h / BLOCK_RATIO_H;
+    *j0 = mm_pt_col_split(t->N, w, LINE_ELEMS);
+    *bh = (uint64_t)t->M * (h+1) / BLOCK_RATIO_H - *i0;
+    *bw = mm_pt_col_split(t->N, w+1, LINE_ELEMS) - *j0;
+}
+
+/*
+ *  store_tile - store (or add) an h x w tile of sums into C at (i0, j0), or
+ *               write it through the epilogue
+ *      @r, @ldr: the sums
+ */
+static void
+store_tile(const struct targ *t, uint32_t i0, uint32_t j0,
+           uint32_t h, uint32_t w, const int64_t *r, uint64_t ldr)
+{
+    if (t->ep) {
+        mm_epilogue_tile(t->ep, i0, j0, h, w, r, ldr, t->C, t->ldc);
+        return;
+    }
+    for (uint32_t i=0;i<h;i++) {
+        int64_t *c = &t->C[(i0+i)*t->ldc + j0];
+        for (uint32_t j=0;j<w;j++) {
+            if (t->accumulate)
+                c[j] += r[i*ldr+j];
+            else
+                c[j] = r[i*ldr+j];
+        }
+    }
+}
+
+/*
+ *  worker_rows - N_THREADS horizontal bands, straight ijk (mat_mul_pt_naive)
+ */
+static void *
+worker_rows(void *args)
+{
+    struct targ *tdata = (struct targ *) args;
+
+    uint32_t N = tdata->N;
+    uint32_t K = tdata->K;
+    const int64_t *A = tdata->A;
+    const int64_t *B = tdata->B;
+    int64_t *C = tdata->C;
+    uint64_t lda = tdata->lda, ldb = tdata->ldb, ldc = tdata->ldc;
+
+    uint32_t start = (uint64_t)tdata->M * tdata->id / N_THREADS;
+    uint32_t end = (uint64_t)tdata->M * (tdata->id+1) / N_THREADS;
+
+    /* with an epilogue a row is summed aside and written through it */
+    int64_t *row = tdata->ep ? mm_alloc((uint64_t)N * sizeof(int64_t)) : NULL;
+
+    for (uint32_t i=start;i<end;i++) {
+        for (uint32_t j=0;j<N;j++) {
+            int64_t acc = tdata->accumulate && !row ? C[i*ldc + j] : 0;
+            for (uint32_t k=0;k<K;k++) {
+                acc += A[i*lda + k] * B[k*ldb + j];
+            }
+            if (row)
+                row[j] = acc;
+            else
+                C[i*ldc + j] = acc;
+        }
+        if (row)
+            mm_epilogue_tile(tdata->ep, i, 0, 1, N, row, N, C, ldc);
+    }
+
+    mm_free(row);
+    return NULL;
+}
+
+/*
+ *  worker_pt1 - BLOCK_RATIO_H x BLOCK_RATIO_W tiles read in place (mat_mul_pt)
+ */
+static void *
+worker_pt1(void *args)
+{
+    struct targ *tdata = (struct targ *) args;
+    uint32_t start_i, start_j, block_size_h, block_size_w;
+
+    tile_bounds(tdata, &start_i, &start_j, &block_size_h, &block_size_w);
+    if (!block_size_h || !block_size_w)
+        return NULL;
+
+    uint32_t K = tdata->K;
+    const int64_t *A = tdata->A;
+    const int64_t *B = tdata->B;
+    uint64_t lda = tdata->lda, ldb = tdata->ldb;
+    int64_t r[STRIDE*STRIDE] __attribute__((aligned(64)));
+
+    // Matrix multiplication, one L1 tile at a time, stored once
+    for (uint32_t ii=0;ii<block_size_h;ii+=STRIDE) {
+        for (uint32_t jj=0;jj<block_size_w;jj+=STRIDE) {
+            uint32_t h = min(STRIDE, block_size_h-ii);
+            uint32_t w = min(STRIDE, block_size_w-jj);
+            const int64_t *a = &A[(start_i+ii)*lda];
+            const int64_t *b = &B[start_j+jj];
+
+            for (uint32_t i=0;i<h;i++) {
+                for (uint32_t j=0;j<w;j++) {
+                    int64_t acc = 0;
+                    for (uint32_t k=0;k<K;k++) {
+                        acc += a[i*lda + k] * b[k*ldb + j];
+                    }
+                    r[i*STRIDE + j] = acc;
+                }
+            }
+            store_tile(tdata, start_i+ii, start_j+jj, h, w, r, STRIDE);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ *  precopy - copy out the rows of A and the columns of B a tile needs;
+ *            this also implicitly transposes B
+ */
+static void
+precopy(struct targ *tdata, uint32_t start_i, uint32_t start_j,
+        uint32_t block_size_h, uint32_t block_size_w,
+        int64_t *m1, int64_t *m2)
+{
+    uint32_t K = tdata->K;
+
+    for (uint32_t i=0;i<block_size_h;i++) {
+        for (uint32_t k=0;k<K;k++) {
+            m1[(uint64_t)i*K + k] = tdata->A[(start_i+i)*tdata->lda+k];
+        }
+    }
+
+    for (uint32_t j=0;j<block_size_w;j++) {
+        for (uint32_t k=0;k<K;k++) {
+            m2[(uint64_t)j*K + k] = tdata->B[k*tdata->ldb + (start_j+j)];
+        }
+    }
+}
+
+/*
+ *  worker_precopy - pt1 tiles over private copies of A and B
+ *                   (mat_mul_pt2_precopy)
+ */
+static void *
+worker_precopy(void *args)
+{
+    struct targ *tdata = (struct targ *) args;
+    uint32_t start_i, start_j, block_size_h, block_size_w;
+
+    tile_bounds(tdata, &start_i, &start_j, &block_size_h, &block_size_w);
+    if (!block_size_h || !block_size_w)
+        return NULL;
+
+    uint32_t K = tdata->K;
+    int64_t *m1 = mm_alloc((uint64_t)block_size_h * K * sizeof(int64_t));
+    int64_t *m2 = mm_alloc((uint64_t)block_size_w * K * sizeof(int64_t));
+    int64_t r[STRIDE*STRIDE] __attribute__((aligned(64)));
+
+    precopy(tdata, start_i, start_j, block_size_h, block_size_w, m1, m2);
+
+    // Matrix multiplication, one L1 tile at a time, stored once
+    for (uint32_t ii=0;ii<block_size_h;ii+=STRIDE) {
+        for (uint32_t jj=0;jj<block_size_w;jj+=STRIDE) {
+            uint32_t h = min(STRIDE, block_size_h-ii);
+            uint32_t w = min(STRIDE, block_size_w-jj);
+
+            for (uint32_t i=0;i<h;i++) {
+                const int64_t *a = &m1[(uint64_t)(ii+i)*K];
+                for (uint32_t j=0;j<w;j++) {
+                    const int64_t *b = &m2[(uint64_t)(jj+j)*K];
+                    int64_t acc = 0;
+                    for (uint32_t k=0;k<K;k++) {
+                        acc += a[k] * b[k];
+                    }
+                    r[i*STRIDE + j] = acc;
+                }
+            }
+            store_tile(tdata, start_i+ii, start_j+jj, h, w, r, STRIDE);
+        }
+    }
+
+    mm_free(m1);
+    mm_free(m2);
+    return NULL;
+}
+
+/*
+ *  worker_stride - precopy plus STRIDE x STRIDE tiling (mat_mul_pt3_stride);
+ *                  the last tile row/column is clipped to what is left
+ */
+static void *
+worker_stride(void *args)
+{
+    struct targ *tdata = (struct targ *) args;
+    uint32_t start_i, start_j, block_size_h, block_size_w;
+
+    tile_bounds(tdata, &start_i, &start_j, &block_size_h, &block_size_w);
+    if (!block_size_h || !block_size_w)
+        return NULL;
+
+    uint32_t K = tdata->K;
+    int64_t *m1 = mm_alloc((uint64_t)block_size_h * K * sizeof(int64_t));
+    int64_t *m2 = mm_alloc((uint64_t)block_size_w * K * sizeof(int64_t));
+    int64_t r[STRIDE*STRIDE] __attribute__((aligned(64)));
+
+    precopy(tdata, start_i, start_j, block_size_h, block_size_w, m1, m2);
+
+    // Tiled matrix multiplication. The micro-kernel reduces its vector
+    // accumulators once per call, so it gets STRIDE_K of depth at a time;
+    // each tile is summed over all of K before it is stored.
+    mm_tile_fn tile = mm_tile_dot();
+    for (uint32_t ii=0;ii<block_size_h;ii+=STRIDE) {
+        for (uint32_t jj=0;jj<block_size_w;jj+=STRIDE) {
+            uint32_t h = min(STRIDE, block_size_h-ii);
+            uint32_t w = min(STRIDE, block_size_w-jj);
+
+            mm_clear(h, w, r, STRIDE);
+            for (uint32_t kk=0;kk<K;kk+=STRIDE_K) {
+                tile(h, w, min(STRIDE_K, K-kk),
+                     &m1[(uint64_t)ii*K + kk], K,
+                     &m2[(uint64_t)jj*K + kk], K,
+                     r, STRIDE);
+            }
+            store_tile(tdata, start_i+ii, start_j+jj, h, w, r, STRIDE);
+        }
+    }
+
+    mm_free(m1);
+    mm_free(m2);
+    return NULL;
+}
+
+/*
+ *  Work-stealing variant: C is cut into many small tiles that any worker
+ *  can pick up, so a slow or interrupted core only delays its own tiles.
+ *  Tiles are clipped at the matrix edge, so any shape and thread count work.
+ *
+ *  When C has too few tiles to keep the workers busy but K is deep (e.g.
+ *  64 x 1000000 x 64), K is split too: slice s of K is summed into its own
+ *  copy of C (slice 0 into C itself), so a task is a (slice, tile) pair and
+ *  no two tasks write the same element. The copies are then added up as a
+ *  binary tree, one mm_ws_run per level: at each level the slot s + step is
+ *  added into slot s, in row chunks, for s a multiple of 2 step.
+ */
+#define STEAL_TILE_MAX 128
+#define STEAL_TILE_MIN 32
+#define STEAL_TILES_PER_THREAD 4
+#define TRANSPOSE_BLOCK 64
+#define SPLITK_MIN_DEPTH 2048   /* least K per slice */
+#define SPLITK_MERGE_ROWS 16    /* rows of C per merge task */
+
+struct steal_ctx {
+    uint32_t M, N, K;
+    uint32_t tile;
+    uint32_t ntiles;    /* tiles per row of C */
+    uint32_t nblocks;   /* transpose blocks per row of B */
+    const int64_t *A;
+    uint64_t lda;
+    const int64_t *B;
+    uint64_t ldb;
+    int64_t *Bt;        /* N x K */
+    int64_t *C;
+    uint64_t ldc;
+    int accumulate;
+    mm_tile_fn fn;
+
+    uint32_t slices;    /* of K, 1 unless split */
+    uint32_t kslice;    /* depth of a slice */
+    uint32_t tiles;     /* tiles of C, per slice */
+    int64_t *part;      /* slices - 1 private M x N copies of C */
+    uint32_t step;      /* merge level */
+
+    const struct mm_epilogue *ep;   /* tiles summed aside, written through it */
+};
+
+/*
+ *  steal_tile_size - largest tile that still gives every thread a few tiles
+ */
+static uint32_t
+steal_tile_size(uint32_t M, uint32_t N, uint32_t nthreads)
+{
+    uint32_t tile = STEAL_TILE_MAX;
+
+    while (tile > STEAL_TILE_MIN) {
+        uint64_t n = (uint64_t)((M + tile - 1) / tile) * ((N + tile - 1) / tile);
+        if (n >= (uint64_t)STEAL_TILES_PER_THREAD * nthreads)
+            break;
+        tile /= 2;
+    }
+    return tile;
+}
+
+/*
+ *  transpose_task - one TRANSPOSE_BLOCK square of B into Bt
+ */
+static void
+transpose_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    struct steal_ctx *c = arg;
+    uint32_t K = c->K;
+    uint32_t k0 = (task / c->nblocks) * TRANSPOSE_BLOCK;
+    uint32_t j0 = (task % c->nblocks) * TRANSPOSE_BLOCK;
+    uint32_t k1 = min(k0 + TRANSPOSE_BLOCK, K);
+    uint32_t j1 = min(j0 + TRANSPOSE_BLOCK, c->N);
+
+    (void)ws, (void)worker;
+    for (uint32_t k=k0; k<k1; k++)
+        for (uint32_t j=j0; j<j1; j++)
+            c->Bt[(uint64_t)j*K + k] = c->B[k*c->ldb + j];
+}
+
+/*
+ *  splitk_slices - K slices for a @tiles tile C: enough (slice, tile) tasks
+ *                  for every worker when C alone has too few, each at least
+ *                  SPLITK_MIN_DEPTH deep
+ *      @force: split even if C has tiles enough
+ */
+static uint32_t
+splitk_slices(uint32_t K, uint64_t tiles, uint32_t nthreads, int force)
+{
+    uint64_t want = (uint64_t)STEAL_TILES_PER_THREAD * nthreads;
+
+    if (!tiles || (!force && (nthreads < 2 || tiles >= want)))
+        return 1;
+
+    uint64_t n = (want + tiles - 1) / tiles;
+    if (force)
+        n = max(n, (uint64_t)max(nthreads, 2u));
+    return max(1ull, min(n, (uint64_t)K / SPLITK_MIN_DEPTH));
+}
+
+/* slot @s of the reduction: C, or a private copy with row stride N */
+static int64_t *
+slot(const struct steal_ctx *c, uint32_t s, uint64_t *ld)
+{
+    *ld = s ? c->N : c->ldc;
+    return s ? &c->part[(uint64_t)(s-1) * c->M * c->N] : c->C;
+}
+
+/*
+ *  tile_task - one tile of C over one slice of K, STRIDE_K of depth per
+ *              micro-kernel call
+ */
+static void
+tile_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    struct steal_ctx *c = arg;
+    uint32_t K = c->K;
+    uint32_t s = task / c->tiles;
+    uint32_t i0 = (task % c->tiles / c->ntiles) * c->tile;
+    uint32_t j0 = (task % c->tiles % c->ntiles) * c->tile;
+    uint32_t mt = min(c->tile, c->M - i0);
+    uint32_t nt = min(c->tile, c->N - j0);
+    uint32_t k0 = s * c->kslice, k1 = min(k0 + c->kslice, K);
+    uint64_t ld;
+    int64_t *r = slot(c, s, &ld);
+
+    (void)ws, (void)worker;
+    r += i0*ld + j0;
+    if (c->ep) {
+        ld = nt;
+        r = mm_alloc((uint64_t)mt * nt * sizeof(int64_t));
+    }
+    if (s || !c->accumulate || c->ep)
+        mm_clear(mt, nt, r, ld);
+
+    for (uint32_t kk=k0; kk<k1; kk+=STRIDE_K)
+        c->fn(mt, nt, min(STRIDE_K, k1-kk),
+              &c->A[i0*c->lda + kk], c->lda,
+              &c->Bt[(uint64_t)j0*K + kk], K,
+              r, ld);
+
+    if (c->ep) {
+        mm_epilogue_tile(c->ep, i0, j0, mt, nt, r, ld, c->C, c->ldc);
+        mm_free(r);
+    }
+}
+
+/*
+ *  merge_task - SPLITK_MERGE_ROWS rows of slot s + step added into slot s
+ */
+static void
+merge_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    struct steal_ctx *c = arg;
+    uint32_t chunks = (c->M + SPLITK_MERGE_ROWS - 1) / SPLITK_MERGE_ROWS;
+    uint32_t s = task / chunks * 2 * c->step;
+    uint32_t i0 = task % chunks * SPLITK_MERGE_ROWS;
+    uint32_t i1 = min(i0 + SPLITK_MERGE_ROWS, c->M);
+    uint64_t ldd, lds;
+    int64_t *dst = slot(c, s, &ldd);
+    const int64_t *src = slot(c, s + c->step, &lds);
+
+    (void)ws, (void)worker;
+    for (uint32_t i=i0; i<i1; i++)
+        for (uint32_t j=0; j<c->N; j++)
+            dst[i*ldd + j] += src[i*lds + j];
+}
+
+/*
+ *  steal_gemv - a product with one row or one column of C is a
+ *               matrix-vector product; run it as one (mm_gemv.c), copying a
+ *               strided column of B or C through a contiguous vector
+ */
+static void
+steal_gemv(uint32_t M, uint32_t N, uint32_t K,
+           const int64_t *A, uint64_t lda,
+           const int64_t *B, uint64_t ldb,
+           int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (M == 1) {
+        mm_gemv_t(K, N, B, ldb, A, C, accumulate);
+        return;
+    }
+
+    int64_t *x = ldb == 1 ? (int64_t *)B : mm_alloc((uint64_t)K * sizeof(int64_t));
+    int64_t *y = ldc == 1 ? C : mm_alloc((uint64_t)M * sizeof(int64_t));
+
+    if (x != B)
+        for (uint32_t k=0; k<K; k++)
+            x[k] = B[k*ldb];
+    if (y != C && accumulate)
+        for (uint32_t i=0; i<M; i++)
+            y[i] = C[i*ldc];
+    mm_gemv(M, K, A, lda, x, y, accumulate);
+    if (y != C) {
+        for (uint32_t i=0; i<M; i++)
+            C[i*ldc] = y[i];
+        mm_free(y);
+    }
+    if (x != B)
+        mm_free(x);
+}
+
+/*
+ *  steal_run - pt_steal; with an epilogue K is not split and C is only
+ *              written through it, tile by tile
+ */
+static void
+steal_run(uint32_t M, uint32_t N, uint32_t K,
+          const int64_t *A, uint64_t lda,
+          const int64_t *B, uint64_t ldb,
+          int64_t *C, uint64_t ldc, int accumulate, int force_split,
+          const struct mm_epilogue *ep)
+{
+    if (!M || !N)
+        return;
+    /* an epilogue still runs on the zero sums */
+    if (!K && !ep) {
+        if (!accumulate)
+            mm_clear(M, N, C, ldc);
+        return;
+    }
+    if (!force_split && !ep && (M == 1 || N == 1)) {
+        steal_gemv(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    uint32_t nthreads = mm_get_num_threads();
+    struct steal_ctx c = {
+        .M = M,
+        .N = N,
+        .K = K,
+        .tile = steal_tile_size(M, N, nthreads),
+        .nblocks = (N + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK,
+        .A = A,
+        .lda = lda,
+        .B = B,
+        .ldb = ldb,
+        .Bt = mm_alloc((uint64_t)N * K * sizeof(int64_t)),
+        .C = C,
+        .ldc = ldc,
+        .accumulate = accumulate,
+        .fn = mm_tile_dot(),
+        .ep = ep,
+    };
+    c.ntiles = (N + c.tile - 1) / c.tile;
+    c.tiles = (M + c.tile - 1) / c.tile * c.ntiles;
+
+    /* slices a multiple of STRIDE_K deep, so micro-kernel calls stay whole */
+    c.slices = ep ? 1 : splitk_slices(K, c.tiles, nthreads, force_split);
+    c.kslice = (K + c.slices - 1) / c.slices;
+    c.kslice = max(1u, (c.kslice + STRIDE_K - 1) / STRIDE_K * STRIDE_K);
+    c.slices = max(1u, (K + c.kslice - 1) / c.kslice);
+    if (c.slices > 1)
+        c.part = mm_alloc((uint64_t)(c.slices - 1) * M * N * sizeof(int64_t));
+
+    mm_ws_run(nthreads, transpose_task, &c,
+              (uint64_t)(K + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK * c.nblocks);
+    mm_ws_run(nthreads, tile_task, &c, (uint64_t)c.slices * c.tiles);
+
+    uint32_t chunks = (M + SPLITK_MERGE_ROWS - 1) / SPLITK_MERGE_ROWS;
+    for (c.step=1; c.step<c.slices; c.step*=2) {
+        uint32_t pairs = (c.slices - c.step + 2*c.step - 1) / (2*c.step);
+        mm_ws_run(nthreads, merge_task, &c, (uint64_t)pairs * chunks);
+    }
+
+    mm_free(c.part);
+    mm_free(c.Bt);
+}
+
+/*
+ *  mm_gemm_pt_steal - work-stealing tiles of C, split along K as well when
+ *                     C is too small for the workers; a single row or
+ *                     column of C goes to mm_gemv / mm_gemv_t
+ */
+void
+mm_gemm_pt_steal(uint32_t M, uint32_t N, uint32_t K,
+                 const int64_t *A, uint64_t lda,
+                 const int64_t *B, uint64_t ldb,
+                 int64_t *C, uint64_t ldc, int accumulate)
+{
+    steal_run(M, N, K, A, lda, B, ldb, C, ldc, accumulate, 0, NULL);
+}
+
+/*
+ *  mm_gemm_pt_steal_ep - pt_steal with @ep applied to each tile as it is
+ *                        written
+ */
+void
+mm_gemm_pt_steal_ep(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    int64_t *C, uint64_t ldc, const struct mm_epilogue *ep)
+{
+    steal_run(M, N, K, A, lda, B, ldb, C, ldc, 0, 0, ep);
+}
+
+void
+mm_pt_steal(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_pt_steal(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+/*
+ *  mm_gemm_pt_splitk - pt_steal always split along K, into at least one
+ *                      slice per worker of SPLITK_MIN_DEPTH or more
+ */
+void
+mm_gemm_pt_splitk(uint32_t M, uint32_t N, uint32_t K,
+                  const int64_t *A, uint64_t lda,
+                  const int64_t *B, uint64_t ldb,
+                  int64_t *C, uint64_t ldc, int accumulate)
+{
+    steal_run(M, N, K, A, lda, B, ldb, C, ldc, accumulate, 1, NULL);
+}
+
+void
+mm_pt_splitk(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_pt_splitk(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+/*
+ *  NUMA variant: C is cut into one row band per node, sized by the node's
+ *  share of workers. A node's workers first-touch its band of C and build
+ *  the node's own copy of B transposed, then share the band's tiles via a
+ *  per-node counter; nothing but the caller's B is read across nodes.
+ */
+struct numa_ctx {
+    uint32_t M, N, K;
+    uint32_t nthreads;
+    uint32_t nodes;
+    uint32_t tile;
+    uint32_t ntiles;                        /* tiles per row of C */
+    const int64_t *A;
+    uint64_t lda;
+    const int64_t *B;
+    uint64_t ldb;
+    int64_t *C;
+    uint64_t ldc;
+    int accumulate;
+    mm_tile_fn fn;
+    struct mm_pool *pool;
+    uint32_t band[MM_NUMA_MAX_NODES + 1];   /* first tile row of each node */
+    int64_t *Bt[MM_NUMA_MAX_NODES];         /* N x K */
+    _Atomic uint32_t *next;                 /* per node, own cache line */
+    double *t0, *t1;                        /* per worker */
+    uint64_t *bytes;
+};
+
+static struct mm_numa_stats numa_stats;
+
+/*
+ *  numa_job - one pool worker: local setup, barrier, then band tiles
+ */
+static void
+numa_job(void *arg, uint32_t tid, uint32_t nthreads)
+{
+    struct numa_ctx *c = arg;
+    uint32_t N = c->N;
+    uint32_t K = c->K;
+    uint32_t node = mm_numa_worker_node(tid, nthreads);
+    uint32_t first = mm_numa_node_first(node, nthreads);
+    uint32_t lw = tid - first;
+    uint32_t nw = mm_numa_node_first(node+1, nthreads) - first;
+    uint32_t row0 = min(c->band[node] * c->tile, c->M);
+    uint32_t row1 = min(c->band[node+1] * c->tile, c->M);
+    int64_t *Bt = c->Bt[node];
+    uint64_t bytes = 0;
+
+    c->t0[tid] = mm_wtime();
+
+    /* first touch: this worker's rows of the band and of the Bt copy */
+    uint32_t r0 = row0 + (uint64_t)(row1 - row0) * lw / nw;
+    uint32_t r1 = row0 + (uint64_t)(row1 - row0) * (lw+1) / nw;
+    if (!c->accumulate) {
+        mm_clear(r1 - r0, N, &c->C[r0*c->ldc], c->ldc);
+        bytes += (uint64_t)(r1 - r0) * N * sizeof(int64_t);
+    }
+
+    uint32_t j0 = (uint64_t)N * lw / nw;
+    uint32_t j1 = (uint64_t)N * (lw+1) / nw;
+    for (uint32_t kk=0; kk<K; kk+=TRANSPOSE_BLOCK)
+        for (uint32_t j=j0; j<j1; j++)
+            for (uint32_t k=kk; k<min(kk+TRANSPOSE_BLOCK, K); k++)
+                Bt[(uint64_t)j*K + k] = c->B[k*c->ldb + j];
+    bytes += 2 * (uint64_t)(j1 - j0) * K * sizeof(int64_t);
+
+    mm_pool_barrier(c->pool, nthreads);
+
+    uint32_t ntasks = (c->band[node+1] - c->band[node]) * c->ntiles;
+    for (;;) {
+        uint32_t t = atomic_fetch_add_explicit(&c->next[node * 16], 1,
+                                               memory_order_relaxed);
+        if (t >= ntasks)
+            break;
+
+        uint32_t i0 = (c->band[node] + t / c->ntiles) * c->tile;
+        uint32_t jt = (t % c->ntiles) * c->tile;
+        uint32_t mt = min(c->tile, c->M - i0);
+        uint32_t nt = min(c->tile, N - jt);
+
+        for (uint32_t kk=0; kk<K; kk+=STRIDE_K)
+            c->fn(mt, nt, min(STRIDE_K, K-kk),
+                  &c->A[i0*c->lda + kk], c->lda,
+                  &Bt[(uint64_t)jt*K + kk], K,
+                  &c->C[i0*c->ldc + jt], c->ldc);
+        bytes += ((uint64_t)(mt + nt) * K + 2 * (uint64_t)mt * nt) * sizeof(int64_t);
+    }
+
+    c->bytes[tid] = bytes;
+    c->t1[tid] = mm_wtime();
+}
+
+void
+mm_gemm_pt_numa(uint32_t M, uint32_t N, uint32_t K,
+                const int64_t *A, uint64_t lda,
+                const int64_t *B, uint64_t ldb,
+                int64_t *C, uint64_t ldc, int accumulate)
+{
+    uint32_t nthreads = mm_pool_current() ? 1 : mm_get_num_threads();
+    uint64_t bytes = max((uint64_t)N * K * sizeof(int64_t), (uint64_t)1);
+    struct numa_ctx c = {
+        .M = M,
+        .N = N,
+        .K = K,
+        .nthreads = nthreads,
+        .nodes = min(mm_numa_nodes(), nthreads),
+        .tile = steal_tile_size(M, N, nthreads),
+        .A = A,
+        .lda = lda,
+        .B = B,
+        .ldb = ldb,
+        .C = C,
+        .ldc = ldc,
+        .accumulate = accumulate,
+        .fn = mm_tile_dot(),
+        .pool = mm_pool_get(nthreads),
+    };
+    c.ntiles = (N + c.tile - 1) / c.tile;
+    c.next = aligned_alloc(64, c.nodes * 16 * sizeof(*c.next));
+    c.t0 = calloc(nthreads, sizeof(double));
+    c.t1 = calloc(nthreads, sizeof(double));
+    c.bytes = calloc(nthreads, sizeof(uint64_t));
+
+    uint32_t mtiles = (M + c.tile - 1) / c.tile;
+    const char *move = getenv("MM_NUMA_MOVE");
+    for (uint32_t n=0; n<=c.nodes; n++)
+        c.band[n] = (uint64_t)mtiles * mm_numa_node_first(n, nthreads) / nthreads;
+
+    for (uint32_t n=0; n<c.nodes; n++) {
+        uint32_t row0 = min(c.band[n] * c.tile, M);
+        uint32_t row1 = min(c.band[n+1] * c.tile, M);
+
+        /*
+         * MM_NUMA_MOVE=1: also migrate the pages of the band's A and C the
+         * caller already touched, from the band's first row to the end of
+         * its last one and not into a sub-view's padding past it
+         */
+        if (move && atoi(move) > 0 && row1 > row0) {
+            mm_numa_move(&A[row0*lda],
+                         ((uint64_t)(row1 - row0 - 1) * lda + K) * sizeof(int64_t), n);
+            mm_numa_move(&C[row0*ldc],
+                         ((uint64_t)(row1 - row0 - 1) * ldc + N) * sizeof(int64_t), n);
+        }
+        c.Bt[n] = mm_numa_alloc(bytes, n);
+        atomic_init(&c.next[n * 16], 0);
+    }
+
+    mm_pool_run(c.pool, numa_job, &c);
+
+    memset(&numa_stats, 0, sizeof(numa_stats));
+    numa_stats.nodes = c.nodes;
+    for (uint32_t n=0; n<c.nodes; n++) {
+        uint32_t w0 = mm_numa_node_first(n, nthreads);
+        uint32_t w1 = mm_numa_node_first(n+1, nthreads);
+        double t0 = c.t0[w0], t1 = c.t1[w0];
+
+        for (uint32_t w=w0; w<w1; w++) {
+            t0 = t0 < c.t0[w] ? t0 : c.t0[w];
+            t1 = t1 > c.t1[w] ? t1 : c.t1[w];
+            numa_stats.bytes[n] += c.bytes[w];
+        }
+        numa_stats.threads[n] = w1 - w0;
+        numa_stats.seconds[n] = t1 - t0;
+        mm_numa_free(c.Bt[n], bytes);
+    }
+
+    free(c.next);
+    free(c.t0);
+    free(c.t1);
+    free(c.bytes);
+}
+
+void
+mm_pt_numa(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_pt_numa(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+/*
+ *  mm_numa_stats - per-node traffic and time of the last mm_pt_numa call
+ */
+const struct mm_numa_stats *
+mm_numa_stats(void)
+{
+    return &numa_stats;
+}
+
+struct pt_job {
+    void *(*worker)(void *);
+    struct targ targs[N_THREADS];
+};
+
+static void
+pt_job(void *arg, uint32_t tid, uint32_t nthreads)
+{
+    struct pt_job *job = arg;
+
+    /* normally one slice per pool thread; all of them when run inline */
+    for (uint32_t i=tid; i<N_THREADS; i+=nthreads)
+        job->worker(&job->targs[i]);
+}
+
+/*
+ *  run_threads - run the N_THREADS slices on the shared pinned pool and
+ *                wait for them
+ *      @worker: slice body
+ *      @args: the problem; each slice gets a copy with its own id
+ */
+static void
+run_threads(void *(*worker)(void *), const struct targ *args)
+{
+    struct pt_job job;
+
+    job.worker = worker;
+    for (int i=0;i<N_THREADS;i++) {
+        job.targs[i] = *args;
+        job.targs[i].id = i;
+    }
+
+    mm_pool_run(mm_pool_get(N_THREADS), pt_job, &job);
+}
+
+#define DEFINE_PT_KERNEL(name, worker)                                          \
+void                                                                            \
+mm_gemm_##name(uint32_t M, uint32_t N, uint32_t K,                              \
+               const int64_t *A, uint64_t lda,                                  \
+               const int64_t *B, uint64_t ldb,                                  \
+               int64_t *C, uint64_t ldc, int accumulate)                        \
+{                                                                               \
+    struct targ args = {                                                        \
+        .M = M, .N = N, .K = K,                                                 \
+        .A = A, .lda = lda,                                                     \
+        .B = B, .ldb = ldb,                                                     \
+        .C = C, .ldc = ldc,                                                     \
+        .accumulate = accumulate,                                               \
+    };                                                                          \
+    run_threads(worker, &args);                                                 \
+}                                                                               \
+                                                                                \
+/* the same with @ep fused into the write-back of each tile */                  \
+void                                                                            \
+mm_gemm_##name##_ep(uint32_t M, uint32_t N, uint32_t K,                         \
+                    const int64_t *A, uint64_t lda,                             \
+                    const int64_t *B, uint64_t ldb,                             \
+                    int64_t *C, uint64_t ldc, const struct mm_epilogue *ep)     \
+{                                                                               \
+    struct targ args = {                                                        \
+        .M = M, .N = N, .K = K,                                                 \
+        .A = A, .lda = lda,                                                     \
+        .B = B, .ldb = ldb,                                                     \
+        .C = C, .ldc = ldc,                                                     \
+        .ep = ep,                                                               \
+    };                                                                          \
+    run_threads(worker, &args);                                                 \
+}                                                                               \
+                                                                                \
+void                                                                            \
+mm_##name(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)         \
+{                                                                               \
+    mm_gemm_##name(N, N, N, m1, N, m2, N, r, N, 0);                             \
+}
+
+DEFINE_PT_KERNEL(pt_rows, worker_rows)
+DEFINE_PT_KERNEL(pt1, worker_pt1)
+DEFINE_PT_KERNEL(pt_precopy, worker_precopy)
+DEFINE_PT_KERNEL(pt_stride, worker_stride)
@@ -0,0 +1,343 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, free                   */
+#include <string.h>     /* memcpy, memset                 */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+
+#include "matmul.h"
+
+/*
+ *  Cache-oblivious multiplication: the largest of M, K and N is halved
+ *  until the whole product fits REC_LEAF in every dimension, so at some
+ *  depth the operands fit each cache level, whatever its size, without a
+ *  block size to tune. Leaves of exactly REC_LEAF run the fixed-size kernel
+ *  of mm_batch.c; halves are rounded to multiples of REC_LEAF so that most
+ *  leaves are full.
+ *
+ *  Halving M or N gives two products writing disjoint parts of C, which
+ *  are spawned as work-stealing tasks while the part of C is large. Halving
+ *  K gives two products into the same C, run one after the other; below
+ *  the task cut-off the whole recursion is sequential.
+ *
+ *  The Morton variant first copies A, B and C into REC_LEAF x REC_LEAF
+ *  tiles stored in Z order, so every quadrant at every depth is one
+ *  contiguous run of memory, and recurses on quadrants of that layout.
+ *  The tile grid is padded to a power of two; tiles wholly in the padding
+ *  are never touched. Shapes too far from square to pad cheaply take the
+ *  row-major recursion instead.
+ */
+
+#define REC_LEAF 64
+
+/* parts of C with a side at least this long are split into tasks */
+#define REC_TASK_MIN 256
+
+/* the Morton grid may pad each dimension's tile count up to this factor */
+#define MORTON_MAX_PAD 2
+
+/* round half of @d up to a multiple of REC_LEAF */
+static inline uint32_t
+split_at(uint32_t d)
+{
+    return (d / 2 + REC_LEAF - 1) / REC_LEAF * REC_LEAF;
+}
+
+/*
+ *  rec_seq - C (+)= A * B by sequential recursive halving
+ */
+static void
+rec_seq(uint32_t M, uint32_t N, uint32_t K,
+        const int64_t *A, uint64_t lda,
+        const int64_t *B, uint64_t ldb,
+        int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (M <= REC_LEAF && N <= REC_LEAF && K <= REC_LEAF) {
+        mm_gemm_fixed(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    if (M >= N && M >= K) {
+        uint32_t h = split_at(M);
+        rec_seq(h, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        rec_seq(M - h, N, K, &A[h*lda], lda, B, ldb, &C[h*ldc], ldc, accumulate);
+    } else if (N >= K) {
+        uint32_t h = split_at(N);
+        rec_seq(M, h, K, A, lda, B, ldb, C, ldc, accumulate);
+        rec_seq(M, N - h, K, A, lda, &B[h], ldb, &C[h], ldc, accumulate);
+    } else {
+        uint32_t h = split_at(K);
+        rec_seq(M, N, h, A, lda, B, ldb, C, ldc, accumulate);
+        rec_seq(M, N, K - h, &A[h], lda, &B[h*ldb], ldb, C, ldc, 1);
+    }
+}
+
+/* one product of the task tree; task 0 is the root in the context */
+struct rec_node {
+    uint32_t M, N, K;
+    const int64_t *A, *B;
+    int64_t *C;
+};
+
+struct rec_ctx {
+    struct rec_node root;
+    uint64_t lda, ldb, ldc;
+    int accumulate;
+};
+
+static void
+rec_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct rec_ctx *ctx = arg;
+    struct rec_node n = task ? *(struct rec_node *)task : ctx->root;
+
+    if (task)
+        free((void *)task);
+
+    /* split C in two while it is large: spawn one half, keep the other */
+    while (max(n.M, n.N) >= REC_TASK_MIN) {
+        struct rec_node *half = malloc(sizeof(*half));
+        *half = n;
+        if (n.M >= n.N) {
+            uint32_t h = split_at(n.M);
+            half->M = n.M - h;
+            half->A = &n.A[h*ctx->lda];
+            half->C = &n.C[h*ctx->ldc];
+            n.M = h;
+        } else {
+            uint32_t h = split_at(n.N);
+            half->N = n.N - h;
+            half->B = &n.B[h];
+            half->C = &n.C[h];
+            n.N = h;
+        }
+        mm_ws_spawn(ws, worker, (uintptr_t)half);
+    }
+    rec_seq(n.M, n.N, n.K, n.A, ctx->lda, n.B, ctx->ldb, n.C, ctx->ldc,
+            ctx->accumulate);
+}
+
+/*
+ *  mm_gemm_recursive - C (+)= A * B, cache-oblivious recursive halving on
+ *                      mm_get_num_threads() work-stealing workers
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @accumulate: add into C instead of overwriting it
+ */
+void
+mm_gemm_recursive(uint32_t M, uint32_t N, uint32_t K,
+                  const int64_t *A, uint64_t lda,
+                  const int64_t *B, uint64_t ldb,
+                  int64_t *C, uint64_t ldc, int accumulate)
+{
+    if (!M || !N)
+        return;
+    if (!K) {
+        if (!accumulate)
+            mm_clear(M, N, C, ldc);
+        return;
+    }
+    if (mm_get_num_threads() == 1 || mm_pool_current()) {
+        rec_seq(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    struct rec_ctx ctx = {
+        { M, N, K, A, B, C }, lda, ldb, ldc, accumulate,
+    };
+    mm_ws_run(0, rec_task, &ctx, 1);
+}
+
+void
+mm_recursive(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_recursive(N, N, N, m1, N, m2, N, r, N, 0);
+}
+
+/* tile index of tile row @i, tile column @j: their bits interleaved */
+static uint64_t
+morton(uint32_t i, uint32_t j)
+{
+    uint64_t z = 0;
+
+    for (uint32_t b=0; b<32; b++)
+        z |= (uint64_t)((i >> b) & 1) << (2*b + 1) |
+             (uint64_t)((j >> b) & 1) << (2*b);
+    return z;
+}
+
+#define TILE_ELEMS ((uint64_t)REC_LEAF * REC_LEAF)
+
+/*
+ *  morton_pack - row-major @rows x @cols into Z-order tiles, the part of
+ *                edge tiles past the matrix zeroed
+ */
+static void
+morton_pack(uint32_t rows, uint32_t cols, const int64_t *m, uint64_t ld,
+            int64_t *z)
+{
+    for (uint32_t ti=0; ti*REC_LEAF<rows; ti++)
+        for (uint32_t tj=0; tj*REC_LEAF<cols; tj++) {
+            int64_t *t = &z[morton(ti, tj) * TILE_ELEMS];
+            uint32_t h = min(rows - ti*REC_LEAF, (uint32_t)REC_LEAF);
+            uint32_t w = min(cols - tj*REC_LEAF, (uint32_t)REC_LEAF);
+
+            for (uint32_t i=0; i<h; i++) {
+                memcpy(&t[i*REC_LEAF], &m[(uint64_t)(ti*REC_LEAF + i)*ld + tj*REC_LEAF],
+                       w * sizeof(int64_t));
+                memset(&t[i*REC_LEAF + w], 0, (REC_LEAF - w) * sizeof(int64_t));
+            }
+            memset(&t[h*REC_LEAF], 0, (REC_LEAF - h) * REC_LEAF * sizeof(int64_t));
+        }
+}
+
+/* the inverse of morton_pack, padding dropped */
+static void
+morton_unpack(uint32_t rows, uint32_t cols, const int64_t *z, int64_t *m,
+              uint64_t ld)
+{
+    for (uint32_t ti=0; ti*REC_LEAF<rows; ti++)
+        for (uint32_t tj=0; tj*REC_LEAF<cols; tj++) {
+            const int64_t *t = &z[morton(ti, tj) * TILE_ELEMS];
+            uint32_t h = min(rows - ti*REC_LEAF, (uint32_t)REC_LEAF);
+            uint32_t w = min(cols - tj*REC_LEAF, (uint32_t)REC_LEAF);
+
+            for (uint32_t i=0; i<h; i++)
+                memcpy(&m[(uint64_t)(ti*REC_LEAF + i)*ld + tj*REC_LEAF],
+                       &t[i*REC_LEAF], w * sizeof(int64_t));
+        }
+}
+
+/* tile row and column of Z-order index @z */
+static void
+unmorton(uint64_t z, uint32_t *i, uint32_t *j)
+{
+    *i = *j = 0;
+    for (uint32_t b=0; b<32; b++) {
+        *i |= (uint32_t)((z >> (2*b + 1)) & 1) << b;
+        *j |= (uint32_t)((z >> (2*b)) & 1) << b;
+    }
+}
+
+struct morton_ctx {
+    const int64_t *A, *B;
+    int64_t *C;
+    uint32_t mt, nt, kt;    /* tile counts of the real matrices */
+    uint32_t side;          /* of the padded grid, in tiles */
+    uint32_t task;          /* side of a task's part of C, in tiles */
+    int accumulate;
+};
+
+/* aligned block (@bi, @bj) of side @s tiles: it is s * s consecutive tiles */
+static inline uint64_t
+zblock(uint32_t bi, uint32_t bj, uint32_t s)
+{
+    return morton(bi, bj) * s * s * TILE_ELEMS;
+}
+
+/*
+ *  morton_seq - C (+)= A * B over the side @s blocks of the grid whose top
+ *               left tiles are C (@i, @j), A (@i, @k), B (@k, @j); tiles
+ *               wholly in the padding are skipped
+ */
+static void
+morton_seq(const struct morton_ctx *ctx, const int64_t *A, const int64_t *B,
+           int64_t *C, uint32_t i, uint32_t j, uint32_t k, uint32_t s,
+           int accumulate)
+{
+    if (i >= ctx->mt || j >= ctx->nt || k >= ctx->kt)
+        return;
+    if (s == 1) {
+        mm_gemm_fixed(REC_LEAF, REC_LEAF, REC_LEAF, A, REC_LEAF, B, REC_LEAF,
+                      C, REC_LEAF, accumulate);
+        return;
+    }
+
+    uint32_t h = s / 2;
+    for (uint32_t r=0; r<2; r++)
+        for (uint32_t c=0; c<2; c++)
+            for (uint32_t l=0; l<2; l++)
+                morton_seq(ctx, &A[zblock(r, l, h)], &B[zblock(l, c, h)],
+                           &C[zblock(r, c, h)], i + r*h, j + c*h, k + l*h, h,
+                           l ? 1 : accumulate);
+}
+
+/*
+ *  morton_task - one block of C of side ctx->task tiles, numbered in Z
+ *                order: the sum over its row of A blocks and column of B
+ *                blocks
+ */
+static void
+morton_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct morton_ctx *ctx = arg;
+    uint32_t s = ctx->task, bi, bj;
+
+    (void)ws, (void)worker;
+    unmorton(task, &bi, &bj);
+    for (uint32_t bk=0; bk*s<ctx->side; bk++)
+        morton_seq(ctx, &ctx->A[zblock(bi, bk, s)], &ctx->B[zblock(bk, bj, s)],
+                   &ctx->C[zblock(bi, bj, s)], bi*s, bj*s, bk*s, s,
+                   bk ? 1 : ctx->accumulate);
+}
+
+/*
+ *  mm_gemm_morton - C (+)= A * B, recursive over a Z-order tiled copy of
+ *                   the matrices; far from square shapes fall back to
+ *                   mm_gemm_recursive
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @accumulate: add into C instead of overwriting it
+ */
+void
+mm_gemm_morton(uint32_t M, uint32_t N, uint32_t K,
+               const int64_t *A, uint64_t lda,
+               const int64_t *B, uint64_t ldb,
+               int64_t *C, uint64_t ldc, int accumulate)
+{
+    struct morton_ctx ctx = {
+        .mt = (M + REC_LEAF - 1) / REC_LEAF,
+        .nt = (N + REC_LEAF - 1) / REC_LEAF,
+        .kt = (K + REC_LEAF - 1) / REC_LEAF,
+        .side = 1,
+        .accumulate = accumulate,
+    };
+
+    if (!M || !N || !K) {
+        mm_gemm_recursive(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+    while (ctx.side < max(ctx.mt, max(ctx.nt, ctx.kt)))
+        ctx.side *= 2;
+    if (ctx.side > MORTON_MAX_PAD * min(ctx.mt, min(ctx.nt, ctx.kt))) {
+        mm_gemm_recursive(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    uint64_t bytes = (uint64_t)ctx.side * ctx.side * TILE_ELEMS * sizeof(int64_t);
+    int64_t *za = mm_alloc(bytes), *zb = mm_alloc(bytes), *zc = mm_alloc(bytes);
+
+    morton_pack(M, K, A, lda, za);
+    morton_pack(K, N, B, ldb, zb);
+    if (accumulate)
+        morton_pack(M, N, C, ldc, zc);
+    ctx.A = za;
+    ctx.B = zb;
+    ctx.C = zc;
+
+    /* parts of C about REC_TASK_MIN on a side per task */
+    ctx.task = min(ctx.side, (uint32_t)(REC_TASK_MIN / REC_LEAF));
+    if (mm_get_num_threads() == 1 || mm_pool_current())
+        ctx.task = ctx.side;
+    uint32_t blocks = ctx.side / ctx.task;
+    mm_ws_run(0, morton_task, &ctx, (uint64_t)blocks * blocks);
+
+    morton_unpack(M, N, zc, C, ldc);
+    mm_free(za);
+    mm_free(zb);
+    mm_free(zc);
+}
+
+void
+mm_morton(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_morton(N, N, N, m1, N, m2, N, r, N, 0);
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, calloc, free, atoi     */
+#include <string.h>     /* strcmp                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+
+#include "matmul.h"
+
+/* largest problem timed by mm_kernel_select; bigger N are sampled down */
+#define SELECT_MAX_N 512
+
+static const struct mm_kernel kernels[] = {
+    { "naive",       "ijk triple loop",                      mm_naive,        mm_gemm_naive,        1, 0 },
+    { "faster",      "kij triple loop",                      mm_faster,       mm_gemm_faster,       1, 0 },
+    { "block",       "blk_mat_mul, kij inside each block",   mm_block,        mm_gemm_block,        1, 0 },
+    { "naive_block", "naive_blk_mat_mul, ijk in each block", mm_naive_block,  mm_gemm_naive_block,  1, 0 },
+    { "transposed",  "dot products against m2 transposed",   mm_transposed,   mm_gemm_transposed,   1, 0 },
+    { "packed",      "GotoBLAS packed panels, MC/KC/NC",     mm_packed,       mm_gemm_packed,       1, 0 },
+    { "strassen",    "Strassen-Winograd down to packed",     mm_strassen,     mm_gemm_strassen,     1, MM_THREADS_ANY },
+    { "fixed",       "kij built per N (8..128), else block", mm_fixed,        mm_gemm_fixed,        1, 0 },
+    { "recursive",   "cache-oblivious halving, 64 leaves",   mm_recursive,    mm_gemm_recursive,    1, MM_THREADS_ANY },
+    { "morton",      "recursion over Z-order 64x64 tiles",   mm_morton,       mm_gemm_morton,       1, MM_THREADS_ANY },
+    { "omp_naive",   "OpenMP over C tiles, ijk per tile",    mm_omp_naive,    mm_gemm_omp_naive,    1, MM_THREADS_ANY },
+    { "omp",         "OpenMP over C tiles, kij per tile",    mm_omp,          mm_gemm_omp,          1, MM_THREADS_ANY },
+    { "unroll",      "ijk with k unrolled by 8",             mm_unroll,       mm_gemm_unroll,       1, 0 },
+    { "pt_rows",     "pthreads, one row band per thread",    mm_pt_rows,      mm_gemm_pt_rows,      1, N_THREADS },
+    { "pt1",         "pthreads, 4x2 tiles read in place",    mm_pt1,          mm_gemm_pt1,          1, N_THREADS },
+    { "pt_precopy",  "pthreads, 4x2 tiles over copies",      mm_pt_precopy,   mm_gemm_pt_precopy,   1, N_THREADS },
+    { "pt_stride",   "pthreads, precopy + STRIDE tiling",    mm_pt_stride,    mm_gemm_pt_stride,    1, N_THREADS },
+    { "pt_steal",    "pthreads, work-stealing small tiles",  mm_pt_steal,     mm_gemm_pt_steal,     1, MM_THREADS_ANY },
+    { "pt_splitk",   "pt_steal always split along K",        mm_pt_splitk,    mm_gemm_pt_splitk,    1, MM_THREADS_ANY },
+    { "pt_numa",     "pthreads, node bands, first touch",    mm_pt_numa,      mm_gemm_pt_numa,      1, MM_THREADS_ANY },
+};
+
+#define N_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+/* fastest kernel per power-of-two size class, filled lazily */
+static const struct mm_kernel *selected[33];
+static pthread_mutex_t select_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t
+mm_kernel_count(void)
+{
+    return N_KERNELS;
+}
+
+const struct mm_kernel *
+mm_kernel_at(uint32_t i)
+{
+    return i < N_KERNELS ? &kernels[i] : NULL;
+}
+
+/*
+ *  mm_kernel_find - look a kernel up by name
+ *      @return: the kernel, NULL if unknown
+ */
+const struct mm_kernel *
+mm_kernel_find(const char *name)
+{
+    for (uint32_t i=0; i<N_KERNELS; i++)
+        if (!strcmp(kernels[i].name, name))
+            return &kernels[i];
+    return NULL;
+}
+
+/*
+ *  mm_kernel_supports - whether @k gives a complete result for size @N
+ */
+int
+mm_kernel_supports(const struct mm_kernel *k, uint32_t N)
+{
+    return N > 0 && N % k->align == 0;
+}
+
+/*
+ *  mm_kernel_has_block - whether @k takes a block parameter: the block size
+ *                        of block / naive_block, the crossover of strassen
+ */
+int
+mm_kernel_has_block(const struct mm_kernel *k)
+{
+    return k->fn == mm_block || k->fn == mm_naive_block || k->fn == mm_strassen;
+}
+
+/*
+ *  mm_kernel_get_block - current block parameter of @k, 0 if it has none
+ */
+uint32_t
+mm_kernel_get_block(const struct mm_kernel *k)
+{
+    if (k->fn == mm_strassen)
+        return mm_strassen_crossover();
+    return mm_kernel_has_block(k) ? mm_get_block_size() : 0;
+}
+
+/*
+ *  mm_kernel_set_block - set the block parameter of @k (no-op if none)
+ */
+void
+mm_kernel_set_block(const struct mm_kernel *k, uint32_t b)
+{
+    if (k->fn == mm_strassen)
+        mm_strassen_set_crossover(b);
+    else if (mm_kernel_has_block(k))
+        mm_set_block_size(b);
+}
+
+static uint32_t
+size_class(uint32_t N)
+{
+    return 32 - __builtin_clz(N);
+}
+
+/*
+ *  time_kernel - seconds per multiply-add of @k on a problem near @N
+ */
+static double
+time_kernel(const struct mm_kernel *k, uint32_t N)
+{
+    uint32_t n = min(N, (uint32_t)SELECT_MAX_N);
+
+    n -= n % k->align;
+    if (n == 0)
+        return -1;
+
+    int64_t *m1 = mm_alloc((uint64_t)n * n * sizeof(int64_t));
+    int64_t *m2 = mm_alloc((uint64_t)n * n * sizeof(int64_t));
+    int64_t *r  = mm_alloc((uint64_t)n * n * sizeof(int64_t));
+    init_matrices(n, m1, m2);
+
+    double wc_start = mm_wtime();
+    k->fn(n, m1, m2, r);
+    double wc_end = mm_wtime();
+
+    mm_free(m1);
+    mm_free(m2);
+    mm_free(r);
+    return (wc_end - wc_start) / ((double)n * n * n);
+}
+
+/*
+ *  mm_kernel_select - fastest kernel for size @N on this host
+ *
+ *  Every kernel supporting @N is timed once in-process; the winner is
+ *  cached per power-of-two size class so later calls are free.
+ *      @N: square matrix size
+ *      @return: the kernel, NULL if none supports @N
+ */
+const struct mm_kernel *
+mm_kernel_select(uint32_t N)
+{
+    if (N == 0)
+        return NULL;
+
+    uint32_t c = size_class(N);
+
+    pthread_mutex_lock(&select_lock);
+    const struct mm_kernel *best = selected[c];
+    if (best && mm_kernel_supports(best, N)) {
+        pthread_mutex_unlock(&select_lock);
+        return best;
+    }
+
+    double best_t = 0;
+    best = NULL;
+    for (uint32_t i=0; i<N_KERNELS; i++) {
+        if (!mm_kernel_supports(&kernels[i], N))
+            continue;
+        double t = time_kernel(&kernels[i], N);
+        if (t >= 0 && (!best || t < best_t)) {
+            best = &kernels[i];
+            best_t = t;
+        }
+    }
+    selected[c] = best;
+    pthread_mutex_unlock(&select_lock);
+
+    return best;
+}
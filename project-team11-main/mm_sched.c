@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, calloc, free, getenv   */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <stdatomic.h>
+#include <sched.h>      /* sched_yield                    */
+#include <unistd.h>     /* sysconf                        */
+
+#include "matmul.h"
+
+/*
+ *  Work-stealing scheduler. Every worker owns a Chase-Lev deque: it pushes
+ *  and pops tasks at the bottom, idle workers steal from the top of a
+ *  random peer. A run ends when the count of pending tasks (including ones
+ *  spawned while running) drops to zero.
+ */
+
+#define CACHE_LINE 64
+#define STEAL_SPINS 64  /* failed steal rounds before yielding the core */
+
+struct ws_deque {
+    _Atomic int64_t top __attribute__((aligned(CACHE_LINE)));
+    _Atomic int64_t bottom __attribute__((aligned(CACHE_LINE)));
+    _Atomic uintptr_t *buf;
+    int64_t mask;
+};
+
+struct ws_worker {
+    struct mm_ws *ws;
+    uint32_t id;
+    uint64_t steals;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct mm_ws {
+    mm_task_fn fn;
+    void *ctx;
+    uint32_t nworkers;
+    _Atomic uint64_t pending __attribute__((aligned(CACHE_LINE)));
+    struct ws_deque *deques;
+    struct ws_worker *workers;
+};
+
+static uint32_t num_threads;
+
+/*
+ *  mm_set_num_threads - worker count of the threaded kernels
+ *      @n: thread count (0 restores the default)
+ */
+void
+mm_set_num_threads(uint32_t n)
+{
+    num_threads = n;
+}
+
+/*
+ *  mm_num_threads_setting - the count set by mm_set_num_threads, 0 if none
+ *                           (for saving and restoring it as it was)
+ */
+uint32_t
+mm_num_threads_setting(void)
+{
+    return num_threads;
+}
+
+/*
+ *  mm_get_num_threads - MM_THREADS if set, else one worker per online CPU
+ */
+uint32_t
+mm_get_num_threads(void)
+{
+    if (num_threads)
+        return num_threads;
+
+    const char *env = getenv("MM_THREADS");
+    if (env && atoi(env) > 0)
+        return atoi(env);
+    return sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+static void
+deque_init(struct ws_deque *d, uint64_t cap)
+{
+    uint64_t c = 16;
+    while (c < cap)
+        c <<= 1;
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    d->buf = calloc(c, sizeof(*d->buf));
+    d->mask = c - 1;
+}
+
+/*
+ *  deque_push - owner only
+ *      @return: 0, -1 if the deque is full
+ */
+static int
+deque_push(struct ws_deque *d, uintptr_t task)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+
+    if (b - t > d->mask)
+        return -1;
+    atomic_store_explicit(&d->buf[b & d->mask], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+    return 0;
+}
+
+/*
+ *  deque_pop - owner only, newest task first
+ *      @return: 1 if @task was filled
+ */
+static int
+deque_pop(struct ws_deque *d, uintptr_t *task)
+{
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+        return 0;
+    }
+
+    *task = atomic_load_explicit(&d->buf[b & d->mask], memory_order_relaxed);
+    if (t == b) {
+        /* last task: race the thieves for it */
+        int won = atomic_compare_exchange_strong_explicit(&d->top, &t, t+1,
+                      memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+        return won;
+    }
+    return 1;
+}
+
+/*
+ *  deque_steal - any thread, oldest task first
+ *      @return: 1 if @task was filled
+ */
+static int
+deque_steal(struct ws_deque *d, uintptr_t *task)
+{
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b)
+        return 0;
+    *task = atomic_load_explicit(&d->buf[t & d->mask], memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&d->top, &t, t+1,
+               memory_order_seq_cst, memory_order_relaxed);
+}
+
+/*
+ *  mm_ws_spawn - queue a new task from inside a running task
+ *      @ws: scheduler passed to the task
+ *      @worker: id of the worker running the calling task
+ *      @task: task to queue; run inline if the deque is full
+ */
+void
+mm_ws_spawn(struct mm_ws *ws, uint32_t worker, uintptr_t task)
+{
+    atomic_fetch_add_explicit(&ws->pending, 1, memory_order_relaxed);
+    if (deque_push(&ws->deques[worker], task) < 0) {
+        ws->fn(ws->ctx, ws, task, worker);
+        atomic_fetch_sub_explicit(&ws->pending, 1, memory_order_release);
+    }
+}
+
+static void
+ws_worker_main(struct ws_worker *w)
+{
+    struct mm_ws *ws = w->ws;
+    uint64_t seed = 0x9e3779b97f4a7c15ull * (w->id + 1);
+    uint32_t fails = 0;
+    uintptr_t task;
+
+    while (atomic_load_explicit(&ws->pending, memory_order_acquire) > 0) {
+        int got = deque_pop(&ws->deques[w->id], &task);
+
+        if (!got && ws->nworkers > 1) {
+            /* xorshift pick of a victim other than ourselves */
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+            uint32_t v = seed % (ws->nworkers - 1);
+            v += v >= w->id;
+            got = deque_steal(&ws->deques[v], &task);
+            w->steals += got;
+        }
+
+        if (!got) {
+            if (++fails % STEAL_SPINS == 0)
+                sched_yield();
+            continue;
+        }
+
+        fails = 0;
+        ws->fn(ws->ctx, ws, task, w->id);
+        atomic_fetch_sub_explicit(&ws->pending, 1, memory_order_release);
+    }
+}
+
+static void
+ws_job(void *arg, uint32_t tid, uint32_t nthreads)
+{
+    struct mm_ws *ws = arg;
+
+    (void)nthreads;
+    ws_worker_main(&ws->workers[tid]);
+}
+
+/*
+ *  mm_ws_run - run tasks 0..@ntasks-1 on @nworkers work-stealing threads
+ *
+ *  Tasks are dealt out in contiguous runs, one per worker, so neighbouring
+ *  tiles start on the same core; whoever runs dry steals from the far end
+ *  of a peer's run. Returns once every task, spawned ones included, is done.
+ *  The workers are the shared pinned pool of that size; called from inside
+ *  a pool job the run happens on the calling thread alone.
+ *      @nworkers: thread count (0: mm_get_num_threads())
+ *      @fn: task body
+ *      @ctx: passed to @fn
+ *      @ntasks: initial task count
+ *      @return: number of successful steals
+ */
+uint64_t
+mm_ws_run(uint32_t nworkers, mm_task_fn fn, void *ctx, uint64_t ntasks)
+{
+    struct mm_ws ws;
+    uint64_t steals = 0;
+
+    if (!nworkers)
+        nworkers = mm_get_num_threads();
+    if (mm_pool_current())
+        nworkers = 1;
+    ws.fn = fn;
+    ws.ctx = ctx;
+    ws.nworkers = nworkers;
+    atomic_init(&ws.pending, ntasks);
+    ws.deques = aligned_alloc(CACHE_LINE, nworkers * sizeof(*ws.deques));
+    ws.workers = aligned_alloc(CACHE_LINE, nworkers * sizeof(*ws.workers));
+
+    for (uint32_t w=0; w<nworkers; w++) {
+        uint64_t lo = ntasks * w / nworkers;
+        uint64_t hi = ntasks * (w+1) / nworkers;
+
+        /* room for the initial run plus tasks spawned later */
+        deque_init(&ws.deques[w], 2 * (hi - lo) + 256);
+        for (uint64_t t=hi; t>lo; t--)
+            deque_push(&ws.deques[w], t-1);
+
+        ws.workers[w].ws = &ws;
+        ws.workers[w].id = w;
+        ws.workers[w].steals = 0;
+    }
+
+    if (nworkers == 1)
+        ws_worker_main(&ws.workers[0]);
+    else
+        mm_pool_run(mm_pool_get(nworkers), ws_job, &ws);
+
+    for (uint32_t w=0; w<nworkers; w++) {
+        steals += ws.workers[w].steals;
+        free(ws.deques[w].buf);
+    }
+
+    free(ws.deques);
+    free(ws.workers);
+    return steals;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* getenv                         */
+#include <string.h>     /* strcmp                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+#include <immintrin.h>
+
+#include "matmul.h"
+#include "mm_simd.h"
+
+/*
+ *  Tile micro-kernels for the dot-product form used by the stride worker:
+ *
+ *      c[i*ldc + j] += sum_k a[i*lda + k] * bt[j*ldb + k]
+ *
+ *  a holds rows of m1 and bt holds columns of m2 (precopied, so both walk k
+ *  with unit stride). The SIMD versions keep an MR x NR block of outputs in
+ *  vector accumulators over k and only reduce them once per tile.
+ */
+
+/*
+ *  dot_scalar - one output, plain loop (edges and fallback)
+ */
+static inline int64_t
+dot_scalar(uint32_t kt, const int64_t *a, const int64_t *b)
+{
+    int64_t acc = 0;
+    for (uint32_t k=0; k<kt; k++)
+        acc += a[k] * b[k];
+    return acc;
+}
+
+static void
+tile_dot_scalar(uint32_t mt, uint32_t nt, uint32_t kt,
+                const int64_t *a, uint32_t lda,
+                const int64_t *bt, uint32_t ldb,
+                int64_t *c, uint32_t ldc)
+{
+    for (uint32_t i=0; i<mt; i++)
+        for (uint32_t j=0; j<nt; j++)
+            c[(uint64_t)i*ldc + j] += dot_scalar(kt, &a[(uint64_t)i*lda],
+                                                 &bt[(uint64_t)j*ldb]);
+}
+
+/* AVX2: 2 rows x 4 columns, 4 int64 lanes along k */
+#define AVX2_MR 2
+#define AVX2_NR 4
+
+__attribute__((target("avx2")))
+static void
+tile_dot_avx2(uint32_t mt, uint32_t nt, uint32_t kt,
+              const int64_t *a, uint32_t lda,
+              const int64_t *bt, uint32_t ldb,
+              int64_t *c, uint32_t ldc)
+{
+    uint32_t kv = kt & ~3u;
+    uint32_t i = 0;
+
+    for (; i+AVX2_MR<=mt; i+=AVX2_MR) {
+        const int64_t *a0 = &a[(uint64_t)i*lda];
+        const int64_t *a1 = a0 + lda;
+        uint32_t j = 0;
+
+        for (; j+AVX2_NR<=nt; j+=AVX2_NR) {
+            const int64_t *b0 = &bt[(uint64_t)j*ldb];
+            const int64_t *b1 = b0 + ldb;
+            const int64_t *b2 = b1 + ldb;
+            const int64_t *b3 = b2 + ldb;
+            __m256i c00 = _mm256_setzero_si256(), c01 = c00, c02 = c00, c03 = c00;
+            __m256i c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+
+            for (uint32_t k=0; k<kv; k+=4) {
+                __m256i va0 = _mm256_loadu_si256((const __m256i *)&a0[k]);
+                __m256i va1 = _mm256_loadu_si256((const __m256i *)&a1[k]);
+                __m256i vb;
+
+                vb  = _mm256_loadu_si256((const __m256i *)&b0[k]);
+                c00 = _mm256_add_epi64(c00, mullo_epi64_avx2(va0, vb));
+                c10 = _mm256_add_epi64(c10, mullo_epi64_avx2(va1, vb));
+                vb  = _mm256_loadu_si256((const __m256i *)&b1[k]);
+                c01 = _mm256_add_epi64(c01, mullo_epi64_avx2(va0, vb));
+                c11 = _mm256_add_epi64(c11, mullo_epi64_avx2(va1, vb));
+                vb  = _mm256_loadu_si256((const __m256i *)&b2[k]);
+                c02 = _mm256_add_epi64(c02, mullo_epi64_avx2(va0, vb));
+                c12 = _mm256_add_epi64(c12, mullo_epi64_avx2(va1, vb));
+                vb  = _mm256_loadu_si256((const __m256i *)&b3[k]);
+                c03 = _mm256_add_epi64(c03, mullo_epi64_avx2(va0, vb));
+                c13 = _mm256_add_epi64(c13, mullo_epi64_avx2(va1, vb));
+            }
+
+            int64_t *r0 = &c[(uint64_t)i*ldc + j];
+            int64_t *r1 = r0 + ldc;
+            r0[0] += hsum_epi64_avx2(c00) + dot_scalar(kt-kv, &a0[kv], &b0[kv]);
+            r0[1] += hsum_epi64_avx2(c01) + dot_scalar(kt-kv, &a0[kv], &b1[kv]);
+            r0[2] += hsum_epi64_avx2(c02) + dot_scalar(kt-kv, &a0[kv], &b2[kv]);
+            r0[3] += hsum_epi64_avx2(c03) + dot_scalar(kt-kv, &a0[kv], &b3[kv]);
+            r1[0] += hsum_epi64_avx2(c10) + dot_scalar(kt-kv, &a1[kv], &b0[kv]);
+            r1[1] += hsum_epi64_avx2(c11) + dot_scalar(kt-kv, &a1[kv], &b1[kv]);
+            r1[2] += hsum_epi64_avx2(c12) + dot_scalar(kt-kv, &a1[kv], &b2[kv]);
+            r1[3] += hsum_epi64_avx2(c13) + dot_scalar(kt-kv, &a1[kv], &b3[kv]);
+        }
+
+        /* leftover columns */
+        if (j < nt)
+            tile_dot_scalar(AVX2_MR, nt-j, kt, a0, lda, &bt[(uint64_t)j*ldb], ldb,
+                            &c[(uint64_t)i*ldc + j], ldc);
+    }
+
+    /* leftover rows */
+    if (i < mt)
+        tile_dot_scalar(mt-i, nt, kt, &a[(uint64_t)i*lda], lda, bt, ldb,
+                        &c[(uint64_t)i*ldc], ldc);
+}
+
+/*
+ *  AVX-512: 4 rows x 4 columns, 8 int64 lanes along k. Generated twice:
+ *  with the emulated multiply (AVX-512F) and with native vpmullq (DQ).
+ */
+#define AVX512_MR 4
+#define AVX512_NR 4
+
+#define DEFINE_TILE_DOT_AVX512(name, isa, mul)                                  \
+__attribute__((target(isa)))                                                    \
+static void                                                                     \
+name(uint32_t mt, uint32_t nt, uint32_t kt,                                     \
+     const int64_t *a, uint32_t lda,                                            \
+     const int64_t *bt, uint32_t ldb,                                           \
+     int64_t *c, uint32_t ldc)                                                  \
+{                                                                               \
+    uint32_t kv = kt & ~7u;                                                     \
+    uint32_t i = 0;                                                             \
+                                                                                \
+    for (; i+AVX512_MR<=mt; i+=AVX512_MR) {                                     \
+        const int64_t *ar[AVX512_MR];                                           \
+        for (uint32_t r=0; r<AVX512_MR; r++)                                    \
+            ar[r] = &a[(uint64_t)(i+r)*lda];                                    \
+        uint32_t j = 0;                                                         \
+                                                                                \
+        for (; j+AVX512_NR<=nt; j+=AVX512_NR) {                                 \
+            const int64_t *br[AVX512_NR];                                       \
+            __m512i acc[AVX512_MR][AVX512_NR];                                  \
+                                                                                \
+            _Pragma("GCC unroll 4")                                             \
+            for (uint32_t s=0; s<AVX512_NR; s++)                                \
+                br[s] = &bt[(uint64_t)(j+s)*ldb];                               \
+            _Pragma("GCC unroll 4")                                             \
+            for (uint32_t r=0; r<AVX512_MR; r++)                                \
+                _Pragma("GCC unroll 4")                                         \
+                for (uint32_t s=0; s<AVX512_NR; s++)                            \
+                    acc[r][s] = _mm512_setzero_si512();                         \
+                                                                                \
+            for (uint32_t k=0; k<kv; k+=8) {                                    \
+                __m512i va[AVX512_MR];                                          \
+                _Pragma("GCC unroll 4")                                         \
+                for (uint32_t r=0; r<AVX512_MR; r++)                            \
+                    va[r] = _mm512_loadu_si512(&ar[r][k]);                      \
+                _Pragma("GCC unroll 4")                                         \
+                for (uint32_t s=0; s<AVX512_NR; s++) {                          \
+                    __m512i vb = _mm512_loadu_si512(&br[s][k]);                 \
+                    _Pragma("GCC unroll 4")                                     \
+                    for (uint32_t r=0; r<AVX512_MR; r++)                        \
+                        acc[r][s] = _mm512_add_epi64(acc[r][s], mul(va[r], vb));\
+                }                                                               \
+            }                                                                   \
+                                                                                \
+            for (uint32_t r=0; r<AVX512_MR; r++) {                              \
+                int64_t *cr = &c[(uint64_t)(i+r)*ldc + j];                      \
+                for (uint32_t s=0; s<AVX512_NR; s++)                            \
+                    cr[s] += _mm512_reduce_add_epi64(acc[r][s])                 \
+                           + dot_scalar(kt-kv, &ar[r][kv], &br[s][kv]);         \
+            }                                                                   \
+        }                                                                       \
+                                                                                \
+        /* leftover columns */                                                  \
+        if (j < nt)                                                             \
+            tile_dot_scalar(AVX512_MR, nt-j, kt, ar[0], lda,                    \
+                            &bt[(uint64_t)j*ldb], ldb,                          \
+                            &c[(uint64_t)i*ldc + j], ldc);                      \
+    }                                                                           \
+                                                                                \
+    /* leftover rows */                                                         \
+    if (i < mt)                                                                 \
+        tile_dot_scalar(mt-i, nt, kt, &a[(uint64_t)i*lda], lda, bt, ldb,        \
+                        &c[(uint64_t)i*ldc], ldc);                              \
+}
+
+DEFINE_TILE_DOT_AVX512(tile_dot_avx512, "avx512f", mullo_epi64_avx512)
+DEFINE_TILE_DOT_AVX512(tile_dot_avx512dq, "avx512f,avx512dq", mullo_epi64_avx512dq)
+
+static const struct {
+    const char *name;
+    mm_tile_fn  fn;
+} tile_impls[] = {
+    { "scalar",   tile_dot_scalar   },
+    { "avx2",     tile_dot_avx2     },
+    { "avx512",   tile_dot_avx512   },
+    { "avx512dq", tile_dot_avx512dq },
+};
+
+/*
+ *  mm_simd_supports - whether this CPU runs micro-kernels built for @isa
+ *      @isa: scalar, avx2, avx512 or avx512dq; fma and avx512bw for the
+ *            typed kernels
+ */
+int
+mm_simd_supports(const char *isa)
+{
+    __builtin_cpu_init();
+    if (!strcmp(isa, "avx2"))
+        return __builtin_cpu_supports("avx2");
+    if (!strcmp(isa, "avx512"))
+        return __builtin_cpu_supports("avx512f");
+    if (!strcmp(isa, "avx512dq"))
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512dq");
+    if (!strcmp(isa, "avx512bw"))
+        return __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512bw");
+    if (!strcmp(isa, "fma"))
+        return __builtin_cpu_supports("fma");
+    return 1;
+}
+
+/*
+ *  time_tile - seconds for a few STRIDE x STRIDE x STRIDE_K tiles
+ */
+static double
+time_tile(mm_tile_fn fn)
+{
+    static int64_t a[STRIDE*STRIDE_K], b[STRIDE*STRIDE_K], c[STRIDE*STRIDE];
+    double best = 0;
+
+    for (uint32_t i=0; i<STRIDE*STRIDE_K; i++)
+        a[i] = b[i] = i;
+    for (int rep=0; rep<5; rep++) {
+        double t = mm_wtime();
+        fn(STRIDE, STRIDE, STRIDE_K, a, STRIDE_K, b, STRIDE_K, c, STRIDE);
+        t = mm_wtime() - t;
+        if (rep == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/* index into tile_impls, set once on the first call */
+static int tile_sel;
+static pthread_once_t tile_once = PTHREAD_ONCE_INIT;
+
+/*
+ *  select_tile - best supported ISA, or MM_SIMD=scalar|avx2|avx512|avx512dq
+ *                if set and supported. vpmullq is microcoded on some cores,
+ *                so the two AVX-512 flavours are timed against each other.
+ */
+static int
+select_tile(void)
+{
+    const char *env = getenv("MM_SIMD");
+    int n = sizeof(tile_impls) / sizeof(tile_impls[0]);
+
+    if (env)
+        for (int i=0; i<n; i++)
+            if (!strcmp(env, tile_impls[i].name) && mm_simd_supports(env))
+                return i;
+
+    for (int i=n-1; i>0; i--) {
+        if (!mm_simd_supports(tile_impls[i].name))
+            continue;
+        if (!strcmp(tile_impls[i].name, "avx512dq") &&
+            time_tile(tile_impls[i-1].fn) < time_tile(tile_impls[i].fn))
+            return i-1;
+        return i;
+    }
+    return 0;
+}
+
+static void
+init_tile(void)
+{
+    tile_sel = select_tile();
+}
+
+/*
+ *  mm_tile_dot - tile micro-kernel for this CPU (CPUID, once); the first
+ *                callers of a parallel kernel all land here together, so
+ *                the timing runs under pthread_once
+ */
+mm_tile_fn
+mm_tile_dot(void)
+{
+    pthread_once(&tile_once, init_tile);
+    return tile_impls[tile_sel].fn;
+}
+
+/*
+ *  mm_simd_name - ISA of the micro-kernel returned by mm_tile_dot
+ */
+const char *
+mm_simd_name(void)
+{
+    mm_tile_dot();
+    return tile_impls[tile_sel].name;
+}
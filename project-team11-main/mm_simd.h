@@ -0,0 +1,58 @@
+#ifndef _MM_SIMD_H
+#define _MM_SIMD_H
+
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <immintrin.h>
+
+/*
+ *  Internal: int64 vector helpers shared by the micro-kernels. Each one
+ *  carries its own target attribute so the library builds without -mavx*
+ *  and only runs them after the CPUID check in mm_simd.c.
+ */
+
+/*
+ *  mullo_epi64_avx2 - low 64 bits of a*b per lane. AVX2 has no 64-bit
+ *  multiply; build it from three 32x32->64 multiplies:
+ *      lo(a)*lo(b) + ((hi(a)*lo(b) + lo(a)*hi(b)) << 32)
+ */
+__attribute__((target("avx2")))
+static inline __m256i
+mullo_epi64_avx2(__m256i a, __m256i b)
+{
+    __m256i ll = _mm256_mul_epu32(a, b);
+    __m256i hl = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+    __m256i lh = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+    return _mm256_add_epi64(ll, _mm256_slli_epi64(_mm256_add_epi64(hl, lh), 32));
+}
+
+__attribute__((target("avx2")))
+static inline int64_t
+hsum_epi64_avx2(__m256i v)
+{
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v),
+                              _mm256_extracti128_si256(v, 1));
+    return _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+}
+
+/*
+ *  mullo_epi64_avx512 - same three-multiply trick on AVX-512F; on several
+ *  cores this beats the microcoded vpmullq (see mullo_epi64_avx512dq)
+ */
+__attribute__((target("avx512f")))
+static inline __m512i
+mullo_epi64_avx512(__m512i a, __m512i b)
+{
+    __m512i ll = _mm512_mul_epu32(a, b);
+    __m512i hl = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), b);
+    __m512i lh = _mm512_mul_epu32(a, _mm512_srli_epi64(b, 32));
+    return _mm512_add_epi64(ll, _mm512_slli_epi64(_mm512_add_epi64(hl, lh), 32));
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static inline __m512i
+mullo_epi64_avx512dq(__m512i a, __m512i b)
+{
+    return _mm512_mullo_epi64(a, b);
+}
+
+#endif /* _MM_SIMD_H */
@@ -0,0 +1,396 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* getenv, atoi                   */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <pthread.h>
+
+#include "matmul.h"
+
+/*
+ *  Strassen-Winograd: 7 half-size products and 15 additions per level
+ *  instead of 8 products. The int64 results are exact, so the extra
+ *  additions cost no accuracy, only the memory traffic they take.
+ *
+ *  A product is split while M, K and N are all at least the crossover and
+ *  goes to mm_gemm_packed below it. Odd dimensions are peeled: the even
+ *  part recurses and the last row / column / k slice are fixed up with the
+ *  packed kernel. Temporaries come from one arena sized and allocated per
+ *  call, used as a stack down the recursion.
+ *
+ *  The top level runs its seven products as work-stealing tasks, each with
+ *  its own slice of the arena for the levels below, which run on the
+ *  sequential two-temporary schedule.
+ */
+
+/* crossover candidates tried by the tuner; none winning means 2 * the last */
+#define TUNE_MIN 128
+#define TUNE_MAX 1024
+
+/* products of the parallel top level */
+#define N_PRODUCTS 7
+
+static uint32_t crossover;
+static pthread_mutex_t crossover_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* workspace stack, in int64 elements */
+struct arena {
+    int64_t *base;
+    uint64_t used;
+};
+
+static int64_t *
+arena_push(struct arena *a, uint64_t n)
+{
+    int64_t *p = &a->base[a->used];
+    a->used += n;
+    return p;
+}
+
+/* Z = X + Y, all m x n */
+static void
+mat_add(uint32_t m, uint32_t n, const int64_t *X, uint64_t ldx,
+        const int64_t *Y, uint64_t ldy, int64_t *Z, uint64_t ldz)
+{
+    for (uint32_t i=0; i<m; i++)
+        for (uint32_t j=0; j<n; j++)
+            Z[i*ldz + j] = X[i*ldx + j] + Y[i*ldy + j];
+}
+
+/* Z = X - Y, all m x n */
+static void
+mat_sub(uint32_t m, uint32_t n, const int64_t *X, uint64_t ldx,
+        const int64_t *Y, uint64_t ldy, int64_t *Z, uint64_t ldz)
+{
+    for (uint32_t i=0; i<m; i++)
+        for (uint32_t j=0; j<n; j++)
+            Z[i*ldz + j] = X[i*ldx + j] - Y[i*ldy + j];
+}
+
+static int
+splits(uint32_t M, uint32_t N, uint32_t K, uint32_t cut)
+{
+    return M >= cut && N >= cut && K >= cut;
+}
+
+/*
+ *  seq_space - arena elements strassen_seq needs for M x K x N
+ */
+static uint64_t
+seq_space(uint32_t M, uint32_t N, uint32_t K, uint32_t cut)
+{
+    if (!splits(M, N, K, cut))
+        return 0;
+
+    uint32_t hm = M / 2, hn = N / 2, hk = K / 2;
+    return (uint64_t)hm * max(hk, hn) + (uint64_t)hk * hn +
+           seq_space(hm, hn, hk, cut);
+}
+
+/*
+ *  peel - fix up the odd last k slice, column and row around the even
+ *         part C[0:M&~1, 0:N&~1], which the caller has already computed
+ */
+static void
+peel(uint32_t M, uint32_t N, uint32_t K,
+     const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+     int64_t *C, uint64_t ldc)
+{
+    uint32_t m2 = M & ~1u, n2 = N & ~1u, k2 = K & ~1u;
+
+    if (K & 1)
+        mm_gemm_packed(m2, n2, 1, &A[k2], lda, &B[k2*ldb], ldb, C, ldc, 1);
+    if (N & 1)
+        mm_gemm_packed(M, 1, K, A, lda, &B[n2], ldb, &C[n2], ldc, 0);
+    if (M & 1)
+        mm_gemm_packed(1, n2, K, &A[m2*lda], lda, B, ldb, &C[m2*ldc], ldc, 0);
+}
+
+/*
+ *  strassen_seq - C = A * B, Winograd's variant on the schedule of Douglas
+ *                 et al. with two temporaries, X and Y, and C's quadrants
+ *                 holding products until they are summed
+ *      @cut: crossover
+ *      @ws: arena, seq_space() elements free
+ */
+static void
+strassen_seq(uint32_t M, uint32_t N, uint32_t K,
+             const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+             int64_t *C, uint64_t ldc, uint32_t cut, struct arena *ws)
+{
+    if (!splits(M, N, K, cut)) {
+        mm_gemm_packed(M, N, K, A, lda, B, ldb, C, ldc, 0);
+        return;
+    }
+
+    uint32_t hm = M / 2, hn = N / 2, hk = K / 2;
+    const int64_t *A11 = A, *A12 = &A[hk], *A21 = &A[hm*lda], *A22 = &A[hm*lda + hk];
+    const int64_t *B11 = B, *B12 = &B[hn], *B21 = &B[hk*ldb], *B22 = &B[hk*ldb + hn];
+    int64_t *C11 = C, *C12 = &C[hn], *C21 = &C[hm*ldc], *C22 = &C[hm*ldc + hn];
+
+    uint64_t top = ws->used;
+    int64_t *X = arena_push(ws, (uint64_t)hm * max(hk, hn));
+    int64_t *Y = arena_push(ws, (uint64_t)hk * hn);
+
+    mat_sub(hm, hk, A11, lda, A21, lda, X, hk);                 /* S3 */
+    mat_sub(hk, hn, B22, ldb, B12, ldb, Y, hn);                 /* T3 */
+    strassen_seq(hm, hn, hk, X, hk, Y, hn, C21, ldc, cut, ws);  /* P7 */
+    mat_add(hm, hk, A21, lda, A22, lda, X, hk);                 /* S1 */
+    mat_sub(hk, hn, B12, ldb, B11, ldb, Y, hn);                 /* T1 */
+    strassen_seq(hm, hn, hk, X, hk, Y, hn, C22, ldc, cut, ws);  /* P5 */
+    mat_sub(hm, hk, X, hk, A11, lda, X, hk);                    /* S2 */
+    mat_sub(hk, hn, B22, ldb, Y, hn, Y, hn);                    /* T2 */
+    strassen_seq(hm, hn, hk, X, hk, Y, hn, C12, ldc, cut, ws);  /* P6 */
+    mat_sub(hm, hk, A12, lda, X, hk, X, hk);                    /* S4 */
+    strassen_seq(hm, hn, hk, X, hk, B22, ldb, C11, ldc, cut, ws); /* P3 */
+    strassen_seq(hm, hn, hk, A11, lda, B11, ldb, X, hn, cut, ws); /* P1 */
+    mat_add(hm, hn, X, hn, C12, ldc, C12, ldc);                 /* U2 = P1 + P6 */
+    mat_add(hm, hn, C12, ldc, C21, ldc, C21, ldc);              /* U3 = U2 + P7 */
+    mat_add(hm, hn, C12, ldc, C22, ldc, C12, ldc);              /* U4 = U2 + P5 */
+    mat_add(hm, hn, C21, ldc, C22, ldc, C22, ldc);              /* U7 = U3 + P5 */
+    mat_add(hm, hn, C12, ldc, C11, ldc, C12, ldc);              /* U5 = U4 + P3 */
+    mat_sub(hk, hn, Y, hn, B21, ldb, Y, hn);                    /* T4 */
+    strassen_seq(hm, hn, hk, A22, lda, Y, hn, C11, ldc, cut, ws); /* P4 */
+    mat_sub(hm, hn, C21, ldc, C11, ldc, C21, ldc);              /* U6 = U3 - P4 */
+    strassen_seq(hm, hn, hk, A12, lda, B21, ldb, C11, ldc, cut, ws); /* P2 */
+    mat_add(hm, hn, X, hn, C11, ldc, C11, ldc);                 /* U1 = P1 + P2 */
+
+    ws->used = top;
+    peel(M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+/* one of the seven top-level products: C = A * B */
+struct product {
+    const int64_t *A;
+    uint64_t lda;
+    const int64_t *B;
+    uint64_t ldb;
+    int64_t *C;
+    uint64_t ldc;
+};
+
+struct top {
+    uint32_t hm, hn, hk, cut;
+    struct product p[N_PRODUCTS];
+    struct arena ws[N_PRODUCTS];    /* one per worker */
+};
+
+static void
+product_task(void *ctx, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    struct top *t = ctx;
+    const struct product *p = &t->p[task];
+
+    (void)ws;
+    strassen_seq(t->hm, t->hn, t->hk, p->A, p->lda, p->B, p->ldb, p->C, p->ldc,
+                 t->cut, &t->ws[worker]);
+}
+
+/*
+ *  strassen_par - C = A * B, the top level's seven products on @nworkers
+ *                 threads: S1..S4, T1..T4 and P1, P6, P7 all get their own
+ *                 buffers so that every product can run at once
+ */
+static void
+strassen_par(uint32_t M, uint32_t N, uint32_t K,
+             const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+             int64_t *C, uint64_t ldc, uint32_t cut, uint32_t nworkers,
+             struct arena *ws)
+{
+    uint32_t hm = M / 2, hn = N / 2, hk = K / 2;
+    const int64_t *A11 = A, *A12 = &A[hk], *A21 = &A[hm*lda], *A22 = &A[hm*lda + hk];
+    const int64_t *B11 = B, *B12 = &B[hn], *B21 = &B[hk*ldb], *B22 = &B[hk*ldb + hn];
+    int64_t *C11 = C, *C12 = &C[hn], *C21 = &C[hm*ldc], *C22 = &C[hm*ldc + hn];
+
+    uint64_t sa = (uint64_t)hm * hk, sb = (uint64_t)hk * hn, sc = (uint64_t)hm * hn;
+    int64_t *S1 = arena_push(ws, sa), *S2 = arena_push(ws, sa);
+    int64_t *S3 = arena_push(ws, sa), *S4 = arena_push(ws, sa);
+    int64_t *T1 = arena_push(ws, sb), *T2 = arena_push(ws, sb);
+    int64_t *T3 = arena_push(ws, sb), *T4 = arena_push(ws, sb);
+    int64_t *P1 = arena_push(ws, sc), *P6 = arena_push(ws, sc);
+    int64_t *P7 = arena_push(ws, sc);
+
+    mat_add(hm, hk, A21, lda, A22, lda, S1, hk);
+    mat_sub(hm, hk, S1, hk, A11, lda, S2, hk);
+    mat_sub(hm, hk, A11, lda, A21, lda, S3, hk);
+    mat_sub(hm, hk, A12, lda, S2, hk, S4, hk);
+    mat_sub(hk, hn, B12, ldb, B11, ldb, T1, hn);
+    mat_sub(hk, hn, B22, ldb, T1, hn, T2, hn);
+    mat_sub(hk, hn, B22, ldb, B12, ldb, T3, hn);
+    mat_sub(hk, hn, T2, hn, B21, ldb, T4, hn);
+
+    struct top t = {
+        .hm = hm, .hn = hn, .hk = hk, .cut = cut,
+        .p = {
+            { A11, lda, B11, ldb, P1,  hn  },
+            { A12, lda, B21, ldb, C11, ldc },   /* P2 */
+            { S4,  hk,  B22, ldb, C12, ldc },   /* P3 */
+            { A22, lda, T4,  hn,  C21, ldc },   /* P4 */
+            { S1,  hk,  T1,  hn,  C22, ldc },   /* P5 */
+            { S2,  hk,  T2,  hn,  P6,  hn  },
+            { S3,  hk,  T3,  hn,  P7,  hn  },
+        },
+    };
+    uint64_t each = seq_space(hm, hn, hk, cut);
+    for (uint32_t w=0; w<nworkers; w++)
+        t.ws[w].base = arena_push(ws, each);
+    mm_ws_run(nworkers, product_task, &t, N_PRODUCTS);
+
+    mat_add(hm, hn, C11, ldc, P1, hn, C11, ldc);                /* U1 */
+    mat_add(hm, hn, P1, hn, P6, hn, P6, hn);                    /* U2 */
+    mat_add(hm, hn, P6, hn, P7, hn, P7, hn);                    /* U3 */
+    mat_add(hm, hn, P6, hn, C22, ldc, P6, hn);                  /* U4 */
+    mat_add(hm, hn, P6, hn, C12, ldc, C12, ldc);                /* U5 */
+    mat_sub(hm, hn, P7, hn, C21, ldc, C21, ldc);                /* U6 */
+    mat_add(hm, hn, P7, hn, C22, ldc, C22, ldc);                /* U7 */
+
+    peel(M, N, K, A, lda, B, ldb, C, ldc);
+}
+
+/*
+ *  gemm_cut - mm_gemm_strassen with crossover @cut
+ */
+static void
+gemm_cut(uint32_t M, uint32_t N, uint32_t K,
+         const int64_t *A, uint64_t lda, const int64_t *B, uint64_t ldb,
+         int64_t *C, uint64_t ldc, int accumulate, uint32_t cut)
+{
+    if (!splits(M, N, K, cut)) {
+        mm_gemm_packed(M, N, K, A, lda, B, ldb, C, ldc, accumulate);
+        return;
+    }
+
+    uint32_t nworkers = min(mm_get_num_threads(), (uint32_t)N_PRODUCTS);
+    if (mm_pool_current())
+        nworkers = 1;
+
+    uint32_t hm = M / 2, hn = N / 2, hk = K / 2;
+    uint64_t space = accumulate ? (uint64_t)M * N : 0;
+    if (nworkers > 1)
+        space += 4 * ((uint64_t)hm * hk + (uint64_t)hk * hn) +
+                 3 * (uint64_t)hm * hn +
+                 nworkers * seq_space(hm, hn, hk, cut);
+    else
+        space += seq_space(M, N, K, cut);
+
+    struct arena ws = { mm_alloc(space * sizeof(int64_t)), 0 };
+
+    /* accumulate: compute into the arena, then add */
+    int64_t *R = accumulate ? arena_push(&ws, (uint64_t)M * N) : C;
+    uint64_t ldr = accumulate ? N : ldc;
+
+    if (nworkers > 1)
+        strassen_par(M, N, K, A, lda, B, ldb, R, ldr, cut, nworkers, &ws);
+    else
+        strassen_seq(M, N, K, A, lda, B, ldb, R, ldr, cut, &ws);
+
+    if (accumulate)
+        mat_add(M, N, C, ldc, R, ldr, C, ldc);
+    mm_free(ws.base);
+}
+
+/*
+ *  time_cut - seconds for one n^3 product with crossover @cut, on one thread
+ */
+static double
+time_cut(uint32_t n, uint32_t cut, const int64_t *A, const int64_t *B, int64_t *C)
+{
+    double start = mm_wtime();
+    struct arena ws = { mm_alloc(seq_space(n, n, n, cut) * sizeof(int64_t)), 0 };
+
+    strassen_seq(n, n, n, A, n, B, n, C, n, cut, &ws);
+    mm_free(ws.base);
+    return mm_wtime() - start;
+}
+
+/*
+ *  tune_crossover - smallest power-of-two n from TUNE_MIN to TUNE_MAX at
+ *                   which one Strassen level beats the packed kernel
+ */
+static uint32_t
+tune_crossover(void)
+{
+    int64_t *A = mm_alloc((uint64_t)TUNE_MAX * TUNE_MAX * sizeof(int64_t));
+    int64_t *B = mm_alloc((uint64_t)TUNE_MAX * TUNE_MAX * sizeof(int64_t));
+    int64_t *C = mm_alloc((uint64_t)TUNE_MAX * TUNE_MAX * sizeof(int64_t));
+    uint32_t n;
+
+    mm_init_matrix(TUNE_MAX, TUNE_MAX, A, TUNE_MAX);
+    mm_init_matrix(TUNE_MAX, TUNE_MAX, B, TUNE_MAX);
+    for (n=TUNE_MIN; n<=TUNE_MAX; n*=2) {
+        /* first pass warms the pages and the packed kernel's pick */
+        time_cut(n, UINT32_MAX, A, B, C);
+        if (time_cut(n, n, A, B, C) < time_cut(n, UINT32_MAX, A, B, C))
+            break;
+    }
+
+    mm_free(A);
+    mm_free(B);
+    mm_free(C);
+    return n;
+}
+
+/*
+ *  mm_strassen_crossover - smallest dimension that is split further:
+ *      MM_STRASSEN_CROSSOVER if set, else timed on the first call
+ */
+uint32_t
+mm_strassen_crossover(void)
+{
+    pthread_mutex_lock(&crossover_lock);
+    if (!crossover) {
+        const char *env = getenv("MM_STRASSEN_CROSSOVER");
+        crossover = env && atoi(env) > 1 ? atoi(env) : tune_crossover();
+    }
+    pthread_mutex_unlock(&crossover_lock);
+    return crossover;
+}
+
+/*
+ *  mm_strassen_crossover_setting - the crossover as set or tuned so far,
+ *                                  0 if neither (never tunes)
+ */
+uint32_t
+mm_strassen_crossover_setting(void)
+{
+    pthread_mutex_lock(&crossover_lock);
+    uint32_t n = crossover;
+    pthread_mutex_unlock(&crossover_lock);
+    return n;
+}
+
+/*
+ *  mm_strassen_set_crossover - override the crossover (0 tunes it again)
+ */
+void
+mm_strassen_set_crossover(uint32_t n)
+{
+    pthread_mutex_lock(&crossover_lock);
+    crossover = n > 1 ? n : 0;
+    pthread_mutex_unlock(&crossover_lock);
+}
+
+/*
+ *  mm_gemm_strassen - C (+)= A * B, Strassen-Winograd down to the
+ *                     crossover, then mm_gemm_packed
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @accumulate: add into C instead of overwriting it
+ */
+void
+mm_gemm_strassen(uint32_t M, uint32_t N, uint32_t K,
+                 const int64_t *A, uint64_t lda,
+                 const int64_t *B, uint64_t ldb,
+                 int64_t *C, uint64_t ldc, int accumulate)
+{
+    gemm_cut(M, N, K, A, lda, B, ldb, C, ldc, accumulate,
+             mm_strassen_crossover());
+}
+
+/*
+ *  mm_strassen - registry entry, square N
+ */
+void
+mm_strassen(uint32_t N, const int64_t *m1, const int64_t *m2, int64_t *r)
+{
+    mm_gemm_strassen(N, N, N, m1, N, m2, N, r, N, 0);
+}
@@ -0,0 +1,357 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* malloc, free                   */
+#include <string.h>     /* memcmp, memcpy                 */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <errno.h>      /* errno, EINVAL, EIO             */
+#include <fcntl.h>      /* open, O_*                      */
+#include <unistd.h>     /* pread, pwrite, ftruncate       */
+#include <sys/mman.h>   /* mmap, munmap                   */
+
+#include "matmul.h"
+
+/*
+ *  Matrix files. A 64-byte header (host byte order) holds the shape,
+ *  dtype, layout, tile size and a checksum of the data. The data follows
+ *  it in one of two layouts:
+ *      rows:  the plain row-major matrix, row stride = cols
+ *      tiles: tile x tile blocks, each row-major, the blocks in row-major
+ *             order of the tile grid; edge tiles are stored whole with the
+ *             part past the matrix zero, so every tile is one contiguous
+ *             read of the same size and the kernels only see full tiles
+ *  The data starts 64 bytes into the file, so once the file is mmap'd a
+ *  rows file is the A or B argument of any kernel and each tile of a tiles
+ *  file is a tile x tile matrix, with no parsing and no copy.
+ *
+ *  A new file is sparse: data never written reads back as zeros. The
+ *  checksum is the sum over 1 MiB chunks of the data of a 64-bit hash of
+ *  the chunk seeded with its index, so chunks can be hashed in any order.
+ *  A file written through this interface gets its checksum when closed;
+ *  it is only compared on mm_tfile_verify(), so opening and mapping stay
+ *  O(1).
+ */
+
+#define TFILE_MAGIC   "MMTILE1"
+#define TFILE_VERSION 1
+#define TFILE_HDR     64        /* header bytes, keeps the data 64-byte aligned */
+#define TFILE_CHUNK   (1u << 20)
+
+struct tfile_hdr {
+    char     magic[8];
+    uint32_t version;
+    uint32_t dtype;             /* enum mm_dtype */
+    uint32_t rows, cols;
+    uint32_t layout;            /* enum mm_layout */
+    uint32_t tile;              /* side of a tile, 0 for rows */
+    uint64_t checksum;
+    uint64_t data_bytes;
+};
+
+_Static_assert(sizeof(struct tfile_hdr) <= TFILE_HDR, "tfile header too large");
+
+static uint64_t
+data_bytes(const struct mm_tfile *f)
+{
+    if (f->layout == MM_LAYOUT_TILES)
+        return (uint64_t)f->trows * f->tcols * mm_tfile_tile_bytes(f);
+    return (uint64_t)f->rows * f->cols * mm_dtype_size(f->dtype);
+}
+
+static struct mm_tfile *
+tfile_new(int fd, const struct tfile_hdr *h, int writable)
+{
+    struct mm_tfile *f = calloc(1, sizeof(*f));
+
+    f->fd = fd;
+    f->writable = writable;
+    f->dtype = h->dtype;
+    f->layout = h->layout;
+    f->rows = h->rows;
+    f->cols = h->cols;
+    f->tile = h->tile;
+    if (f->layout == MM_LAYOUT_TILES) {
+        f->trows = (f->rows + f->tile - 1) / f->tile;
+        f->tcols = (f->cols + f->tile - 1) / f->tile;
+    }
+    f->checksum = h->checksum;
+    return f;
+}
+
+/*
+ *  mm_tfile_create - new zero matrix file, replacing @path
+ *      @dt: element type
+ *      @tile: side of a tile, 0 for the rows layout
+ *      @return: the open file, NULL with errno set on failure
+ */
+struct mm_tfile *
+mm_tfile_create(const char *path, uint32_t rows, uint32_t cols,
+                enum mm_dtype dt, uint32_t tile)
+{
+    struct tfile_hdr h = {
+        TFILE_MAGIC, TFILE_VERSION, dt, rows, cols,
+        tile ? MM_LAYOUT_TILES : MM_LAYOUT_ROWS, tile, 0, 0,
+    };
+    int fd;
+
+    if (!rows || !cols || dt > MM_DTYPE_F64) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return NULL;
+
+    struct mm_tfile *f = tfile_new(fd, &h, 1);
+    f->dirty = 1;
+    errno = 0;
+    if (ftruncate(fd, TFILE_HDR + data_bytes(f))) {
+        int e = errno ? errno : EIO;
+        mm_tfile_close(f);
+        errno = e;
+        return NULL;
+    }
+    return f;
+}
+
+/*
+ *  mm_tfile_open - existing matrix file
+ *      @writable: open for writing data too
+ *      @return: the open file, NULL with errno set on failure (EINVAL: not
+ *               a matrix file of this version, or truncated)
+ */
+struct mm_tfile *
+mm_tfile_open(const char *path, int writable)
+{
+    struct tfile_hdr h;
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    off_t end;
+
+    if (fd < 0)
+        return NULL;
+    if (pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+        memcmp(h.magic, TFILE_MAGIC, sizeof(h.magic)) ||
+        h.version != TFILE_VERSION || !h.rows || !h.cols ||
+        h.dtype > MM_DTYPE_F64 || h.layout > MM_LAYOUT_TILES ||
+        (h.layout == MM_LAYOUT_TILES) != (h.tile != 0)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct mm_tfile *f = tfile_new(fd, &h, writable);
+    end = lseek(fd, 0, SEEK_END);
+    if (h.data_bytes != data_bytes(f) || end < (off_t)(TFILE_HDR + h.data_bytes)) {
+        mm_tfile_close(f);
+        errno = EINVAL;
+        return NULL;
+    }
+    return f;
+}
+
+/* 64-bit hash of @n bytes: four multiply-rotate lanes over 8-byte words */
+static uint64_t
+hash_chunk(const void *p, uint64_t n, uint64_t seed)
+{
+    const uint64_t P1 = 0x9e3779b185ebca87ull, P2 = 0xc2b2ae3d27d4eb4full;
+    uint64_t acc[4] = { seed + P1, seed + P2, seed, seed - P1 };
+    const unsigned char *b = p;
+    uint64_t i = 0, w;
+
+    for (; i + 32 <= n; i += 32)
+        for (uint32_t l=0; l<4; l++) {
+            memcpy(&w, &b[i + 8*l], 8);
+            acc[l] += w * P2;
+            acc[l] = (acc[l] << 31 | acc[l] >> 33) * P1;
+        }
+    uint64_t h = (acc[0] << 1 | acc[0] >> 63) + (acc[1] << 7 | acc[1] >> 57) +
+                 (acc[2] << 12 | acc[2] >> 52) + (acc[3] << 18 | acc[3] >> 46);
+    for (; i < n; i++)
+        h = (h ^ b[i]) * P1;
+    h ^= n;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    return h;
+}
+
+/*
+ *  mm_tfile_checksum - checksum of the data as it is now
+ *      @return: the checksum, 0 with errno set on a read error
+ */
+uint64_t
+mm_tfile_checksum(const struct mm_tfile *f)
+{
+    uint64_t bytes = data_bytes(f), sum = 0;
+    char *buf = f->map ? NULL : malloc(TFILE_CHUNK);
+
+    errno = 0;
+    for (uint64_t c=0; c*TFILE_CHUNK<bytes; c++) {
+        uint64_t off = c * TFILE_CHUNK, n = min(bytes - off, (uint64_t)TFILE_CHUNK);
+        const char *p = f->map ? (const char *)f->map + TFILE_HDR + off : buf;
+
+        if (!f->map && pread(f->fd, buf, n, TFILE_HDR + off) != (ssize_t)n) {
+            if (!errno)
+                errno = EIO;
+            sum = 0;
+            break;
+        }
+        sum += hash_chunk(p, n, c);
+    }
+    free(buf);
+    return sum;
+}
+
+/*
+ *  mm_tfile_verify - compare the data with the checksum in the header
+ *      @return: 1 if they match, 0 if not, -1 on a read error
+ */
+int
+mm_tfile_verify(const struct mm_tfile *f)
+{
+    uint64_t sum = mm_tfile_checksum(f);
+
+    if (!sum && errno)
+        return -1;
+    return sum == f->checksum;
+}
+
+/* header with the current checksum */
+static int
+write_header(struct mm_tfile *f)
+{
+    struct tfile_hdr h = {
+        TFILE_MAGIC, TFILE_VERSION, f->dtype, f->rows, f->cols, f->layout,
+        f->tile, 0, data_bytes(f),
+    };
+    char buf[TFILE_HDR] = { 0 };
+
+    h.checksum = f->checksum = mm_tfile_checksum(f);
+    memcpy(buf, &h, sizeof(h));
+    return pwrite(f->fd, buf, sizeof(buf), 0) == sizeof(buf) ? 0 : -1;
+}
+
+/*
+ *  mm_tfile_close - unmap and close; a file that was written gets its
+ *                   checksum first
+ *      @return: 0, -1 with errno set if the header could not be written
+ */
+int
+mm_tfile_close(struct mm_tfile *f)
+{
+    int ret = 0;
+
+    if (!f)
+        return 0;
+    if (f->dirty)
+        ret = write_header(f);
+    if (f->map)
+        munmap(f->map, TFILE_HDR + data_bytes(f));
+    close(f->fd);
+    free(f);
+    return ret;
+}
+
+/*
+ *  mm_tfile_map - the data, mmap'd (read-only unless opened writable)
+ *      @return: pointer to element (0, 0), NULL with errno set on failure
+ */
+void *
+mm_tfile_map(struct mm_tfile *f)
+{
+    if (f->map)
+        return (char *)f->map + TFILE_HDR;
+
+    int prot = PROT_READ | (f->writable ? PROT_WRITE : 0);
+    void *p = mmap(NULL, TFILE_HDR + data_bytes(f), prot, MAP_SHARED, f->fd, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    f->map = p;
+    /* a writable map may be written through, so the checksum is redone */
+    f->dirty |= f->writable;
+    return (char *)p + TFILE_HDR;
+}
+
+uint64_t
+mm_tfile_tile_bytes(const struct mm_tfile *f)
+{
+    return (uint64_t)f->tile * f->tile * mm_dtype_size(f->dtype);
+}
+
+static uint64_t
+tile_offset(const struct mm_tfile *f, uint32_t ti, uint32_t tj)
+{
+    return ((uint64_t)ti * f->tcols + tj) * mm_tfile_tile_bytes(f);
+}
+
+/*
+ *  mm_tfile_tile - tile (@ti, @tj) of a mapped tiles file, tile x tile with
+ *                  row stride tile
+ */
+void *
+mm_tfile_tile(const struct mm_tfile *f, uint32_t ti, uint32_t tj)
+{
+    return (char *)f->map + TFILE_HDR + tile_offset(f, ti, tj);
+}
+
+/*
+ *  mm_tfile_read - tile (@ti, @tj) of a tiles file into @t
+ *      @return: 0, -1 with errno set on failure
+ */
+int
+mm_tfile_read(const struct mm_tfile *f, uint32_t ti, uint32_t tj, void *t)
+{
+    uint64_t off = TFILE_HDR + tile_offset(f, ti, tj);
+    uint64_t left = mm_tfile_tile_bytes(f);
+    char *p = t;
+
+    if (f->layout != MM_LAYOUT_TILES) {
+        errno = EINVAL;
+        return -1;
+    }
+    while (left) {
+        ssize_t n = pread(f->fd, p, left, off);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (!n)
+                errno = EIO;
+            return -1;
+        }
+        p += n;
+        off += n;
+        left -= n;
+    }
+    return 0;
+}
+
+/*
+ *  mm_tfile_write - @t as tile (@ti, @tj) of a tiles file
+ *      @return: 0, -1 with errno set on failure
+ */
+int
+mm_tfile_write(struct mm_tfile *f, uint32_t ti, uint32_t tj, const void *t)
+{
+    uint64_t off = TFILE_HDR + tile_offset(f, ti, tj);
+    uint64_t left = mm_tfile_tile_bytes(f);
+    const char *p = t;
+
+    if (f->layout != MM_LAYOUT_TILES) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->dirty = 1;
+    while (left) {
+        ssize_t n = pwrite(f->fd, p, left, off);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (!n)
+                errno = EIO;
+            return -1;
+        }
+        p += n;
+        off += n;
+        left -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+#include <stdio.h>      /* FILE, fopen, fgets, fprintf    */
+#include <stdlib.h>     /* getenv, realloc, strtoul       */
+#include <string.h>     /* strcmp, strncmp, strchr        */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <errno.h>      /* errno, EEXIST                  */
+#include <pthread.h>
+#include <sys/stat.h>   /* mkdir                          */
+
+#include "matmul.h"
+
+/*
+ *  Autotuner: for a problem class (M, K and N rounded up to powers of two,
+ *  dtype, thread budget) it times every registry kernel that can run it,
+ *  with every block size / crossover and thread count the kernel takes,
+ *  and remembers the fastest configuration.
+ *
+ *  The search has two stages. All candidates are timed on the problem with
+ *  each dimension capped at TUNE_SAMPLE_MAX, then the TUNE_FINALISTS best
+ *  are timed again at the real size, so a naive kernel never runs on a
+ *  large problem.
+ *
+ *  Results are appended to a tuning cache, one tab-separated line each:
+ *      cpu model, m/k/n class, dtype, threads, scope, kernel, block,
+ *      worker count, GOP/s, shape it was tuned on
+ *  The file is shared by hosts of every CPU model; a process only loads
+ *  the lines of its own model, later lines overriding earlier ones.
+ */
+
+/* stage 1 caps every dimension at this */
+#define TUNE_SAMPLE_MAX 512
+
+/* candidates timed again at the real size */
+#define TUNE_FINALISTS 3
+
+/* a candidate is repeated until this many seconds, at most TUNE_REPS runs */
+#define TUNE_MIN_TIME 0.05
+#define TUNE_REPS     5
+
+#define CPU_MODEL_MAX 128
+
+static const uint32_t tune_blocks[] = { 8, 16, 32, 64, 128 };
+static const uint32_t tune_crossovers[] = { 128, 256, 512, 1024 };
+
+/* one cached class */
+struct tune_entry {
+    uint32_t       cm, ck, cn;      /* size classes */
+    enum mm_dtype  dt;
+    uint32_t       threads;         /* thread budget */
+    const struct mm_kernel *scope;  /* NULL: any kernel */
+    struct mm_tuned t;
+};
+
+static struct tune_entry *entries;
+static uint32_t n_entries;
+static int loaded;
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char cpu_model[CPU_MODEL_MAX];
+static char cache_path[4096];
+
+/* ceil(log2(x)), 0 for x <= 1 */
+static uint32_t
+size_class(uint32_t x)
+{
+    return x > 1 ? 32 - __builtin_clz(x - 1) : 0;
+}
+
+/*
+ *  mm_cpu_model - "model name" of /proc/cpuinfo, tabs and newline removed
+ */
+const char *
+mm_cpu_model(void)
+{
+    if (cpu_model[0])
+        return cpu_model;
+
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    char line[512];
+
+    strcpy(cpu_model, "unknown");
+    while (f && fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        if (strncmp(line, "model name", 10) || !colon)
+            continue;
+        colon += 1 + (colon[1] == ' ');
+        snprintf(cpu_model, sizeof(cpu_model), "%s", colon);
+        for (char *c = cpu_model; *c; c++)
+            if (*c == '\t' || *c == '\n')
+                *c = *c == '\t' ? ' ' : '\0';
+        break;
+    }
+    if (f)
+        fclose(f);
+    return cpu_model;
+}
+
+/*
+ *  mm_tune_cache_path - MM_TUNE_CACHE, else ~/.cache/matmul-tune
+ */
+const char *
+mm_tune_cache_path(void)
+{
+    if (cache_path[0])
+        return cache_path;
+
+    const char *env = getenv("MM_TUNE_CACHE");
+    const char *home = getenv("HOME");
+
+    if (env && *env)
+        snprintf(cache_path, sizeof(cache_path), "%s", env);
+    else
+        snprintf(cache_path, sizeof(cache_path), "%s/.cache/matmul-tune",
+                 home ? home : ".");
+    return cache_path;
+}
+
+static struct tune_entry *
+find_entry(uint32_t cm, uint32_t ck, uint32_t cn, enum mm_dtype dt,
+           uint32_t threads, const struct mm_kernel *scope)
+{
+    for (uint32_t i=n_entries; i>0; i--) {
+        struct tune_entry *e = &entries[i-1];
+        if (e->cm == cm && e->ck == ck && e->cn == cn && e->dt == dt &&
+            e->threads == threads && e->scope == scope)
+            return e;
+    }
+    return NULL;
+}
+
+static void
+add_entry(const struct tune_entry *e)
+{
+    struct tune_entry *old = find_entry(e->cm, e->ck, e->cn, e->dt,
+                                        e->threads, e->scope);
+    if (old) {
+        *old = *e;
+        return;
+    }
+    entries = realloc(entries, (n_entries + 1) * sizeof(*entries));
+    entries[n_entries++] = *e;
+}
+
+/*
+ *  parse_line - one cache line into @e
+ *      @return: 0 if it is ours and valid, -1 otherwise
+ */
+static int
+parse_line(char *line, struct tune_entry *e)
+{
+    char *f[12], *save = NULL;
+    uint32_t n = 0;
+
+    line[strcspn(line, "\n")] = '\0';
+    if (line[0] == '#')
+        return -1;
+    for (char *tok = strtok_r(line, "\t", &save); tok && n < 12;
+         tok = strtok_r(NULL, "\t", &save))
+        f[n++] = tok;
+    if (n != 12 || strcmp(f[0], mm_cpu_model()))
+        return -1;
+
+    int dt = mm_dtype_parse(f[4]);
+    e->cm = strtoul(f[1], NULL, 10);
+    e->ck = strtoul(f[2], NULL, 10);
+    e->cn = strtoul(f[3], NULL, 10);
+    e->threads = strtoul(f[5], NULL, 10);
+    e->scope = strcmp(f[6], "any") ? mm_kernel_find(f[6]) : NULL;
+    e->t.k = mm_kernel_find(f[7]);
+    e->t.block = strtoul(f[8], NULL, 10);
+    e->t.threads = strtoul(f[9], NULL, 10);
+    e->t.gops = strtod(f[10], NULL);
+    /* f[11]: the shape it was tuned on, for the reader */
+    if (dt < 0 || !e->t.k || (strcmp(f[6], "any") && !e->scope))
+        return -1;
+    e->dt = dt;
+    return 0;
+}
+
+/* the cache file, once per process; call with tune_lock held */
+static void
+load_cache(void)
+{
+    FILE *f;
+    char line[1024];
+
+    if (loaded)
+        return;
+    loaded = 1;
+    if (!(f = fopen(mm_tune_cache_path(), "r")))
+        return;
+
+    while (fgets(line, sizeof(line), f)) {
+        struct tune_entry e;
+        if (!parse_line(line, &e))
+            add_entry(&e);
+    }
+    fclose(f);
+}
+
+/* mkdir -p of @path's directory */
+static void
+make_parent(const char *path)
+{
+    char dir[sizeof(cache_path)];
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *s = dir + 1; *s; s++) {
+        if (*s != '/')
+            continue;
+        *s = '\0';
+        if (mkdir(dir, 0755) && errno != EEXIST)
+            return;
+        *s = '/';
+    }
+}
+
+/*
+ *  save_entry - append @e to the cache file
+ *      @M, @K, @N: the shape it was tuned on
+ */
+static void
+save_entry(const struct tune_entry *e, uint32_t M, uint32_t K, uint32_t N)
+{
+    const char *path = mm_tune_cache_path();
+    FILE *f;
+
+    make_parent(path);
+    if (!(f = fopen(path, "a"))) {
+        fprintf(stderr, "mm_tune: cannot write %s\n", path);
+        return;
+    }
+    fprintf(f, "%s\t%u\t%u\t%u\t%s\t%u\t%s\t%s\t%u\t%u\t%.3f\t%ux%ux%u\n",
+            mm_cpu_model(), e->cm, e->ck, e->cn, mm_dtype_name(e->dt),
+            e->threads, e->scope ? e->scope->name : "any", e->t.k->name,
+            e->t.block, e->t.threads, e->t.gops, M, K, N);
+    fclose(f);
+}
+
+/*
+ *  mm_tune_lookup - cached configuration of the class of M x K x N
+ *      @threads: thread budget (0: mm_get_num_threads())
+ *      @only: search scope, NULL for any kernel
+ *      @return: 1 and @t filled in if cached, 0 otherwise
+ */
+int
+mm_tune_lookup(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+               uint32_t threads, const struct mm_kernel *only,
+               struct mm_tuned *t)
+{
+    if (!threads)
+        threads = mm_get_num_threads();
+
+    pthread_mutex_lock(&tune_lock);
+    load_cache();
+    struct tune_entry *e = find_entry(size_class(M), size_class(K),
+                                      size_class(N), dt, threads, only);
+    if (e)
+        *t = e->t;
+    pthread_mutex_unlock(&tune_lock);
+    return e != NULL;
+}
+
+/*
+ *  mm_tune_apply - set the block parameter and worker count of @t
+ */
+void
+mm_tune_apply(const struct mm_tuned *t)
+{
+    if (t->k->threaded == MM_THREADS_ANY)
+        mm_set_num_threads(t->threads);
+    if (t->block)
+        mm_kernel_set_block(t->k, t->block);
+}
+
+/* buffers of the largest problem timed */
+struct tune_bufs {
+    void *A, *B, *C;
+};
+
+/*
+ *  time_config - best seconds of @t on M x K x N, 0 if it cannot run
+ */
+static double
+time_config(const struct mm_tuned *t, enum mm_dtype dt,
+            uint32_t M, uint32_t K, uint32_t N, const struct tune_bufs *b)
+{
+    mm_gemm_any_fn any = mm_dtype_kernel(t->k, dt);
+    double best = 0, spent = 0;
+
+    if (dt != MM_DTYPE_I64 && !any)
+        return 0;
+
+    mm_tune_apply(t);
+    for (uint32_t rep=0; rep<TUNE_REPS && (rep < 2 || spent < TUNE_MIN_TIME); rep++) {
+        double start = mm_wtime();
+        if (any)
+            any(M, N, K, b->A, K, b->B, N, b->C, N, 0);
+        else
+            t->k->gemm(M, N, K, b->A, K, b->B, N, b->C, N, 0);
+        double s = mm_wtime() - start;
+
+        /* the first run pays for page faults and one-time setup */
+        if (rep > 0 && (best == 0 || s < best))
+            best = s;
+        spent += s;
+        if (s > 1.0 && rep > 0)
+            break;
+    }
+    return best;
+}
+
+/*
+ *  candidates - every configuration of the search space for the budget
+ *      @M, @K, @N: the problem, kernels that cannot take it are skipped
+ *      @out: filled in, sized for the whole registry
+ *      @return: number of candidates
+ */
+static uint32_t
+candidates(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+           uint32_t threads, const struct mm_kernel *only, struct mm_tuned *out)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i=0; i<mm_kernel_count(); i++) {
+        const struct mm_kernel *k = mm_kernel_at(i);
+        const uint32_t *blocks = NULL;
+        uint32_t nb = 1;
+
+        if ((only && k != only) ||
+            M % k->align || K % k->align || N % k->align ||
+            (dt != MM_DTYPE_I64 && !mm_dtype_kernel(k, dt)))
+            continue;
+        /* fixed worker counts larger than the budget are out */
+        if (k->threaded && k->threaded != MM_THREADS_ANY && k->threaded > threads)
+            continue;
+
+        if (k->fn == mm_strassen) {
+            blocks = tune_crossovers;
+            nb = sizeof(tune_crossovers) / sizeof(tune_crossovers[0]);
+        } else if (mm_kernel_has_block(k)) {
+            blocks = tune_blocks;
+            nb = sizeof(tune_blocks) / sizeof(tune_blocks[0]);
+        }
+
+        for (uint32_t ib=0; ib<nb; ib++) {
+            /* 1, 2, 4, ... below the budget, then the budget itself */
+            for (uint32_t t=1; ; t = t*2 < threads ? t*2 : threads) {
+                out[n++] = (struct mm_tuned){
+                    .k = k,
+                    .block = blocks ? blocks[ib] : 0,
+                    .threads = k->threaded == MM_THREADS_ANY ? t :
+                               k->threaded ? k->threaded : 1,
+                };
+                if (k->threaded != MM_THREADS_ANY || t == threads)
+                    break;
+            }
+        }
+    }
+    return n;
+}
+
+static int
+cmp_gops(const void *a, const void *b)
+{
+    double x = ((const struct mm_tuned *)a)->gops;
+    double y = ((const struct mm_tuned *)b)->gops;
+    return (x < y) - (x > y);
+}
+
+/*
+ *  mm_tune_search - time the search space on M x K x N and cache the
+ *                   fastest configuration, even if the class was cached
+ *      @threads: thread budget (0: mm_get_num_threads())
+ *      @only: search scope, NULL for any kernel
+ *      @t: the winner
+ *      @return: 0, -1 if no kernel can run the problem
+ */
+int
+mm_tune_search(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+               uint32_t threads, const struct mm_kernel *only,
+               struct mm_tuned *t)
+{
+    if (!threads)
+        threads = mm_get_num_threads();
+
+    /* 5 block sizes x 33 thread counts per kernel at most */
+    uint32_t room = mm_kernel_count() * 5 * 33;
+    struct mm_tuned *cand = malloc(room * sizeof(*cand));
+    uint32_t nc = candidates(M, K, N, dt, threads, only, cand);
+
+    if (!nc || !M || !K || !N) {
+        free(cand);
+        return -1;
+    }
+
+    uint32_t sm = min(M, (uint32_t)TUNE_SAMPLE_MAX);
+    uint32_t sk = min(K, (uint32_t)TUNE_SAMPLE_MAX);
+    uint32_t sn = min(N, (uint32_t)TUNE_SAMPLE_MAX);
+    uint32_t size = mm_dtype_size(dt), acc = mm_dtype_acc_size(dt);
+    struct tune_bufs b = {
+        mm_alloc((uint64_t)M * K * size),
+        mm_alloc((uint64_t)K * N * size),
+        mm_alloc((uint64_t)M * N * acc),
+    };
+    mm_dtype_init(dt, M, K, b.A, K);
+    mm_dtype_init(dt, K, N, b.B, N);
+
+    /* as set, not as resolved: unset stays unset, and nothing is tuned */
+    uint32_t saved_threads = mm_num_threads_setting();
+    uint32_t saved_block = mm_get_block_size();
+    uint32_t saved_cross = mm_strassen_crossover_setting();
+
+    /* stage 1: everything on the sample */
+    for (uint32_t i=0; i<nc; i++) {
+        double s = time_config(&cand[i], dt, sm, sk, sn, &b);
+        cand[i].gops = s > 0 ? 2.0 * sm * sk * sn / s / 1e9 : 0;
+    }
+    qsort(cand, nc, sizeof(*cand), cmp_gops);
+
+    /* stage 2: the finalists at the real size */
+    if (sm != M || sk != K || sn != N) {
+        uint32_t nf = min(nc, (uint32_t)TUNE_FINALISTS);
+        for (uint32_t i=0; i<nf; i++) {
+            double s = time_config(&cand[i], dt, M, K, N, &b);
+            cand[i].gops = s > 0 ? 2.0 * M * K * N / s / 1e9 : 0;
+        }
+        qsort(cand, nf, sizeof(*cand), cmp_gops);
+    }
+    *t = cand[0];
+
+    mm_set_num_threads(saved_threads);
+    mm_set_block_size(saved_block);
+    mm_strassen_set_crossover(saved_cross);
+    mm_free(b.A);
+    mm_free(b.B);
+    mm_free(b.C);
+    free(cand);
+
+    struct tune_entry e = {
+        .cm = size_class(M), .ck = size_class(K), .cn = size_class(N),
+        .dt = dt, .threads = threads, .scope = only, .t = *t,
+    };
+    pthread_mutex_lock(&tune_lock);
+    load_cache();
+    add_entry(&e);
+    save_entry(&e, M, K, N);
+    pthread_mutex_unlock(&tune_lock);
+    return 0;
+}
+
+/*
+ *  mm_tune - cached configuration of the class of M x K x N, searched and
+ *            cached first if there is none
+ *      @return: 1 if it came from the cache, 0 if searched, -1 if no
+ *               kernel can run the problem
+ */
+int
+mm_tune(uint32_t M, uint32_t K, uint32_t N, enum mm_dtype dt,
+        uint32_t threads, const struct mm_kernel *only, struct mm_tuned *t)
+{
+    if (mm_tune_lookup(M, K, N, dt, threads, only, t))
+        return 1;
+    return mm_tune_search(M, K, N, dt, threads, only, t);
+}
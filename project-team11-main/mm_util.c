@@ -0,0 +1,223 @@
+#include <stdio.h>      /* printf                         */
+#include <errno.h>      /* errno                          */
+#include <stdlib.h>     /* malloc, calloc, free, strtoul  */
+#include <string.h>     /* memset                         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <time.h>       /* clock_gettime                  */
+
+#include "matmul.h"
+
+/*
+ *  mm_usage - how to run the program
+ *      @prog: program name (argv[0])
+ *      @args: argument synopsis
+ *      @return: -1
+ */
+int32_t
+mm_usage(const char *prog, const char *args)
+{
+    printf("\t%s %s\n", prog, args);
+    return -1;
+}
+
+/*
+ *  parse_dim - one dimension of a shape: digits only (no sign, so "-5"
+ *              does not wrap to 4e9), not 0, and within uint32_t
+ *      @return: the character after it, NULL if there is none
+ */
+static const char *
+parse_dim(const char *s, uint32_t *d)
+{
+    unsigned long v;
+    char *end;
+
+    if (*s < '0' || *s > '9')
+        return NULL;
+    errno = 0;
+    v = strtoul(s, &end, 10);
+    if (errno || !v || v > UINT32_MAX)
+        return NULL;
+    *d = v;
+    return end;
+}
+
+/*
+ *  mm_parse_shape - "N" for a square problem or "MxKxN"
+ *      @M, @K, @N: filled in; A is M x K, B is K x N
+ *      @return: 0, -1 if @s is not a shape or has a zero dimension
+ */
+int
+mm_parse_shape(const char *s, uint32_t *M, uint32_t *K, uint32_t *N)
+{
+    const char *p = parse_dim(s, M);
+
+    if (p && !*p) {
+        *K = *N = *M;
+        return 0;
+    }
+    if (!p || *p != 'x' || !(p = parse_dim(p+1, K)) ||
+        *p != 'x' || !(p = parse_dim(p+1, N)) || *p)
+        return -1;
+    return 0;
+}
+
+/*
+ *  print_matrix - if you need convincing that it works just fine
+ *      @N: square matrix size
+ *      @m: pointer to matrix
+ */
+void
+print_matrix(uint32_t N, const int64_t *m)
+{
+    for (uint32_t i=0; i<N; ++i) {
+        for (uint32_t j=0; j<N; ++j)
+            printf("%3ld ", m[i*N + j]);
+        printf("\n");
+    }
+}
+
+/*
+ *  init_matrices - fill both operands with their element index
+ *      @N: square matrix size
+ *      @m1: pointer to matrix 1
+ *      @m2: pointer to matrix 2
+ */
+void
+init_matrices(uint32_t N, int64_t *m1, int64_t *m2)
+{
+    for (uint32_t i=0; i<N*N; ++i) {
+        m1[i] = i;
+        m2[i] = i;
+    }
+}
+
+/*
+ *  mm_init_matrix - fill a rows x cols view with its element index, as
+ *                   init_matrices does for square operands
+ *      @ld: row stride
+ */
+void
+mm_init_matrix(uint32_t rows, uint32_t cols, int64_t *m, uint64_t ld)
+{
+    for (uint32_t i=0; i<rows; i++)
+        for (uint32_t j=0; j<cols; j++)
+            m[i*ld + j] = (uint64_t)i*cols + j;
+}
+
+/*
+ *  mm_clear - zero an M x N view
+ *      @ldc: row stride
+ */
+void
+mm_clear(uint32_t M, uint32_t N, int64_t *C, uint64_t ldc)
+{
+    if (ldc == N) {
+        memset(C, 0, (uint64_t)M * N * sizeof(int64_t));
+        return;
+    }
+    for (uint32_t i=0; i<M; i++)
+        memset(&C[i*ldc], 0, N * sizeof(int64_t));
+}
+
+/*
+ *  compare_matrix - element-wise equality
+ *      @return: 1 if equal, 0 otherwise
+ */
+int
+compare_matrix(uint32_t N, const int64_t *a, const int64_t *b)
+{
+    for (uint64_t i=0; i<(uint64_t)N*N; i++)
+        if (a[i] != b[i])
+            return 0;
+    return 1;
+}
+
+/*
+ *  verify_matrix - mm_verify_gemm of a square product
+ *      @N: square matrix size
+ *      @m1: pointer to matrix 1
+ *      @m2: pointer to matrix 2
+ *      @r: result to check
+ *      @return: 1 if r == m1 * m2, 0 otherwise
+ */
+int
+verify_matrix(uint32_t N, const int64_t *m1, const int64_t *m2,
+              const int64_t *r)
+{
+    return mm_verify_gemm(N, N, N, m1, N, m2, N, r, N);
+}
+
+/*
+ *  mm_wtime - wall clock in seconds
+ */
+double
+mm_wtime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ *  read_cache_size - size of /sys/devices/system/cpu/cpu0/cache/index@idx
+ *      @level: cache level wanted
+ *      @return: size in bytes, 0 if that index is not a @level data cache
+ */
+static uint64_t
+read_cache_size(int idx, int level)
+{
+    char path[128], type[32], unit = 0;
+    int lvl = 0;
+    uint64_t size = 0;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+    if (!(f = fopen(path, "r")))
+        return 0;
+    if (fscanf(f, "%d", &lvl) != 1)
+        lvl = 0;
+    fclose(f);
+    if (lvl != level)
+        return 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+    if (!(f = fopen(path, "r")))
+        return 0;
+    if (fscanf(f, "%31s", type) != 1 || !strcmp(type, "Instruction")) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+    if (!(f = fopen(path, "r")))
+        return 0;
+    if (fscanf(f, "%lu%c", &size, &unit) < 1)
+        size = 0;
+    fclose(f);
+
+    if (unit == 'K')
+        size <<= 10;
+    else if (unit == 'M')
+        size <<= 20;
+    return size;
+}
+
+/*
+ *  mm_cache_sizes - L1d/L2/L3 sizes of this host
+ *      @c: filled in; levels sysfs does not report get common defaults
+ */
+void
+mm_cache_sizes(struct mm_cache *c)
+{
+    uint64_t *lv[] = { &c->l1d, &c->l2, &c->l3 };
+    const uint64_t dflt[] = { 32 << 10, 256 << 10, 8 << 20 };
+
+    for (int level=1; level<=3; level++) {
+        *lv[level-1] = 0;
+        for (int idx=0; idx<8 && !*lv[level-1]; idx++)
+            *lv[level-1] = read_cache_size(idx, level);
+        if (!*lv[level-1])
+            *lv[level-1] = dflt[level-1];
+    }
+}
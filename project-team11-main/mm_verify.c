@@ -0,0 +1,205 @@
+#include <stdio.h>      /* printf                         */
+#include <stdlib.h>     /* getenv, strtoull               */
+#include <string.h>     /* memcmp, memset, strcmp         */
+#include <stdint.h>     /* uint32_t, uint64_t             */
+#include <stdatomic.h>
+
+#include "matmul.h"
+
+/*
+ *  Checking C == A * B without recomputing the product serially.
+ *
+ *  Freivalds: for a random vector x, A (B x) == C x holds for every x if
+ *  C is right, and for few x if it is not. That costs three matrix-vector
+ *  products, O(MK + KN + MN), instead of O(MNK). The arithmetic is the
+ *  kernels' own, int64 modulo 2^64. A wrong entry d is missed by one trial
+ *  with probability 2^v / 2^64, where 2^v is the largest power of two
+ *  dividing d; for d = 2^63 that is 1/2, so the bound is 2^-trials for any
+ *  error and about 2^-64 per trial for typical ones. Up to FV_LANES trials
+ *  share one pass over the matrices.
+ *
+ *  Exact: C is recomputed band by band of VERIFY_BAND rows with the packed
+ *  kernel on the work-stealing workers and compared as it goes, so only
+ *  one band per worker is held, and a mismatch stops the other workers.
+ *
+ *  mm_verify_gemm (and so verify_matrix) uses Freivalds with
+ *  MM_VERIFY_TRIALS trials (default VERIFY_TRIALS), or the exact check if
+ *  MM_VERIFY=exact.
+ */
+
+#define FV_LANES      8         /* trials per pass */
+#define FV_ROWS       64        /* matrix-vector rows per task */
+#define VERIFY_BAND   64        /* rows of C per exact-check task */
+#define VERIFY_TRIALS 4
+
+/* y = m x for FV_LANES vectors at once; x is cols x FV_LANES, y rows x FV_LANES */
+struct fv_pass {
+    const int64_t *m;
+    uint64_t ld;
+    uint32_t rows, cols;
+    const uint64_t *x;
+    uint64_t *y;
+};
+
+static void
+fv_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    const struct fv_pass *p = arg;
+    uint32_t lo = task * FV_ROWS, hi = min(lo + FV_ROWS, p->rows);
+
+    (void)ws, (void)worker;
+    for (uint32_t i=lo; i<hi; i++) {
+        const int64_t *row = &p->m[i * p->ld];
+        uint64_t acc[FV_LANES] = { 0 };
+
+        for (uint32_t j=0; j<p->cols; j++) {
+            uint64_t v = row[j];
+            for (uint32_t l=0; l<FV_LANES; l++)
+                acc[l] += v * p->x[(uint64_t)j*FV_LANES + l];
+        }
+        memcpy(&p->y[(uint64_t)i*FV_LANES], acc, sizeof(acc));
+    }
+}
+
+static void
+fv_mul(const int64_t *m, uint64_t ld, uint32_t rows, uint32_t cols,
+       const uint64_t *x, uint64_t *y)
+{
+    struct fv_pass p = {
+        .m = m, .ld = ld, .rows = rows, .cols = cols, .x = x, .y = y,
+    };
+
+    mm_ws_run(0, fv_task, &p, (rows + FV_ROWS - 1) / FV_ROWS);
+}
+
+/* splitmix64 */
+static uint64_t
+next_random(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/*
+ *  mm_verify_freivalds - randomized check of C == A * B
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @trials: independent random vectors (0: VERIFY_TRIALS)
+ *      @return: 1 if every trial agreed, 0 if C is certainly wrong
+ */
+int
+mm_verify_freivalds(uint32_t M, uint32_t N, uint32_t K,
+                    const int64_t *A, uint64_t lda,
+                    const int64_t *B, uint64_t ldb,
+                    const int64_t *C, uint64_t ldc, uint32_t trials)
+{
+    static _Atomic uint64_t calls;
+    uint64_t seed = (uint64_t)(mm_wtime() * 1e9) ^ atomic_fetch_add(&calls, 1) << 48;
+    uint64_t *x = malloc((uint64_t)N * FV_LANES * sizeof(uint64_t));
+    uint64_t *bx = malloc((uint64_t)K * FV_LANES * sizeof(uint64_t));
+    uint64_t *abx = malloc((uint64_t)M * FV_LANES * sizeof(uint64_t));
+    uint64_t *cx = malloc((uint64_t)M * FV_LANES * sizeof(uint64_t));
+    int valid = 1;
+
+    if (!trials)
+        trials = VERIFY_TRIALS;
+    for (uint32_t done=0; done<trials && valid; done+=FV_LANES) {
+        for (uint64_t i=0; i<(uint64_t)N * FV_LANES; i++)
+            x[i] = next_random(&seed);
+        fv_mul(B, ldb, K, N, x, bx);
+        fv_mul(A, lda, M, K, bx, abx);
+        fv_mul(C, ldc, M, N, x, cx);
+
+        /* lanes past the trial count are computed but not compared */
+        uint32_t lanes = min(trials - done, (uint32_t)FV_LANES);
+        for (uint64_t i=0; i<M && valid; i++)
+            for (uint32_t l=0; l<lanes; l++)
+                if (abx[i*FV_LANES + l] != cx[i*FV_LANES + l])
+                    valid = 0;
+    }
+
+    free(x);
+    free(bx);
+    free(abx);
+    free(cx);
+    return valid;
+}
+
+struct exact_ctx {
+    uint32_t M, N, K;
+    const int64_t *A, *B, *C;
+    uint64_t lda, ldb, ldc;
+    atomic_int bad;
+};
+
+static void
+exact_task(void *arg, struct mm_ws *ws, uintptr_t task, uint32_t worker)
+{
+    struct exact_ctx *e = arg;
+    uint32_t lo = task * VERIFY_BAND, rows = min((uint32_t)VERIFY_BAND, e->M - lo);
+
+    (void)ws, (void)worker;
+    if (atomic_load_explicit(&e->bad, memory_order_relaxed))
+        return;
+
+    int64_t *v = mm_alloc((uint64_t)rows * e->N * sizeof(int64_t));
+    mm_gemm_packed(rows, e->N, e->K, &e->A[lo * e->lda], e->lda, e->B, e->ldb,
+                   v, e->N, 0);
+    for (uint32_t i=0; i<rows; i++)
+        if (memcmp(&v[(uint64_t)i * e->N], &e->C[(lo + i) * e->ldc],
+                   e->N * sizeof(int64_t))) {
+            atomic_store_explicit(&e->bad, 1, memory_order_relaxed);
+            break;
+        }
+    mm_free(v);
+}
+
+/*
+ *  mm_verify_exact - C == A * B, recomputed in parallel bands
+ *      @M, @N, @K: A is M x K, B is K x N, C is M x N
+ *      @lda, @ldb, @ldc: row strides
+ *      @return: 1 if C == A * B, 0 otherwise
+ */
+int
+mm_verify_exact(uint32_t M, uint32_t N, uint32_t K,
+                const int64_t *A, uint64_t lda,
+                const int64_t *B, uint64_t ldb,
+                const int64_t *C, uint64_t ldc)
+{
+    struct exact_ctx e = {
+        .M = M, .N = N, .K = K,
+        .A = A, .B = B, .C = C,
+        .lda = lda, .ldb = ldb, .ldc = ldc,
+    };
+    uint64_t bands = (M + VERIFY_BAND - 1) / VERIFY_BAND;
+
+    if (!M || !N)
+        return 1;
+
+    mm_ws_run(0, exact_task, &e, bands);
+    return !e.bad;
+}
+
+/*
+ *  mm_verify_gemm - verify_matrix for an M x K times K x N product:
+ *                   Freivalds with MM_VERIFY_TRIALS trials, or
+ *                   mm_verify_exact if MM_VERIFY=exact
+ *      @lda, @ldb, @ldc: row strides
+ *      @return: 1 if C == A * B, 0 otherwise
+ */
+int
+mm_verify_gemm(uint32_t M, uint32_t N, uint32_t K,
+               const int64_t *A, uint64_t lda,
+               const int64_t *B, uint64_t ldb,
+               const int64_t *C, uint64_t ldc)
+{
+    const char *mode = getenv("MM_VERIFY");
+    const char *trials = getenv("MM_VERIFY_TRIALS");
+
+    if (mode && !strcmp(mode, "exact"))
+        return mm_verify_exact(M, N, K, A, lda, B, ldb, C, ldc);
+    return mm_verify_freivalds(M, N, K, A, lda, B, ldb, C, ldc,
+                               trials ? strtoul(trials, NULL, 10) : 0);
+}
@@ -1,63 +1,4 @@
 #!/bin/bash
-export KMP_STACKSIZE=1g
-export OMP_STACKSIZE=1g
-ulimit -s unlimited 
-./mat_mul_pt 256 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 256 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 256 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 512 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 512 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 512 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 1024 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 1024 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 1024 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 2048 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 2048 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 2048 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 4096 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 4096 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 4096 0 >> mat_mul_pt_taff.log
-
-./mat_mul_pt2_precopy 256 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 256 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 256 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 512 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 512 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 512 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 1024 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 1024 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 1024 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 2048 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 2048 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 2048 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 4096 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 4096 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 4096 0 >> mat_mul_pt2_precopy_taff.log
-
-./mat_mul_pt3_stride 256 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 256 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 256 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 512 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 512 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 512 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 1024 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 1024 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 1024 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 2048 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 2048 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 2048 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 4096 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 4096 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 4096 0 >> mat_mul_pt3_stride_taff.log
-
-./mat_mul_pt 8192 0 >> mat_mul_pt_taff.log 
-./mat_mul_pt 8192 0 >> mat_mul_pt_taff.log
-./mat_mul_pt 8192 0 >> mat_mul_pt_taff.log
-
-./mat_mul_pt2_precopy 8192 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 8192 0 >> mat_mul_pt2_precopy_taff.log
-./mat_mul_pt2_precopy 8192 0 >> mat_mul_pt2_precopy_taff.log
-
-./mat_mul_pt3_stride 8192 0 >> mat_mul_pt3_stride_taff.log 
-./mat_mul_pt3_stride 8192 0 >> mat_mul_pt3_stride_taff.log
-./mat_mul_pt3_stride 8192 0 >> mat_mul_pt3_stride_taff.log
+# every configuration is repeated until its 95% CI is within 2% of the mean
+./mat_mul_bench -k pt1,pt_precopy,pt_stride -n 256,512,1024,2048,4096,8192 \
+    -w 1 -r 3 -R 30 -c 0.02 -T 60 -f csv "$@" > mat_mul_bench.csv